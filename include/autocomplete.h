@@ -0,0 +1,73 @@
+#pragma once
+
+//Подсказки при наборе: префиксное дерево по названиям и авторам в нижнем регистре
+//(foldCase). Дерево сжатое: цепочки без ветвлений хранятся одной дугой с меткой-строкой,
+//узлы лежат в одном массиве (дети узла - подряд, по возрастанию первого байта метки),
+//метки - в общем буфере. В каждом узле - максимальный рейтинг в его поддереве, поэтому
+//K лучших продолжений префикса находятся обходом "сначала лучший" без просмотра всего
+//поддерева: очередь по рейтингу, узел раскрывается, только когда он лучший из оставшихся.
+
+#include "media.h"
+#include "catalog_store.h"
+#include "catalog_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Suggestion {
+    std::string text; //название или автор как в каталоге (у записи с лучшим рейтингом)
+    bool author = false;
+    double rating = 0; //лучший рейтинг среди записей с этим текстом
+    size_t row = 0;    //строка этой записи
+};
+
+class PrefixIndex {
+public:
+    //по первым rows строкам каталога (ключи - названия и авторы)
+    static std::shared_ptr<const PrefixIndex> build(MediaSpan catalog, uint64_t base);
+
+    size_t rows() const { return rows_; }
+    uint64_t base() const { return base_; }
+    size_t nodeCount() const { return nodes_.size(); }
+
+    //k продолжений prefix (в нижнем регистре) по убыванию рейтинга
+    std::vector<Suggestion> complete(const std::string& prefix, size_t k) const;
+
+private:
+    struct Node {
+        uint32_t label = 0;      //метка дуги в узел: labels_[label, label + labelLength)
+        uint16_t labelLength = 0;
+        uint16_t childCount = 0;
+        uint32_t firstChild = 0;
+        int32_t entry = -1;      //ключ, который заканчивается в узле
+        double maxRating = 0;    //лучший рейтинг в поддереве
+    };
+
+    struct Entry {
+        std::string text;
+        bool author = false;
+        double rating = 0;
+        uint32_t row = 0;
+    };
+
+    struct Key;
+    uint32_t buildNode(uint32_t node, const std::vector<Key>& keys, size_t begin, size_t end, size_t depth);
+
+    size_t rows_ = 0;
+    uint64_t base_ = 0;
+    std::vector<Node> nodes_; //узел 0 - корень
+    std::string labels_;
+    std::vector<Entry> entries_;
+};
+
+//подсказки для цепочки версий: дерево строится по снимку и годится его продолжениям
+//(строки вставок после дерева просматриваются), перестраивается, когда их много
+class PrefixIndexHolder {
+public:
+    std::vector<Suggestion> complete(const CatalogSnapshot& snapshot, const std::string& prefix, size_t k);
+
+private:
+    SharedIndex<PrefixIndex> index_;
+};
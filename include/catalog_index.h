@@ -0,0 +1,164 @@
+#pragma once
+
+//Индексы версии каталога для планировщика составных запросов (planner.h):
+//  - триграммы названия (в нижнем регистре) и автора: строки, где встречается
+//    каждая тройка байтов; кандидаты на подстроку - пересечение списков ее триграмм;
+//  - списки строк по тегам;
+//  - строки по годам с деревом Фенвика (year_index.h) и гистограмма рейтингов;
+//  - столбцы года и рейтинга для векторных фильтров (column_filter.h);
+//  - карта блоков с границами года, рейтинга и маской тегов (zone_map.h).
+//Списки триграмм и тегов хранятся сжатыми (posting_codec.h).
+//Индекс строится по первым rows() строкам и не меняется. Вставки дописывают записи в
+//конец, поэтому индекс версии подходит и ее продолжениям (та же base): строки после
+//rows() - "хвост", который просматривается целиком. IndexHolder перестраивает индекс,
+//когда хвост становится большим.
+
+#include "media.h"
+#include "catalog_store.h"
+#include "column_filter.h"
+#include "zone_map.h"
+#include "year_index.h"
+#include "posting_codec.h"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//сжатые списки строк по ключам (posting_codec.h)
+struct PostingLists {
+    std::unordered_map<uint32_t, uint32_t> slots; //ключ -> номер списка
+    std::vector<CompressedPostings> lists;
+
+    size_t size(uint32_t key) const;
+    //nullptr, если ключа нет
+    const CompressedPostings* find(uint32_t key) const;
+};
+
+//первый элемент отсортированного [first, last), не меньший value: шаги 1, 2, 4... от начала,
+//потом двоичный поиск - O(log расстояния); для пересечения короткого списка с длинным
+const uint32_t* gallop(const uint32_t* first, const uint32_t* last, uint32_t value);
+
+class CatalogIndex {
+public:
+    static std::shared_ptr<const CatalogIndex> build(MediaSpan catalog, uint64_t base);
+
+    size_t rows() const { return rows_; }
+    uint64_t base() const { return base_; }
+
+    //подстрока (для названия - в нижнем регистре): верхняя оценка числа строк по самому
+    //короткому списку ее триграмм; SIZE_MAX - короче трех байтов, индекс не поможет
+    size_t trigramEstimate(const std::string& pattern, bool title) const;
+    //сумма длин списков триграмм (работа на пересечение)
+    size_t trigramWork(const std::string& pattern, bool title) const;
+    //строки, где есть все триграммы подстроки (кандидаты, их надо проверить), по возрастанию
+    std::vector<uint32_t> trigramCandidates(const std::string& pattern, bool title) const;
+
+    size_t tagCount(const std::string& tag) const;
+    std::vector<uint32_t> tagRows(const std::string& tag) const;
+
+    //годы [from, to] включительно
+    size_t yearCount(int from, int to) const;
+    std::vector<uint32_t> yearRows(int from, int to) const;
+
+    //строк с рейтингом в [from, to] (оценка по гистограмме с шагом 0.1)
+    size_t ratingCount(double from, double to) const;
+
+    const CatalogColumns& columns() const { return columns_; }
+    const ZoneMap& zones() const { return zones_; }
+
+private:
+    size_t rows_ = 0;
+    uint64_t base_ = 0;
+    PostingLists titleTrigrams_;
+    PostingLists authorTrigrams_;
+    std::unordered_map<std::string, CompressedPostings> tags_;
+    YearIndex years_;
+    std::vector<uint32_t> ratingCounts_; //корзины по 0.1 от 0 до 10
+    CatalogColumns columns_;
+    ZoneMap zones_;
+};
+
+//построенное по rows строкам цепочки base годится для снимка без перестройки: та же цепочка,
+//а строк, вставленных после построения, немного (их досматривают полным проходом)
+bool coversSnapshot(size_t rows, uint64_t base, const CatalogSnapshot& snapshot);
+
+//общий индекс последней цепочки версий для запросов из многих потоков. Индекс строится
+//вне мьютекса (построение идет по кускам на пуле, а пул не должен ждать мьютекс, который
+//держит строящий поток); запросы к той же цепочке, пришедшие во время построения, ждут
+//его результата, а не строят свой. Под мьютексом - только выбор и публикация.
+template <typename Index>
+class SharedIndex {
+public:
+    //готовый индекс, годный для снимка; nullptr - его нет (ничего не строит)
+    std::shared_ptr<const Index> peek(const CatalogSnapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(lock_);
+        return ready_ && coversSnapshot(readyRows_, readyBase_, snapshot) ? ready_ : nullptr;
+    }
+
+    //индекс, годный для снимка: готовый, строящийся другим потоком или построенный здесь
+    //build(); nullptr - снимок старше индекса той же цепочки (строк индекса в нем нет)
+    template <typename Build>
+    std::shared_ptr<const Index> get(const CatalogSnapshot& snapshot, const Build& build) {
+        size_t size = snapshot.records().size();
+        uint64_t base = snapshot.base();
+        std::packaged_task<std::shared_ptr<const Index>()> task;
+        std::shared_future<std::shared_ptr<const Index>> result;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (ready_ && readyBase_ == base && readyRows_ > size) return nullptr;
+            if (ready_ && coversSnapshot(readyRows_, readyBase_, snapshot)) return ready_;
+            if (building_.valid() && buildingBase_ == base && buildingRows_ > size) return nullptr;
+            if (!building_.valid() || !coversSnapshot(buildingRows_, buildingBase_, snapshot)) {
+                task = std::packaged_task<std::shared_ptr<const Index>()>([&] { return build(); });
+                building_ = task.get_future().share();
+                buildingRows_ = size;
+                buildingBase_ = base;
+            }
+            result = building_;
+        }
+        if (task.valid()) {
+            task();
+            std::shared_ptr<const Index> built;
+            try {
+                built = result.get();
+            }
+            catch (...) { //ошибку получат все ждущие; следующий запрос попробует снова
+            }
+            std::lock_guard<std::mutex> lock(lock_);
+            if (buildingRows_ == size && buildingBase_ == base) building_ = {};
+            if (built && (!ready_ || readyBase_ != base || readyRows_ < size)) {
+                ready_ = built;
+                readyRows_ = size;
+                readyBase_ = base;
+            }
+        }
+        return result.get();
+    }
+
+private:
+    std::mutex lock_;
+    std::shared_ptr<const Index> ready_;
+    size_t readyRows_ = 0;
+    uint64_t readyBase_ = 0;
+    std::shared_future<std::shared_ptr<const Index>> building_;
+    size_t buildingRows_ = 0;
+    uint64_t buildingBase_ = 0;
+};
+
+//индекс последней использованной цепочки версий для запросов из многих потоков
+class IndexHolder {
+public:
+    //индекс, годный для снимка (та же base); nullptr, если каталог пуст
+    std::shared_ptr<const CatalogIndex> get(const CatalogSnapshot& snapshot);
+    //только карта блоков (для топа): из индекса, если он годен для снимка, иначе своя -
+    //она строится за один проход, без триграмм; nullptr, если каталог пуст
+    std::shared_ptr<const ZoneMap> zones(const CatalogSnapshot& snapshot);
+
+private:
+    SharedIndex<CatalogIndex> index_;
+    SharedIndex<ZoneMap> zones_;
+};
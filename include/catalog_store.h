@@ -0,0 +1,98 @@
+#pragma once
+
+//Каталог для одновременного чтения и записи (в стиле RCU).
+//Каждая версия каталога неизменяема. Читатель закрепляет текущую версию
+//(CatalogSnapshot) без блокировок: объявляет эпоху в своем слоте и читает указатель.
+//Писатель собирает новую версию рядом, публикует ее атомарной заменой указателя
+//и откладывает старую; старая удаляется, когда все закрепившие ее читатели ушли
+//(эпохи всех активных слотов новее эпохи, в которой версию убрали).
+//Версии одной цепочки вставок делят буфер записей: вставка дописывает записи в его
+//свободный хвост (читатели старых версий туда не заглядывают) и публикует версию
+//с большим числом строк. Когда хвост кончается, записи копируются в новый буфер
+//в полтора раза больше - вставка стоит в среднем O(1) записей, а не копию каталога.
+//Массовый импорт все равно лучше вставлять пачками (insertBatch) - одна версия на пачку.
+
+#include "media.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct CatalogVersion {
+    uint64_t number = 0;
+    //номер версии, с которой началась цепочка вставок (создание или replace): версии с
+    //одной базой - продолжения друг друга, их общие строки совпадают
+    uint64_t base = 0;
+    //буфер цепочки; записи версии - первые size, их адреса не меняются, пока буфер жив
+    std::shared_ptr<std::vector<Media>> buffer;
+    const Media* data = nullptr;
+    size_t size = 0;
+};
+
+class CatalogStore;
+class QueryCache;
+
+//закрепленная версия каталога; пока объект жив, records() не меняется и не удаляется.
+//Освобождать снимок нужно в том же потоке, где он взят.
+class CatalogSnapshot {
+public:
+    CatalogSnapshot(CatalogSnapshot&& other) noexcept;
+    ~CatalogSnapshot();
+    CatalogSnapshot(const CatalogSnapshot&) = delete;
+    CatalogSnapshot& operator=(const CatalogSnapshot&) = delete;
+    CatalogSnapshot& operator=(CatalogSnapshot&&) = delete;
+
+    MediaSpan records() const { return MediaSpan(version_->data, version_->size); }
+    //буфер записей: records() живы, пока он есть, и после освобождения снимка (так их
+    //читает ответ, который продолжается в других потоках)
+    std::shared_ptr<const std::vector<Media>> buffer() const { return version_->buffer; }
+    uint64_t version() const { return version_->number; }
+    uint64_t base() const { return version_->base; }
+
+private:
+    friend class CatalogStore;
+    CatalogSnapshot(CatalogStore* store, const CatalogVersion* version)
+        : store_(store), version_(version) {}
+
+    CatalogStore* store_;
+    const CatalogVersion* version_;
+};
+
+class CatalogStore {
+public:
+    explicit CatalogStore(std::vector<Media> records = {});
+    //читателей к этому моменту быть не должно
+    ~CatalogStore();
+    CatalogStore(const CatalogStore&) = delete;
+    CatalogStore& operator=(const CatalogStore&) = delete;
+
+    CatalogSnapshot snapshot();
+
+    //проверяет запись и публикует версию с ней; false - запись некорректна
+    bool insert(Media m);
+    //добавляет корректные записи пачки одной новой версией; возвращает число добавленных
+    size_t insertBatch(std::vector<Media> records);
+    //заменяет каталог целиком (например, после загрузки другого файла)
+    void replace(std::vector<Media> records);
+
+    //кэш результатов, который узнает о вставках до публикации новой версии (query_cache.h);
+    //подключается до начала чтения и записи
+    void attachCache(QueryCache* cache) { cache_ = cache; }
+
+    //удаляет отложенные версии, которые больше никто не читает
+    void reclaim();
+    size_t retiredCount() const { return retiredCount_.load(std::memory_order_relaxed); }
+
+private:
+    void publish(CatalogVersion* next);
+    void reclaimLocked();
+
+    std::atomic<const CatalogVersion*> current_;
+    std::mutex writeLock_; //писатели - по одному
+    std::vector<std::pair<uint64_t, const CatalogVersion*>> retired_; //эпоха удаления, версия
+    std::atomic<size_t> retiredCount_{ 0 };
+    QueryCache* cache_ = nullptr;
+};
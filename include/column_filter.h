@@ -0,0 +1,42 @@
+#pragma once
+
+//Столбцы года и рейтинга для фильтров по диапазонам и битовые карты выбранных строк.
+//Год хранится как int16, рейтинг - в фиксированной точке (рейтинг * 10, тоже int16),
+//поэтому оба фильтра - одно ядро сравнения 16-битных чисел: 8 строк за команду на SSE2,
+//16 - на AVX2. Результат - битовая карта (бит на строку, слово на 64 строки); карты
+//нескольких условий и тегов пересекаются побитовым AND, номера строк извлекаются один
+//раз в конце.
+
+#include "media.h"
+
+#include <cstdint>
+#include <vector>
+
+struct CatalogColumns {
+    std::vector<int16_t> years;
+    std::vector<int16_t> ratings; //рейтинг * 10
+    bool yearsExact = true;       //все годы помещаются в int16
+    bool ratingsExact = true;     //все рейтинги кратны 0.1 (иначе фильтр по рейтингу идет по записям)
+
+    size_t size() const { return years.size(); }
+};
+
+CatalogColumns buildColumns(MediaSpan catalog);
+
+inline size_t bitmapWords(size_t rows) { return (rows + 63) / 64; }
+
+//бит i слова out[i / 64] - строка i выполняет lo <= values[i] <= hi (с negate - не выполняет);
+//combine - пересечь с тем, что уже лежит в out. Биты за концом последнего слова - нули.
+void filterRange16(const int16_t* values, size_t n, int16_t lo, int16_t hi, bool negate, bool combine,
+    uint64_t* out);
+
+//границы рейтинга в фиксированной точке: наименьшее k с k / 10.0 >= value
+//и наибольшее k с k / 10.0 <= value (сравнение - как у самих рейтингов в double)
+int ratingAtLeast(double value);
+int ratingAtMost(double value);
+
+//строки из отсортированного списка [first, last) - в карту (строки за пределами words * 64 пропускаются)
+void setBitmapRows(const uint32_t* first, const uint32_t* last, uint64_t* bits, size_t words);
+void andBitmap(uint64_t* bits, const uint64_t* other, size_t words);
+//номера строк с единичными битами (first - номер строки бита 0) дописываются в rows
+void appendBitmapRows(const uint64_t* bits, size_t words, uint32_t first, std::vector<uint32_t>& rows);
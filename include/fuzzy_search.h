@@ -0,0 +1,86 @@
+#pragma once
+
+//Поиск с опечатками: слова запроса сопоставляются со словами названий и авторов
+//(splitWords) по расстоянию Левенштейна в буквах. Словарь слов каталога лежит в
+//префиксном дереве по буквам; поиск похожих слов - обход дерева со строкой таблицы
+//Левенштейна на каждом уровне (это и есть проход автомата Левенштейна по словарю):
+//ветка отбрасывается, как только все значения в строке больше допустимого расстояния,
+//поэтому просматривается малая часть словаря. Для каждого слова словаря - список строк,
+//где оно встречается; строки запроса - пересечение списков по словам запроса.
+
+#include "media.h"
+#include "catalog_store.h"
+#include "catalog_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct FuzzyMatch {
+    size_t row = 0;
+    int distance = 0; //сумма опечаток по словам запроса
+    float rating = 0; //для порядка выдачи
+};
+
+class TermIndex {
+public:
+    //по первым rows строкам каталога
+    static std::shared_ptr<const TermIndex> build(MediaSpan catalog, uint64_t base);
+
+    size_t rows() const { return rows_; }
+    uint64_t base() const { return base_; }
+    size_t termCount() const { return terms_.size(); }
+    const std::string& term(uint32_t id) const { return terms_[id]; }
+
+    //слова словаря на расстоянии не больше maxDistance от word: (номер слова, расстояние)
+    std::vector<std::pair<uint32_t, int>> similarTerms(const std::u32string& word, int maxDistance) const;
+    //рейтинг строки из плотного столбца (сортировка найденного без обращений к записям)
+    float rating(uint32_t row) const { return ratings_[row]; }
+    //строки со словом по возрастанию
+    std::pair<const uint32_t*, const uint32_t*> termRows(uint32_t id) const {
+        return { postings_.data() + offsets_[id], postings_.data() + offsets_[id + 1] };
+    }
+
+private:
+    struct Node {
+        char32_t letter = 0;
+        int32_t term = -1; //слово, которое заканчивается в узле
+        uint32_t firstChild = 0;
+        uint32_t childCount = 0;
+    };
+
+    void buildNode(uint32_t node, const std::vector<std::u32string>& words, size_t begin, size_t end, size_t depth);
+    void walk(uint32_t node, const std::u32string& word, int maxDistance, size_t depth,
+        std::vector<std::vector<int>>& table, std::vector<std::pair<uint32_t, int>>& out) const;
+
+    size_t rows_ = 0;
+    uint64_t base_ = 0;
+    std::vector<std::string> terms_;  //по возрастанию
+    std::vector<uint32_t> offsets_;   //строки слова t - postings_[offsets_[t], offsets_[t + 1])
+    std::vector<uint32_t> postings_;
+    std::vector<Node> nodes_;         //узел 0 - корень, дети узла подряд по возрастанию буквы
+    std::vector<float> ratings_;
+};
+
+//текст UTF-8 по буквам (некорректные байты - как есть)
+std::u32string decodeUtf8(const std::string& s);
+//опечаток в слове из letters букв: до 2 букв - 0, до 5 - 1, длиннее - 2, но не больше limit
+int fuzzyDistanceFor(size_t letters, int limit);
+
+//строки, где для каждого слова запроса есть слово названия или автора с допустимым числом
+//опечаток; по возрастанию суммы опечаток, затем по убыванию рейтинга
+std::vector<FuzzyMatch> fuzzySearch(const TermIndex& index, const std::string& text, int maxDistance);
+
+//номера строк в порядке выдачи
+std::vector<size_t> fuzzyRows(const std::vector<FuzzyMatch>& matches);
+
+//индекс для цепочки версий: строки вставок после построения проверяются напрямую
+class FuzzyIndexHolder {
+public:
+    std::vector<FuzzyMatch> search(const CatalogSnapshot& snapshot, const std::string& text, int maxDistance);
+
+private:
+    SharedIndex<TermIndex> index_;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+//HTTP/1.1 JSON API каталога поверх цикла событий из server.h (без внешних библиотек).
+//  GET  /search?q=текст[&limit=N]   поиск по названию/автору
+//  GET  /tag?tag=тег[&limit=N]      фильтр по тегу
+//  GET  /top?n=N                    топ-N по рейтингу
+//  GET  /stats                      статистика
+//  GET  /query?q=запрос[&limit=N]   составной запрос (query_lang.h); EXPLAIN - план в JSON
+//  GET  /years?from=Y&to=Y[&limit=N] записи за годы (годовой индекс, year_index.h)
+//  GET  /histogram[?step=10&from=Y&to=Y] число записей по столбцам лет
+//  GET  /records[?offset=K&limit=N] записи каталога по порядку
+//  POST /records                    вставка записи (тело - JSON-запись)
+//Соединения постоянные (keep-alive), запросы можно слать конвейером. Ответы с
+//записями передаются по частям (Transfer-Encoding: chunked) прямо из строк каталога,
+//следующая часть - когда клиент забрал предыдущие. Клиенту HTTP/1.0 ответ идет в его
+//версии и без chunked: записи - телом до закрытия соединения, остальное - с Content-Length.
+
+#include "server.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+const size_t MAX_HEAD = 64 << 10; //наибольший заголовок запроса, байт
+const size_t MAX_BODY = 1 << 20;  //наибольшее тело (Content-Length), байт
+
+//RequestParser для HTTP: забирает из in целые запросы (заголовок + тело по Content-Length).
+//Запрос, тело которого нельзя отделить от следующего (Transfer-Encoding, неверный
+//Content-Length), отдается одним заголовком, а остаток in отбрасывается; false -
+//заголовок длиннее MAX_HEAD
+bool parseHttpRequests(std::string& in, std::vector<std::string>& requests);
+
+int runHttpServer(QueryContext& context, const ServerConfig& config);
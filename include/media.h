@@ -0,0 +1,167 @@
+#pragma once
+
+//Каталог медиа: запись, загрузка/сохранение, поиск, статистика.
+//Общая часть для приложения LR и вспомогательных программ (генератор, бенчмарк).
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//настройки ширины колонок таблицы (в колонках терминала, а не в байтах)
+const int TITLE_WIDTH = 30;
+const int AUTHOR_WIDTH = 25;
+const int YEAR_WIDTH = 8;
+const int RATING_WIDTH = 10;
+
+//поток служебных сообщений: в меню это cout, в пакетном режиме - cerr,
+//чтобы в stdout попадали только данные
+extern std::ostream* logStream;
+std::ostream& logOut();
+
+/*------UTF-8------*/
+uint32_t decodeUtf8(const std::string& s, size_t& pos);
+int charWidth(uint32_t cp);
+void appendUtf8(std::string& out, uint32_t cp);
+
+//ширина строки для вывода в колонку
+struct TextWidth {
+    int width = 0;        //полная ширина строки в колонках
+    size_t cutBytes = 0;  //длина в байтах префикса, который влезает до "..."
+    int cutWidth = 0;     //ширина этого префикса в колонках
+};
+
+TextWidth measureText(const std::string& s, int limit);
+
+/*------Медиа------*/
+struct Media {
+    std::string id;        // уникальный номер
+    std::string title;     // название
+    std::string author;    // автор/режиссер
+    int year;              // год выпуска
+    std::vector<std::string> tags;  // теги/категории
+    double rating;         // рейтинг от 0.0 до 10.0 (9.8)
+
+    //закэшированная ширина названия и автора для табличного вывода
+    TextWidth titleWidth;
+    TextWidth authorWidth;
+
+    // простой конструктор для удобства
+    Media(std::string i = "", std::string t = "", std::string a = "",
+        int y = 0, std::vector<std::string> tg = {}, double r = 0.0)
+        : id(i), title(t), author(a), year(y), tags(tg), rating(r) {
+        cacheWidths();
+    }
+
+    //пересчитывает ширины; вызывать после изменения title или author
+    void cacheWidths() {
+        titleWidth = measureText(title, TITLE_WIDTH - 3);
+        authorWidth = measureText(author, AUTHOR_WIDTH - 3);
+    }
+};
+
+//записи подряд в памяти, без владения: весь вектор или версия каталога (catalog_store.h),
+//которая делит буфер записей с соседними версиями
+class MediaSpan {
+public:
+    MediaSpan() = default;
+    MediaSpan(const Media* data, size_t size) : data_(data), size_(size) {}
+    MediaSpan(const std::vector<Media>& records) : data_(records.data()), size_(records.size()) {}
+
+    const Media* begin() const { return data_; }
+    const Media* end() const { return data_ + size_; }
+    const Media* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const Media& operator[](size_t i) const { return data_[i]; }
+
+private:
+    const Media* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/*------Валидация------*/
+bool isValid(const Media& m);
+//та же проверка без сообщений (потокобезопасна)
+bool checkRecord(const Media& m);
+//добавляет запись, если она корректна (с замером в метриках)
+bool insertRecord(std::vector<Media>& catalog, Media m);
+
+/*------Загрузка------*/
+std::string deltaFileName(const std::string& filename);
+std::string readJsonString(std::istringstream& stream);
+bool parseJsonLine(const std::string& line, Media& m);
+bool parseJsonObject(const std::string& line, std::map<std::string, std::string>& fields);
+//формат определяется по содержимому: JSON-массив, JSON-строки или бинарный снимок
+std::vector<Media> loadFromFile(const std::string& filename);
+
+/*-------Поиск и фильтрация------*/
+//на больших каталогах поиск идет по кускам в общем пуле потоков (thread_pool.h).
+//Варианты findRows* возвращают номера строк по возрастанию, без копирования записей.
+bool matchesSubstring(const Media& item, const std::string& searchLower, const std::string& searchText,
+    std::string& titleLower);
+//нижний регистр для латиницы и кириллицы в UTF-8 (Ё -> ё), остальные байты как есть;
+//длина в байтах не меняется
+std::string foldCase(const std::string& s);
+//слова текста после foldCase: буквы и цифры (любые символы вне ASCII, кроме знаков
+//препинания Latin-1 и U+2000-U+203F), остальное - разделители
+std::vector<std::string> splitWords(const std::string& s);
+std::vector<size_t> findRowsBySubstring(MediaSpan catalog, const std::string& searchText);
+std::vector<size_t> findRowsByTag(MediaSpan catalog, const std::string& tag);
+std::vector<Media> selectRows(MediaSpan catalog, const std::vector<size_t>& rows);
+std::vector<Media> findBySubstring(MediaSpan catalog, const std::string& searchText);
+std::vector<Media> findByTag(MediaSpan catalog, const std::string& tag);
+struct ZoneMap;
+//zones - карта блоков первых строк каталога (zone_map.h): блоки, где нет рейтинга лучше
+//уже набранных n, пропускаются
+std::vector<size_t> getTopRows(MediaSpan catalog, int n, const ZoneMap* zones = nullptr);
+std::vector<Media> getTopN(MediaSpan catalog, int n);
+std::vector<std::pair<std::string, int>> collectDuplicates(MediaSpan catalog);
+void findDuplicates(MediaSpan catalog);
+
+/*------Вывод информации------*/
+void printCatalog(MediaSpan catalog);
+
+//статистика каталога
+struct CatalogStats {
+    size_t total = 0;
+    double avgRating = 0;
+    int minYear = 9999, maxYear = 0;
+    std::vector<std::pair<std::string, int>> tagCounts; //теги по убыванию частоты
+};
+
+CatalogStats computeStatistics(MediaSpan catalog);
+void printStatistics(MediaSpan catalog);
+void printStatistics(const CatalogStats& stats);
+
+/*------Сохранение в файл------*/
+
+//форматы файлов каталога
+enum class CatalogFormat {
+    Json,     //массив объектов, одно поле на строку (основной формат)
+    JsonLines, //один объект на строку (.jsonl, дельта)
+    Snapshot  //бинарный снимок (.bin)
+};
+
+//формат по расширению имени файла: .jsonl, .bin, иначе JSON
+CatalogFormat formatForFile(const std::string& filename);
+
+void appendJsonString(std::string& out, const std::string& s);
+void appendJsonRecord(std::string& out, const Media& item);
+void appendJsonLine(std::string& out, const Media& item);
+void appendJsonObject(std::string& out, const Media& item);
+void appendSnapshotHeader(std::string& out, uint64_t count);
+void appendSnapshotRecord(std::string& out, const Media& item);
+bool writeAll(int fd, const char* data, size_t size);
+
+//атомарное сохранение (временный файл, fsync, rename); формат - по расширению
+bool saveToFile(MediaSpan catalog, const std::string& filename);
+//дописывает в дельту записи после savedCount и сдвигает savedCount
+bool saveDelta(MediaSpan catalog, const std::string& filename, size_t& savedCount);
+
+/*------Создание тестовых данных------*/
+std::vector<Media> createTestCatalog();
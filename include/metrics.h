@@ -0,0 +1,136 @@
+#pragma once
+
+//Метрики операций каталога: гистограммы задержек в стиле HDR (логарифмические
+//корзины с линейным делением внутри, погрешность ~3%).
+//Каждый поток пишет в свою копию гистограмм без блокировок (единственный писатель,
+//relaxed-атомики), при выводе копии всех потоков складываются.
+//В режиме профилирования (enablePerfCounters) вместе с временем копятся аппаратные
+//счетчики и число обработанных записей - для счетчиков в расчете на запись.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+
+//операции, по которым собираются метрики
+enum class Op {
+    Load,
+    Save,
+    SaveDelta,
+    SearchSubstring,
+    SearchTag,
+    TopN,
+    Duplicates,
+    Stats,
+    Insert,
+    BatchScan,
+    CatalogQuery,
+    YearIndex,
+    Suggest,
+    Fuzzy,
+    TextSearch,
+    Count //число операций, не операция
+};
+
+const char* opName(Op op);
+
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 5;                 //32 линейные подкорзины на степень двойки
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS) * SUB_COUNT;
+
+    //записывает значение (наносекунды); вызывать только из потока-владельца
+    void record(uint64_t value);
+
+    static int bucketIndex(uint64_t value);
+    //середина диапазона значений корзины
+    static uint64_t bucketValue(int index);
+
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{ 0 };
+    std::atomic<uint64_t> sum{ 0 };
+    std::atomic<uint64_t> max{ 0 };
+};
+
+//сводка по операции со всех потоков
+struct OpSummary {
+    uint64_t count = 0;
+    double sumSeconds = 0;
+    double p50 = 0, p90 = 0, p99 = 0, max = 0; //секунды
+    double throughput = 0; //операций в секунду с момента запуска
+};
+
+//суммы аппаратных счетчиков по операции; writer - поток-владелец, как у гистограммы
+struct PerfTotals {
+    std::atomic<uint64_t> samples{ 0 };
+    std::atomic<uint64_t> records{ 0 };
+    std::atomic<uint64_t> values[(int)PerfCounter::Count] = {};
+};
+
+struct PerfSummary {
+    uint64_t samples = 0;
+    uint64_t records = 0;
+    uint64_t values[(int)PerfCounter::Count] = {};
+    bool available[(int)PerfCounter::Count] = {};
+};
+
+//обращения к кэшу результатов запросов (query_cache.h)
+struct CacheCounters {
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+    std::atomic<uint64_t> invalidations{ 0 }; //удалено записей при вставках и очистке
+};
+
+struct CacheSummary {
+    uint64_t hits = 0, misses = 0, invalidations = 0;
+    double hitRatio = 0;
+};
+
+//записывает длительность операции в гистограмму текущего потока
+void recordLatency(Op op, uint64_t nanoseconds);
+void recordPerf(Op op, const PerfSample& delta, size_t records);
+void recordCacheLookup(bool hit);
+void recordCacheInvalidations(size_t count);
+OpSummary summarize(Op op);
+CacheSummary summarizeCache();
+PerfSummary summarizePerf(Op op);
+
+//таблица для меню и текст в формате Prometheus
+void printMetrics(std::ostream& out);
+//таблица аппаратных счетчиков на запись (печатается в printMetrics в режиме профилирования)
+void printPerfCounters(std::ostream& out);
+std::string formatPrometheus();
+bool writePrometheusFile(const std::string& filename);
+
+//замеряет время жизни объекта и записывает его как длительность операции
+class OpTimer {
+public:
+    explicit OpTimer(Op op) : op_(op) {
+        if (perfCountersEnabled()) {
+            profiling_ = true;
+            perfStart_ = readPerfCounters();
+        }
+        start_ = std::chrono::steady_clock::now();
+    }
+    ~OpTimer() {
+        recordLatency(op_, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+        if (profiling_) recordPerf(op_, perfDelta(perfStart_, readPerfCounters()), records_);
+    }
+    //число записей, обработанных операцией (для счетчиков на запись)
+    void setRecords(size_t records) { records_ = records; }
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+
+private:
+    Op op_;
+    std::chrono::steady_clock::time_point start_;
+    bool profiling_ = false;
+    size_t records_ = 0;
+    PerfSample perfStart_;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+//Аппаратные счетчики процессора (Linux perf_event_open, без внешних программ):
+//такты, инструкции, промахи последнего уровня кэша и промахи предсказания переходов.
+//Счетчики открываются группой на каждый поток при первом замере (потоки пула -
+//перед первой задачей после включения) и считают только пользовательский код потока.
+//readPerfCounters читает группу вызывающего потока: замер операции в metrics.h не
+//видит работу, отданную пулу (параллельные проходы, форматирование при сохранении).
+//readProcessPerfCounters складывает группы всех потоков, включая пул: так считает
+//бенчмарк, и в его замер попадает все, что потоки делали за это время.
+//Если счетчики недоступны (не Linux, запрет ядра, виртуальная машина без PMU),
+//enablePerfCounters возвращает false, и программа работает без них.
+
+#include <cstdint>
+#include <string>
+
+enum class PerfCounter {
+    Cycles,
+    Instructions,
+    CacheMisses,  //промахи последнего уровня кэша (LLC)
+    BranchMisses,
+    Count //число счетчиков, не счетчик
+};
+
+const char* perfCounterName(PerfCounter counter);
+
+//значения счетчиков; -1 - счетчик не открылся
+struct PerfSample {
+    int64_t values[(int)PerfCounter::Count] = { -1, -1, -1, -1 };
+};
+
+//включает замеры; при неудаче причина пишется в error
+bool enablePerfCounters(std::string& error);
+bool perfCountersEnabled();
+
+//текущие значения счетчиков потока (с поправкой на мультиплексирование)
+PerfSample readPerfCounters();
+//сумма счетчиков всех потоков, где они открыты; счетчик есть, если он открылся хотя бы в одном
+PerfSample readProcessPerfCounters();
+//открывает счетчики текущего потока, если замеры включены (вызывается потоками пула)
+void attachPerfCounters();
+//разность end - start; недоступные счетчики остаются -1
+PerfSample perfDelta(const PerfSample& start, const PerfSample& end);
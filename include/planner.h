@@ -0,0 +1,51 @@
+#pragma once
+
+//Планировщик и исполнитель составных запросов (query_lang.h).
+//Для каждого условия, которое поддерживает индекс (catalog_index.h), оценивается
+//число строк по статистике индекса и стоимость выборки; дешевейший путь становится
+//ведущим (полный проход - всегда один из вариантов). Векторный проход по столбцам
+//(column_filter.h) берет сразу все условия на год и рейтинг вместе с тегами.
+//Остальные условия применяются как фильтры над списком номеров строк: каждый фильтр
+//проходит весь список и сжимает его, фильтры идут в порядке "дешевле и отсекает
+//больше - раньше".
+
+#include "media.h"
+#include "query_lang.h"
+#include "catalog_index.h"
+
+#include <string>
+#include <vector>
+
+enum class AccessPath { FullScan, Trigram, TagPostings, YearIndex, ColumnBitmap };
+
+const char* accessPathName(AccessPath path);
+
+struct PathCost {
+    AccessPath path = AccessPath::FullScan;
+    std::vector<int> predicates; //условия, по которым идет выборка (пусто - полный проход)
+    size_t estimatedRows = 0; //строк на выходе пути (до фильтров)
+    double cost = 0;
+};
+
+struct QueryPlan {
+    PathCost driver;
+    std::vector<PathCost> alternatives; //все рассмотренные пути, включая выбранный
+    std::vector<int> filters;           //условия после выборки, в порядке применения
+    std::vector<double> selectivity;    //оценка доли строк по каждому условию
+    size_t catalogRows = 0;
+    size_t indexedRows = 0;             //строки, покрытые индексом; остальные - хвост
+    bool topByZones = false;            //ORDER BY rating с LIMIT по карте блоков (zone_map.h)
+};
+
+//index может быть nullptr (тогда возможен только полный проход)
+QueryPlan planQuery(const CatalogQuery& query, const CatalogIndex* index, size_t catalogRows);
+//номера строк результата с учетом ORDER BY и LIMIT
+std::vector<size_t> runCatalogQuery(MediaSpan catalog, const CatalogIndex* index,
+    const CatalogQuery& query, const QueryPlan& plan);
+//текст плана для EXPLAIN
+std::string explainQuery(const CatalogQuery& query, const QueryPlan& plan);
+
+//разбор, план и выполнение над закрепленной версией с индексом из holder; для EXPLAIN -
+//текст плана в plan (строки не выбираются); false - ошибка разбора в error
+bool runCompositeQuery(IndexHolder& holder, const CatalogSnapshot& snapshot, const std::string& text,
+    std::vector<size_t>& rows, std::string& plan, std::string& error);
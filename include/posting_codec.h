@@ -0,0 +1,54 @@
+#pragma once
+
+//Сжатые списки строк (возрастающие номера) для индексов: разности соседних строк
+//упаковываются блоками по POSTING_BLOCK чисел в b бит (PFOR): b выбирается по блоку так,
+//чтобы общий размер был наименьшим, а редкие большие разности ("исключения") хранят
+//старшие биты отдельно и дописываются после распаковки. Числа блока лежат в четырех
+//вертикальных полосах (число i - в полосе i % 4), поэтому на SSE2 распаковка идет по
+//4 числа за команду, а разности превращаются в строки префиксной суммой в регистре.
+//Хвост короче блока - байтовый varint. Для каждого блока хранится его последняя строка
+//(указатель пропуска): поиск строки не меньше заданной перепрыгивает блоки по этим
+//значениям и распаковывает только нужный блок.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t POSTING_BLOCK = 128;
+
+class CompressedPostings {
+public:
+    CompressedPostings() = default;
+    //rows - по возрастанию, без повторов
+    static CompressedPostings encode(const uint32_t* rows, size_t n);
+    static CompressedPostings encode(const std::vector<uint32_t>& rows) { return encode(rows.data(), rows.size()); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    //занятая память, байт
+    size_t bytes() const { return sizeof(*this) + words_.capacity() * sizeof(uint32_t); }
+
+    std::vector<uint32_t> decode() const;
+
+    //блоки по POSTING_BLOCK чисел, последний (хвост) может быть короче
+    size_t blockCount() const { return (size_ + POSTING_BLOCK - 1) / POSTING_BLOCK; }
+    size_t blockSize(size_t block) const { return block < blocks_ ? POSTING_BLOCK : size_ - blocks_ * POSTING_BLOCK; }
+    uint32_t blockLast(size_t block) const { return block < blocks_ ? words_[block * 3] : last_; }
+    //строки блока в out[0, blockSize(block))
+    void decodeBlock(size_t block, uint32_t* out) const;
+    //первый блок от from с последней строкой не меньше target; blockCount() - такого нет
+    size_t findBlock(size_t from, uint32_t target) const;
+
+private:
+    uint32_t size_ = 0;
+    uint32_t blocks_ = 0;     //полных блоков
+    uint32_t tailOffset_ = 0; //слово, с которого начинаются байты хвоста
+    uint32_t last_ = 0;       //последняя строка списка
+    //заголовки блоков по 3 слова (последняя строка, смещение данных, b | исключений << 8),
+    //затем данные блоков, затем хвост
+    std::vector<uint32_t> words_;
+};
+
+//пересечение списков: самый короткий распаковывается, в остальных распаковываются только
+//блоки, где могут быть его строки (остальные перепрыгиваются по указателям пропуска)
+std::vector<uint32_t> intersectPostings(std::vector<const CompressedPostings*> lists);
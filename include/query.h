@@ -0,0 +1,89 @@
+#pragma once
+
+//Запросы к каталогу от сетевых клиентов: разбор JSON-запроса и выполнение
+//над закрепленной версией каталога. Общая часть серверов (server.h, http_server.h).
+//
+//Запрос - плоский JSON-объект, как в файле нагрузки:
+//  {"op": "search", "text": "мир", "limit": 100}
+//  {"op": "tag", "tag": "роман"}     {"op": "top", "n": 10}     {"op": "stats"}
+//  {"op": "query", "q": "tag:роман AND year>=1990 ORDER BY rating DESC LIMIT 10"} - составной
+//  запрос (query_lang.h); с префиксом EXPLAIN ответ {"ok": true, "plan": "..."}
+//  {"op": "years", "from": 1860, "to": 1870} - записи за годы (по годовому индексу)
+//  {"op": "histogram", "step": 10, "from": 1800, "to": 2000} - число записей по десятилетиям:
+//  {"ok": true, "buckets": [{"from": 1860, "to": 1869, "count": N}, ...]}
+//  {"op": "suggest", "q": "вой", "k": 10} - подсказки по началу названия или автора:
+//  {"ok": true, "suggestions": [{"text": "Война и мир", "field": "title", "rating": 9.1}, ...]}
+//  {"op": "fuzzy", "q": "Мастер и Маргорита", "d": 2} - поиск с опечатками (до d в слове),
+//  записи по возрастанию числа опечаток, затем по убыванию рейтинга
+//  {"op": "text", "q": "мертвые души", "k": 10, "w": 1} - полнотекстовый поиск: k записей
+//  с лучшей оценкой BM25 + w * рейтинг / 10
+//  {"op": "insert", "id": "...", "title": "...", "author": "...", "year": 2001, "rating": 7.5, "tags": ["..."]}
+//Ответ: {"ok": true, "count": N, "results": [...]} или {"ok": false, "error": "..."}.
+
+#include "media.h"
+#include "catalog_store.h"
+#include "query_cache.h"
+#include "catalog_index.h"
+#include "year_index.h"
+#include "autocomplete.h"
+#include "fuzzy_search.h"
+#include "text_search.h"
+
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct QueryRequest {
+    std::string op;
+    std::string text;   //подстрока, тег, составной запрос или начало для подсказок
+    int n = 10;         //для top; для suggest и text - сколько вернуть
+    size_t limit = 100; //максимум записей в ответе (count - полное число найденных)
+    int from = std::numeric_limits<int>::min(); //годы для years/histogram, включительно
+    int to = std::numeric_limits<int>::max();
+    int step = 10;      //лет в столбце гистограммы
+    int distance = 2;   //для fuzzy: наибольшее число опечаток в слове
+    double weight = 1;  //для text: вес рейтинга в оценке
+    Media record;       //для insert
+};
+
+//общее состояние для выполнения запросов: каталог, кэш результатов, индексы для
+//составных запросов и файл, куда дописываются вставки
+struct QueryContext {
+    QueryContext(CatalogStore& store, const std::string& filename, size_t savedCount, size_t cacheCapacity = 1024)
+        : store(store), filename(filename), savedCount(savedCount), cache(cacheCapacity) {
+        store.attachCache(&cache);
+    }
+    ~QueryContext() { store.attachCache(nullptr); }
+
+    CatalogStore& store;
+    std::string filename;
+    std::mutex insertLock; //вставки и дозапись дельты - по одной
+    size_t savedCount;     //записей каталога, уже лежащих в файле
+    QueryCache cache;
+    IndexHolder index;
+    YearIndexHolder years;
+    PrefixIndexHolder suggest;
+    FuzzyIndexHolder fuzzy;
+    TextIndexHolder text;
+};
+
+bool parseQueryRequest(const std::string& json, QueryRequest& q, std::string& error);
+
+//результат search/tag/top/stats по закрепленной версии через кэш контекста;
+//для search/tag/top - номера строк по порядку выдачи
+std::shared_ptr<const CachedResult> queryResult(QueryContext& context, const CatalogSnapshot& snapshot,
+    const QueryRequest& q);
+
+//выполняет запрос и дописывает JSON-ответ в out
+void executeQuery(QueryContext& context, const QueryRequest& q, std::string& out);
+//разбор + выполнение; ошибки разбора тоже превращаются в ответ
+void executeQueryJson(QueryContext& context, const std::string& json, std::string& out);
+
+void appendStatsJson(std::string& out, const CatalogStats& stats);
+//подсказка {"text": ..., "field": "title"|"author", "rating": ...} и ответ со списком подсказок
+void appendSuggestionJson(std::string& out, const Suggestion& suggestion);
+void appendSuggestionsJson(std::string& out, const std::vector<Suggestion>& suggestions);
+void appendErrorJson(std::string& out, const std::string& error);
+void appendHistogramJson(std::string& out, const std::vector<YearBucket>& buckets);
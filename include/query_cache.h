@@ -0,0 +1,73 @@
+#pragma once
+
+//Кэш результатов повторяющихся запросов (search, tag, top, stats) с вытеснением LRU.
+//Ключ - нормализованный запрос, результат - номера строк каталога (или статистика),
+//привязанные к версии каталога (CatalogVersion::number): запись кэша отвечает только
+//читателю той же версии.
+//При вставке (CatalogStore::insert/insertBatch) кэш проверяет новые записи предикатами
+//запросов: результаты, в которые новые записи попасть не могут, переносятся на новую
+//версию (номера старых строк не меняются - записи только добавляются в конец), остальные
+//удаляются. Замена каталога целиком очищает кэш.
+
+#include "media.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//запрос, результат которого можно кэшировать
+struct CacheQuery {
+    std::string op;   //search, tag, top, stats
+    std::string text; //подстрока или тег
+    int n = 0;        //для top
+};
+
+struct CachedResult {
+    std::vector<size_t> rows; //search/tag/top - как у findRows*/getTopRows
+    CatalogStats stats;       //stats
+    double minRating = 0;     //top: рейтинг последней строки результата
+};
+
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity = 1024) : capacity_(capacity) {}
+
+    static bool cacheable(const CacheQuery& q);
+    //нормализованный ключ: одинаковые по смыслу запросы дают один ключ
+    static std::string makeKey(const CacheQuery& q);
+
+    //результат для версии каталога; nullptr - промаха (считается в метриках)
+    std::shared_ptr<const CachedResult> get(const std::string& key, uint64_t version);
+    void put(const std::string& key, const CacheQuery& q, uint64_t version,
+        std::shared_ptr<const CachedResult> result);
+
+    //в версии newVersion к каталогу версии oldVersion добавлены записи added
+    void onInsert(const std::vector<Media>& added, uint64_t oldVersion, uint64_t newVersion);
+    void clear();
+    size_t size();
+
+private:
+    struct Entry {
+        std::string key;
+        CacheQuery query;
+        uint64_t version;
+        std::shared_ptr<const CachedResult> result;
+    };
+    using EntryList = std::list<Entry>;
+
+    bool affectedBy(const Entry& entry, const std::vector<Media>& added) const;
+
+    size_t capacity_;
+    std::mutex lock_;
+    EntryList entries_; //спереди - недавно использованные
+    std::unordered_map<std::string, EntryList::iterator> index_;
+};
+
+//результат запроса по закрепленной версии: из кэша или вычисленный и сохраненный;
+//zones - карта блоков версии для топа (может быть nullptr)
+std::shared_ptr<const CachedResult> runCachedQuery(QueryCache& cache, MediaSpan catalog,
+    uint64_t version, const CacheQuery& q, const ZoneMap* zones = nullptr);
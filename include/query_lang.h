@@ -0,0 +1,44 @@
+#pragma once
+
+//Язык составных запросов к каталогу:
+//  [EXPLAIN] условие AND условие ... [ORDER BY поле [ASC|DESC]] [LIMIT N]
+//Условия:
+//  title~"мир"      подстрока в названии (без учета регистра латиницы)
+//  author~"Толстой" подстрока в авторе
+//  text~"мир"       в названии или авторе (как поиск по подстроке)
+//  tag:классика     тег (значение можно взять в кавычки: tag:"тег 1")
+//  year>=1900       год: =, !=, <, <=, >, >=
+//  rating>7.5       рейтинг: те же сравнения
+//Сортировка - по rating, year или title; без ORDER BY записи идут в порядке каталога.
+//Ключевые слова и поля - без учета регистра. Пример:
+//  title~"мир" AND tag:классика AND year>=1900 ORDER BY rating DESC LIMIT 20
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class QueryField { Title, Author, Text, Tag, Year, Rating };
+enum class CompareOp { Contains, Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+struct Predicate {
+    QueryField field = QueryField::Title;
+    CompareOp op = CompareOp::Contains;
+    std::string text; //подстрока или тег (для title - уже в нижнем регистре)
+    double value = 0; //год или рейтинг
+};
+
+struct CatalogQuery {
+    std::vector<Predicate> predicates; //все должны выполняться (AND)
+    bool ordered = false;
+    QueryField orderBy = QueryField::Rating;
+    bool descending = false;
+    size_t limit = SIZE_MAX;
+    bool explain = false;
+};
+
+bool parseCatalogQuery(const std::string& text, CatalogQuery& query, std::string& error);
+
+const char* fieldName(QueryField field);
+//условие в синтаксисе языка (для EXPLAIN)
+std::string formatPredicate(const Predicate& p);
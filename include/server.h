@@ -0,0 +1,47 @@
+#pragma once
+
+//Серверный режим: каталог загружается один раз и обслуживает запросы клиентов.
+//Один поток держит цикл epoll (прием, чтение, запись), запросы выполняются в общем
+//пуле потоков (thread_pool.h). Запросы одного соединения выполняются по порядку
+//одной задачей (конвейер: несколько запросов подряд без ожидания ответов),
+//разные соединения - параллельно. Пока клиент не забрал MAX_OUTPUT байт ответов,
+//соединение не читается, а задача не продолжает ответ: ее остаток ждет в цикле событий,
+//не занимая поток пула, и возвращается в пул, когда клиент заберет половину.
+//
+//Протокол runServer: кадр = 4 байта длины (big-endian) + JSON-запрос из query.h,
+//ответ - кадр того же вида с JSON-ответом.
+
+#include "query.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+const size_t MAX_FRAME = 1 << 20; //наибольший JSON-запрос в кадре, байт
+
+struct ServerConfig {
+    std::string socketPath; //Unix-сокет; пусто - не слушать
+    int port = 0;           //TCP на 127.0.0.1; 0 - не слушать
+};
+
+//забирает из начала in готовые запросы; false - поток испорчен, соединение закрывается
+using RequestParser = std::function<bool(std::string& in, std::vector<std::string>& requests)>;
+//отправка части ответа (не ждет клиента); closeAfter - закрыть соединение после нее.
+//false - соединение закрыто, следующие части готовить незачем
+using ResponseSender = std::function<bool(std::string&& data, bool closeAfter)>;
+//продолжение ответа, который отдается частями: отправляет следующую часть (в потоке пула);
+//false - ответ закончен. Следующий вызов - когда у соединения есть место в очереди вывода
+using ResponseContinuation = std::function<bool(const ResponseSender& send)>;
+//выполняет запрос (в потоке пула): отвечает сразу или возвращает продолжение ответа
+//(пустое - ответ отдан целиком)
+using RequestHandler = std::function<ResponseContinuation(const std::string& request, const ResponseSender& send)>;
+
+//цикл событий до SIGINT/SIGTERM; возвращает код завершения процесса
+int runEventLoop(const ServerConfig& config, const RequestParser& parser, const RequestHandler& handler);
+
+//RequestParser для кадров: забирает из in целые кадры; false - длина кадра больше MAX_FRAME
+bool parseFrames(std::string& in, std::vector<std::string>& requests);
+
+//сервер с кадрами длина + JSON
+int runServer(QueryContext& context, const ServerConfig& config);
@@ -0,0 +1,52 @@
+#pragma once
+
+//Общий проход по каталогу для пачки запросов: K поисков по подстроке и фильтров по
+//тегу отвечаются за одно чтение каталога, а не за K.
+//Подстроки ищутся автоматом Ахо-Корасик сразу по всем образцам (отдельные автоматы
+//для названия в нижнем регистре и для автора - как в findRowsBySubstring), теги -
+//через номера тегов запросов и битовую маску уже отмеченных тегов записи.
+
+#include "media.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//автомат Ахо-Корасик по байтам; байты, которых нет в образцах, сведены в один класс
+class AhoCorasick {
+public:
+    //номер образца - его индекс; пустые образцы не ищутся
+    explicit AhoCorasick(const std::vector<std::string>& patterns);
+
+    //onMatch(id) для каждого вхождения образца id в text (повторы возможны)
+    template <typename F>
+    void scan(const std::string& text, F onMatch) const {
+        int32_t state = 0;
+        for (unsigned char ch : text) {
+            state = next_[(size_t)state * classes_ + classOf_[ch]];
+            for (int32_t node = out_[state] >= 0 ? state : dictLink_[state]; node > 0; node = dictLink_[node]) {
+                for (int32_t id = out_[node]; id >= 0; id = outNext_[id]) onMatch(id);
+            }
+        }
+    }
+
+    bool empty() const { return out_.size() <= 1; }
+
+private:
+    uint16_t classOf_[256];
+    size_t classes_ = 1;
+    std::vector<int32_t> next_;     //переходы: узел * classes_ + класс байта
+    std::vector<int32_t> out_;      //первый образец, кончающийся в узле (-1 - нет)
+    std::vector<int32_t> outNext_;  //следующий образец с тем же концом
+    std::vector<int32_t> dictLink_; //ближайший суффиксный узел с образцом (0 - нет)
+};
+
+struct ScanQuery {
+    enum Kind { Substring, Tag };
+    Kind kind = Substring;
+    std::string text;
+};
+
+//ответы на все запросы за один проход; ответ i - номера строк по возрастанию,
+//как у findRowsBySubstring/findRowsByTag для queries[i]
+std::vector<std::vector<size_t>> findRowsBatch(MediaSpan catalog, const std::vector<ScanQuery>& queries);
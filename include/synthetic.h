@@ -0,0 +1,46 @@
+#pragma once
+
+//Синтетические каталоги для тестов и замеров: детерминированно по seed,
+//каждая запись зависит только от seed и своего номера, поэтому каталог
+//можно генерировать кусками в любом числе потоков и получать один и тот же результат.
+
+#include "media.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct GeneratorConfig {
+    uint64_t count = 1000;       //число записей
+    uint64_t seed = 42;
+    double zipfS = 1.1;          //показатель распределения Ципфа для популярности тегов
+    int tagVocabulary = 200;     //число разных тегов
+    double cyrillicShare = 0.5;  //доля записей с русскими названием и автором
+    double duplicateRate = 0.02; //доля записей, повторяющих название+автор+год более ранней
+    double invalidRate = 0.01;   //доля записей с некорректным полем (отбрасываются при загрузке)
+};
+
+class SyntheticCatalog {
+public:
+    explicit SyntheticCatalog(const GeneratorConfig& config);
+
+    //запись с номером index (0..count-1)
+    Media record(uint64_t index) const;
+    //записи [first, first + n)
+    std::vector<Media> generate(uint64_t first, size_t n) const;
+
+    const GeneratorConfig& config() const { return config_; }
+    const std::vector<std::string>& tagNames() const { return tags_; }
+
+private:
+    //название, автор и год записи - то, что копирует дубликат
+    void fillBase(uint64_t index, Media& m) const;
+    int sampleTag(uint64_t& state) const;
+
+    GeneratorConfig config_;
+    std::vector<std::string> tags_;
+    std::vector<double> tagCdf_; //накопленные вероятности тегов по Ципфу
+};
+
+//весь каталог в памяти (для бенчмарков и тестов небольших размеров)
+std::vector<Media> generateCatalog(const GeneratorConfig& config);
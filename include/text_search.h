@@ -0,0 +1,103 @@
+#pragma once
+
+//Полнотекстовый поиск с ранжированием BM25 по словам названия и автора.
+//Слова (splitWords) приводятся к основе легким стеммером: у русских слов отрезаются
+//частые окончания (-ами, -ого, -ая, -ы...), у английских - -s, -ies, -sses и -ing,
+//если остается основа не короче трех букв. Для каждой основы - список строк с числом
+//ее вхождений (tf) в запись. Оценка записи - сумма BM25 по основам запроса плюс
+//weight * рейтинг / 10. Первые k записей ищутся алгоритмом WAND: у каждой основы есть
+//верхняя граница ее вклада, и записи, которые даже с границами всех оставшихся основ
+//не обгоняют k-ю найденную, перепрыгиваются в списках без подсчета оценки. Списки
+//поделены на блоки по TEXT_BLOCK строк со своими границами вклада и рейтинга (Block-Max
+//WAND): блоки, которые не могут дать запись лучше k-й, пропускаются целиком. Граница
+//рейтинга при выборе опорной основы - наибольший рейтинг в непройденной части списков,
+//а не во всем каталоге.
+
+#include "media.h"
+#include "catalog_store.h"
+#include "catalog_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const size_t TEXT_BLOCK = 128; //строк списка в блоке с границами
+
+struct TextMatch {
+    size_t row = 0;
+    double score = 0;
+};
+
+//сколько работы сделал поиск: записей с подсчитанной оценкой и всего записей в списках
+struct TextSearchStats {
+    size_t scored = 0;
+    size_t postings = 0;
+};
+
+//основа слова после foldCase
+std::string stemWord(const std::string& word);
+//основы слов текста по порядку
+std::vector<std::string> textTerms(const std::string& text);
+
+class TextIndex {
+public:
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+
+    //по первым rows строкам каталога
+    static std::shared_ptr<const TextIndex> build(MediaSpan catalog, uint64_t base);
+
+    size_t rows() const { return rows_; }
+    uint64_t base() const { return base_; }
+    size_t termCount() const { return slots_.size(); }
+
+    //k лучших записей по убыванию оценки (при равной - по возрастанию строки)
+    std::vector<TextMatch> search(const std::string& text, size_t k, double weight, TextSearchStats* stats = nullptr) const;
+    //то же подсчетом оценки каждой записи из списков (для сравнения с WAND)
+    std::vector<TextMatch> searchExhaustive(const std::string& text, size_t k, double weight) const;
+    //оценка записи не из индекса (строки вставок) по статистике индекса; -1 - в записи нет
+    //ни одной основы запроса
+    double score(const Media& item, const std::vector<std::string>& terms, double weight) const;
+
+private:
+    struct Term {
+        uint32_t id = 0;
+        double idf = 0;
+    };
+    struct Block {
+        uint32_t last = 0;   //последняя строка блока
+        float maxScore = 0;  //наибольший вклад основы в блоке (без idf)
+        float maxRating = 0;
+        float restRating = 0; //наибольший рейтинг от этого блока до конца списка
+    };
+    //основы запроса, которые есть в индексе, без повторов
+    std::vector<Term> queryTerms(const std::string& text) const;
+    double termScore(double idf, uint32_t tf, uint32_t length) const;
+
+    size_t rows_ = 0;
+    uint64_t base_ = 0;
+    std::unordered_map<std::string, uint32_t> slots_; //основа -> номер списка
+    std::vector<uint32_t> offsets_;  //список t - [offsets_[t], offsets_[t + 1])
+    std::vector<uint32_t> postings_; //строки по возрастанию
+    std::vector<uint16_t> freqs_;    //tf для каждой строки списка
+    std::vector<float> maxScores_;   //наибольший вклад основы (без idf)
+    std::vector<Block> blocks_;      //блоки списка t - [firstBlock_[t], firstBlock_[t + 1])
+    std::vector<uint32_t> firstBlock_;
+    std::vector<uint16_t> lengths_;  //слов в записи
+    std::vector<float> ratings_;
+    double averageLength_ = 0;
+};
+
+//номера строк в порядке выдачи
+std::vector<size_t> textRows(const std::vector<TextMatch>& matches);
+
+//индекс для цепочки версий; строки вставок после построения оцениваются напрямую
+class TextIndexHolder {
+public:
+    std::vector<TextMatch> search(const CatalogSnapshot& snapshot, const std::string& text, size_t k, double weight);
+
+private:
+    SharedIndex<TextIndex> index_;
+};
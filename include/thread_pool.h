@@ -0,0 +1,160 @@
+#pragma once
+
+//Общий планировщик задач приложения: фиксированное число потоков, у каждого своя
+//очередь (deque). Поток берет задачи с конца своей очереди, а когда она пуста -
+//крадет с начала чужих. Поток, ждущий завершения группы кусков, сам разбирает
+//оставшиеся куски группы, поэтому вложенные parallelFor не блокируют друг друга,
+//а вызов под мьютексом не подхватывает чужую задачу, которой нужен тот же мьютекс.
+//
+//parallelFor/parallelReduce делят диапазон строк каталога на куски; при малом
+//диапазоне или одном потоке работа выполняется сразу в вызывающем потоке.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//меньше этого числа строк операции каталога идут в одном потоке
+const size_t PARALLEL_MIN_ROWS = 16384;
+
+class ThreadPool {
+public:
+    //workers <= 0 - по числу ядер; pin - закрепить поток i за ядром i (Linux)
+    ThreadPool(int workers, bool pin);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)queues_.size(); }
+
+    //ставит задачу: из потока пула - в его очередь, иначе - по кругу
+    void submit(std::function<void()> task);
+    //выполняет одну задачу из любой очереди; false, если задач нет
+    bool runPending();
+
+    //задача с результатом (для конвейеров вроде сохранения по кускам)
+    template <typename F>
+    auto async(F f) -> std::future<decltype(f())> {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+        auto result = task->get_future();
+        submit([task] { (*task)(); });
+        return result;
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(int index);
+    bool popLocal(int index, std::function<void()>& task);
+    bool steal(int thief, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_{ 0 };    //задач во всех очередях
+    std::atomic<size_t> nextQueue_{ 0 };  //очередь для задач извне пула
+    std::mutex sleepLock_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+//настройки общего пула; действуют, если вызваны до первого обращения к threadPool()
+void configureThreadPool(int workers, bool pin);
+ThreadPool& threadPool();
+
+//выполняет task(c) для c из [0, count) на потоках пула и ждет завершения всех. Куски
+//разбираются по общему счетчику: помощники из пула и сам вызывающий поток берут
+//следующий свободный кусок, пока они не кончатся. Ожидающий поток выполняет только
+//куски своей группы, чужих задач из очередей не берет: чужая задача (например, другой
+//запрос сервера) могла бы ждать мьютекс, под которым вызван runChunks, и поток
+//заблокировал бы сам себя. Если кусок бросил исключение, еще не начатые куски не
+//выполняются; runChunks дожидается начатых и бросает первое исключение в вызывающем потоке
+template <typename Task>
+void runChunks(size_t count, const Task& task) {
+    if (count == 0) return;
+    struct Group {
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> left{ 0 };
+        std::mutex lock;
+        std::exception_ptr error; //первое исключение куска
+    };
+    auto group = std::make_shared<Group>();
+    group->left.store(count, std::memory_order_relaxed);
+    const Task* body = &task;
+    //помощник, взятый из очереди после конца группы, не найдет кусков и не тронет body
+    auto work = [group, body, count] {
+        for (size_t c; (c = group->next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            size_t done = 1;
+            try {
+                (*body)(c);
+            }
+            catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(group->lock);
+                    if (!group->error) group->error = std::current_exception();
+                }
+                //никем не взятые куски считаем сделанными, чтобы ожидание не ждало их
+                size_t first = group->next.exchange(count, std::memory_order_relaxed);
+                if (first < count) done += count - first;
+            }
+            group->left.fetch_sub(done, std::memory_order_acq_rel);
+        }
+    };
+    ThreadPool& pool = threadPool();
+    size_t helpers = std::min(count - 1, (size_t)pool.size());
+    for (size_t h = 0; h < helpers; h++) pool.submit(work);
+    work();
+    //оставшиеся куски уже выполняются другими потоками
+    while (group->left.load(std::memory_order_acquire) > 0) std::this_thread::yield();
+    if (group->error) std::rethrow_exception(group->error);
+}
+
+//размер куска: не меньше grain, кусков в несколько раз больше потоков -
+//чтобы было что красть при неравной нагрузке
+inline size_t chunkSize(size_t n, size_t grain) {
+    size_t parts = (size_t)threadPool().size() * 4;
+    return std::max<size_t>(std::max<size_t>(grain, 1), (n + parts - 1) / parts);
+}
+
+inline bool runSequential(size_t n) {
+    return n < PARALLEL_MIN_ROWS || threadPool().size() <= 1;
+}
+
+//выполняет body(begin, end) по кускам диапазона [0, n) и ждет завершения всех кусков
+template <typename Body>
+void parallelFor(size_t n, size_t grain, const Body& body) {
+    if (runSequential(n)) {
+        if (n > 0) body(size_t(0), n);
+        return;
+    }
+    size_t chunk = chunkSize(n, grain);
+    runChunks((n + chunk - 1) / chunk, [&](size_t c) {
+        body(c * chunk, std::min(n, (c + 1) * chunk));
+    });
+}
+
+//map(begin, end) считает частичный результат куска, combine сливает их в порядке кусков
+template <typename T, typename Map, typename Combine>
+T parallelReduce(size_t n, size_t grain, T identity, const Map& map, const Combine& combine) {
+    if (runSequential(n)) {
+        return n > 0 ? combine(std::move(identity), map(size_t(0), n)) : identity;
+    }
+    size_t chunk = chunkSize(n, grain);
+    std::vector<T> partial((n + chunk - 1) / chunk);
+    runChunks(partial.size(), [&](size_t c) {
+        partial[c] = map(c * chunk, std::min(n, (c + 1) * chunk));
+    });
+    T result = std::move(identity);
+    for (T& p : partial) result = combine(std::move(result), std::move(p));
+    return result;
+}
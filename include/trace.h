@@ -0,0 +1,45 @@
+#pragma once
+
+//Трассировка фаз операций в формате Chrome trace event (открывается в chrome://tracing
+//и ui.perfetto.dev). Участок кода отмечается TRACE_SCOPE("фаза"); при выключенной
+//трассировке это одна проверка флага, без чтения часов и без выделения памяти.
+//События копятся в буферах потоков и пишутся в файл при stopTrace.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+extern std::atomic<bool> traceEnabled;
+
+//начинает запись событий; файл пишется при stopTrace
+bool startTrace(const std::string& filename);
+//записывает накопленные события в файл и выключает трассировку
+bool stopTrace();
+
+uint64_t traceNow();
+//name - строковый литерал (хранится указатель)
+void recordSpan(const char* name, uint64_t startNs, uint64_t endNs);
+
+//отрезок от создания объекта до выхода из области видимости; name == nullptr - не писать
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) {
+        if (traceEnabled.load(std::memory_order_relaxed) && name) {
+            name_ = name;
+            start_ = traceNow();
+        }
+    }
+    ~TraceSpan() {
+        if (name_) recordSpan(name_, start_, traceNow());
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_ = nullptr;
+    uint64_t start_ = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name)
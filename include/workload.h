@@ -0,0 +1,26 @@
+#pragma once
+
+//Файл нагрузки (запросы по одному в строке) и его воспроизведение по каталогу.
+
+#include "media.h"
+#include "catalog_store.h"
+
+#include <string>
+#include <vector>
+
+//запрос из файла нагрузки (одна JSON-строка на запрос):
+//{"op": "search", "text": "мир"}, {"op": "tag", "tag": "роман"}, {"op": "top", "n": 10}, {"op": "stats"}
+struct WorkloadQuery {
+    std::string op;
+    std::string text; //подстрока или тег
+    int n = 0;   //для top
+};
+
+std::vector<WorkloadQuery> loadWorkload(const std::string& filename);
+size_t runQuery(MediaSpan catalog, const WorkloadQuery& q);
+double percentile(const std::vector<double>& sorted, double p);
+//каждый запрос читает закрепленную версию каталога; если задан importFile, параллельно
+//с запросами записи из него вставляются пачками по importBatch (проверка задержек чтения
+//под записью)
+void replayWorkload(CatalogStore& store, const std::vector<WorkloadQuery>& queries,
+    int threads, double rate, int repeat, const std::string& importFile = "", size_t importBatch = 10000);
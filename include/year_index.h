@@ -0,0 +1,67 @@
+#pragma once
+
+//Вторичный индекс по году: строки каждого года (по возрастанию номера) и дерево Фенвика
+//по годам, поэтому число строк в диапазоне лет и каждый столбец гистограммы считаются
+//за O(log Y), где Y - число лет от самого раннего до самого позднего. Вставка - тоже
+//O(log Y): строка дописывается в список своего года, счетчики дерева обновляются.
+//YearIndexHolder ведет индекс для цепочки версий каталога: перед запросом дописывает
+//строки, вставленные после прошлого запроса.
+
+#include "media.h"
+#include "catalog_store.h"
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class YearIndex {
+public:
+    void add(int year, uint32_t row);
+    void clear();
+
+    size_t size() const { return size_; }
+    //самый ранний и самый поздний год среди строк (для пустого индекса не определены)
+    int minYear() const { return minYear_; }
+    int maxYear() const { return maxYear_; }
+
+    //строк с годом в [from, to]
+    size_t count(int from, int to) const;
+    //строки с годом в [from, to] по возрастанию номера
+    std::vector<uint32_t> rows(int from, int to) const;
+
+private:
+    size_t prefix(long long slot) const; //строк в слотах [0, slot]
+    void rebuildTree();
+
+    int first_ = 0;                              //год слота 0
+    std::vector<std::vector<uint32_t>> byYear_;  //строки по слотам годов
+    std::vector<size_t> tree_;                   //дерево Фенвика по слотам (с 1)
+    size_t size_ = 0;
+    int minYear_ = 0, maxYear_ = 0;
+};
+
+struct YearBucket {
+    int from = 0, to = 0; //годы включительно
+    size_t count = 0;
+};
+
+//гистограмма по step лет за [from, to]: столбцы выровнены по кратным step годам; все годы -
+//[INT_MIN, INT_MAX], пустой диапазон (from > to) - пустая гистограмма
+std::vector<YearBucket> yearHistogram(const YearIndex& index, int from, int to, int step);
+
+class YearIndexHolder {
+public:
+    //строки снимка с годом в [from, to] по возрастанию номера
+    std::vector<size_t> rows(const CatalogSnapshot& snapshot, int from, int to);
+    //гистограмма по снимку (yearHistogram)
+    std::vector<YearBucket> histogram(const CatalogSnapshot& snapshot, int from, int to, int step);
+
+private:
+    //догоняет снимок; false - снимок старше индекса, отвечать по самому снимку
+    bool sync(const CatalogSnapshot& snapshot);
+
+    std::mutex lock_;
+    YearIndex index_;
+    uint64_t base_ = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+//Карта блоков (zone map): строки каталога делятся на блоки по ZONE_ROWS, у каждого блока -
+//минимум и максимум года и рейтинга и маска тегов (по биту на хеш тега, как фильтр Блума).
+//Фильтр пропускает блок, в котором условие заведомо не выполняется ни для одной строки;
+//топ-N обходит блоки от лучшего максимума рейтинга и останавливается, когда набрано N
+//строк и следующий блок не может дать строку лучше N-й.
+
+#include "media.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+const size_t ZONE_ROWS = 4096;
+
+struct Zone {
+    int minYear = 0, maxYear = 0;
+    double minRating = 0, maxRating = 0;
+    uint64_t tagMask = 0;
+};
+
+//зона i - строки [i * ZONE_ROWS, min(rows, (i + 1) * ZONE_ROWS))
+struct ZoneMap {
+    size_t rows = 0;
+    std::vector<Zone> zones;
+};
+
+ZoneMap buildZoneMap(MediaSpan catalog);
+
+//бит тега в маске блока; разные теги могут попасть в один бит - тогда блок просто не пропускается
+uint64_t tagBit(const std::string& tag);
+
+//до k номеров строк [0, zones.rows), среди которых заведомо есть k лучших по рейтингу
+//(descending - больший рейтинг лучше; при равенстве лучше меньший номер) из строк, которые
+//выбирает select(begin, end, rows) - дописывает подходящие строки блока в rows.
+//Порядок результата не определен.
+std::vector<size_t> topRowsByZones(MediaSpan catalog, const ZoneMap& zones, size_t k,
+    bool descending, const std::function<void(size_t, size_t, std::vector<uint32_t>&)>& select);
@@ -0,0 +1,414 @@
+//Бенчмарк операций каталога на синтетических каталогах разного размера.
+//  catalog_bench [--sizes 1K,10K,100K] [--reps 10] [--warmup 2] [--filter подстрока]
+//                [--out results.json] [--baseline base.json] [--threshold 0.10]
+//                [--trace trace.json] [--perf] [--workers N]
+//Для каждого случая: прогрев, затем reps замеров; в отчет идут медиана, минимум
+//и MAD (медиана абсолютных отклонений) - они устойчивы к единичным выбросам.
+//С --baseline сравнивает медианы с сохраненным прогоном и возвращает 1 при регрессии.
+//С --perf к каждому случаю добавляются аппаратные счетчики на запись (сумма по замерам
+//и по всем потокам, включая пул, деленная на reps * размер каталога).
+
+#include "media.h"
+#include "synthetic.h"
+#include "shared_scan.h"
+#include "column_filter.h"
+#include "zone_map.h"
+#include "autocomplete.h"
+#include "fuzzy_search.h"
+#include "text_search.h"
+#include "posting_codec.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "thread_pool.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t BATCH_QUERIES = 100; //запросов в случаях findRowsBatch/findRows
+const size_t SUGGEST_PREFIXES = 10; //начал в случаях suggest/suggestScan, запросов в fuzzy и bm25
+
+struct BenchResult {
+    string name;
+    size_t size = 0;
+    int reps = 0;
+    double medianMs = 0;
+    double minMs = 0;
+    double madMs = 0;
+    PerfSample perf; //сумма счетчиков по замерам; -1 - нет данных
+};
+
+double median(vector<double> values) {
+    sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+//значение счетчика на одну обработанную запись
+double perRecord(const BenchResult& r, int counter) {
+    return (double)r.perf.values[counter] / ((double)r.reps * max<size_t>(r.size, 1));
+}
+
+//прогрев и замеры одного случая
+BenchResult runCase(const string& name, size_t size, int warmup, int reps, const function<void()>& body) {
+    for (int i = 0; i < warmup; i++) body();
+
+    BenchResult r;
+    vector<double> times;
+    for (int i = 0; i < reps; i++) {
+        PerfSample perfStart = readProcessPerfCounters();
+        auto start = chrono::steady_clock::now();
+        body();
+        times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        PerfSample delta = perfDelta(perfStart, readProcessPerfCounters());
+        for (int c = 0; c < (int)PerfCounter::Count; c++) {
+            if (delta.values[c] < 0) continue;
+            r.perf.values[c] = max<int64_t>(r.perf.values[c], 0) + delta.values[c];
+        }
+    }
+
+    r.name = name;
+    r.size = size;
+    r.reps = reps;
+    r.medianMs = median(times);
+    r.minMs = *min_element(times.begin(), times.end());
+    vector<double> deviations;
+    for (double t : times) deviations.push_back(fabs(t - r.medianMs));
+    r.madMs = median(deviations);
+
+    fprintf(stderr, "%-22s %10zu  median %10.3f ms  min %10.3f ms  mad %8.3f ms",
+        name.c_str(), size, r.medianMs, r.minMs, r.madMs);
+    for (int c = 0; c < (int)PerfCounter::Count; c++) {
+        if (r.perf.values[c] < 0) continue;
+        fprintf(stderr, "  %s/rec %.2f", perfCounterName((PerfCounter)c), perRecord(r, c));
+    }
+    fprintf(stderr, "\n");
+    return r;
+}
+
+//одна строка на результат - так файл легко читать обратно как базовый
+string formatResults(const vector<BenchResult>& results) {
+    string out = "{\"results\": [\n";
+    char line[256];
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        snprintf(line, sizeof(line),
+            "{\"name\": \"%s\", \"size\": %zu, \"reps\": %d, \"median_ms\": %.4f, \"min_ms\": %.4f, \"mad_ms\": %.4f",
+            r.name.c_str(), r.size, r.reps, r.medianMs, r.minMs, r.madMs);
+        out += line;
+        for (int c = 0; c < (int)PerfCounter::Count; c++) {
+            if (r.perf.values[c] < 0) continue;
+            snprintf(line, sizeof(line), ", \"%s_per_record\": %.4f", perfCounterName((PerfCounter)c), perRecord(r, c));
+            out += line;
+        }
+        out += i + 1 < results.size() ? "},\n" : "}\n";
+    }
+    out += "]}\n";
+    return out;
+}
+
+//читает результаты, сохраненные formatResults; ключ - имя случая и размер
+map<pair<string, size_t>, BenchResult> loadBaseline(const string& filename) {
+    map<pair<string, size_t>, BenchResult> baseline;
+    ifstream file(filename);
+    string line;
+    while (getline(file, line)) {
+        if (line.compare(0, 8, "{\"name\":") != 0) continue;
+        if (!line.empty() && line.back() == ',') line.pop_back();
+        map<string, string> fields;
+        if (!parseJsonObject(line, fields)) continue;
+        BenchResult r;
+        r.name = fields["name"];
+        r.size = strtoull(fields["size"].c_str(), nullptr, 10);
+        r.medianMs = atof(fields["median_ms"].c_str());
+        r.madMs = atof(fields["mad_ms"].c_str());
+        baseline[{ r.name, r.size }] = r;
+    }
+    return baseline;
+}
+
+//список размеров через запятую, с суффиксами K/M
+vector<size_t> parseSizes(const string& text) {
+    vector<size_t> sizes;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        char* end = nullptr;
+        double value = strtod(item.c_str(), &end);
+        if (end && (*end == 'k' || *end == 'K')) value *= 1e3;
+        if (end && (*end == 'm' || *end == 'M')) value *= 1e6;
+        if (value >= 1) sizes.push_back((size_t)value);
+    }
+    return sizes;
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> sizes = { 1000, 10000, 100000 };
+    int reps = 10, warmup = 2;
+    double threshold = 0.10;
+    string outFile, baselineFile, filter, traceFile;
+
+    bool perf = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--perf") {
+            perf = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Нет значения для параметра " << arg << "\n";
+            return 2;
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") sizes = parseSizes(value);
+        else if (arg == "--reps") reps = max(1, atoi(value.c_str()));
+        else if (arg == "--warmup") warmup = max(0, atoi(value.c_str()));
+        else if (arg == "--out") outFile = value;
+        else if (arg == "--baseline") baselineFile = value;
+        else if (arg == "--threshold") threshold = atof(value.c_str());
+        else if (arg == "--filter") filter = value;
+        else if (arg == "--trace") traceFile = value;
+        else if (arg == "--workers") configureThreadPool(max(1, atoi(value.c_str())), false);
+        else {
+            cerr << "Неизвестный параметр " << arg << "\n";
+            return 2;
+        }
+    }
+
+    //сообщения функций каталога и их табличный вывод в замеры не попадают
+    ostream nullStream(nullptr);
+    logStream = &nullStream;
+    streambuf* coutBuf = cout.rdbuf();
+
+    char tmpTemplate[] = "/tmp/catalog_bench_XXXXXX";
+    if (!mkdtemp(tmpTemplate)) {
+        cerr << "Ошибка: не могу создать временный каталог\n";
+        return 1;
+    }
+    string tmpDir = tmpTemplate;
+    vector<string> tmpFiles = { "catalog.json", "catalog.bin", "out.json", "out.bin" };
+
+    string perfError;
+    if (perf && !enablePerfCounters(perfError)) {
+        cerr << "Аппаратные счетчики недоступны: " << perfError << ". Продолжаю без них.\n";
+    }
+    //трассировка немного замедляет замеры - для сравнения с базовым прогоном ее не включают
+    if (!traceFile.empty()) startTrace(traceFile);
+
+    vector<BenchResult> results;
+    volatile size_t sink = 0; //результаты используются, чтобы компилятор их не выбросил
+    for (size_t size : sizes) {
+        GeneratorConfig config;
+        config.count = size;
+        vector<Media> catalog = generateCatalog(config);
+
+        string jsonFile = tmpDir + "/catalog.json";
+        string binFile = tmpDir + "/catalog.bin";
+        saveToFile(catalog, jsonFile);
+        saveToFile(catalog, binFile);
+
+        //пачка запросов: слова названий и теги из самого каталога
+        vector<ScanQuery> batch;
+        for (size_t i = 0; i < catalog.size() && batch.size() < BATCH_QUERIES; i += 97) {
+            const Media& m = catalog[i];
+            if (m.title.empty() || m.tags.empty()) continue;
+            ScanQuery q;
+            q.kind = batch.size() % 2 ? ScanQuery::Tag : ScanQuery::Substring;
+            q.text = q.kind == ScanQuery::Tag ? m.tags[0] : m.title.substr(0, m.title.find(' '));
+            batch.push_back(q);
+        }
+
+        //1950 <= year <= 1970 AND rating >= 9: столбцы строятся заранее, как в индексе версии
+        CatalogColumns columns = buildColumns(catalog);
+        vector<uint64_t> bits(bitmapWords(catalog.size()));
+        ZoneMap zones = buildZoneMap(catalog);
+
+        //подсказки: начала названий (до 4 байт) из пачки, дерево строится заранее
+        vector<string> prefixes;
+        for (const ScanQuery& q : batch) {
+            if (q.kind == ScanQuery::Substring && prefixes.size() < SUGGEST_PREFIXES) prefixes.push_back(foldCase(q.text.substr(0, 4)));
+        }
+        shared_ptr<const PrefixIndex> prefixIndex = PrefixIndex::build(catalog, 0);
+
+        //поиск с опечатками: названия из каталога без последней буквы
+        vector<string> typos;
+        for (size_t i = 0; i < catalog.size() && typos.size() < SUGGEST_PREFIXES; i += 101) {
+            u32string letters = decodeUtf8(catalog[i].title);
+            if (letters.size() < 6) continue;
+            string title = catalog[i].title;
+            size_t cut = title.size();
+            while (cut > 0 && ((unsigned char)title[cut - 1] & 0xC0) == 0x80) cut--;
+            typos.push_back(title.substr(0, cut - 1));
+        }
+        shared_ptr<const TermIndex> termIndex = TermIndex::build(catalog, 0);
+        shared_ptr<const TextIndex> textIndex = TextIndex::build(catalog, 0);
+        //в сгенерированных названиях все слова частые: редкое слово добавляется в каждую
+        //500-ю запись копии каталога, запросы - оно и первое слово названия
+        vector<Media> rareCatalog = catalog;
+        for (size_t i = 0; i < rareCatalog.size(); i += 500) rareCatalog[i].title += " Фолиант";
+        shared_ptr<const TextIndex> rareIndex = TextIndex::build(rareCatalog, 0);
+        vector<string> rareQueries;
+        for (const string& t : typos) rareQueries.push_back("фолиант " + t.substr(0, t.find(' ')));
+
+        //списки строк пачки (теги - длинные, слова названий - короткие) обычные и сжатые;
+        //пересекаются соседние пары
+        vector<vector<uint32_t>> rawLists;
+        vector<CompressedPostings> packedLists;
+        size_t rawBytes = 0, packedBytes = 0;
+        for (const ScanQuery& q : batch) {
+            vector<size_t> rows = q.kind == ScanQuery::Tag ? findRowsByTag(catalog, q.text) : findRowsBySubstring(catalog, q.text);
+            rawLists.emplace_back(rows.begin(), rows.end());
+            packedLists.push_back(CompressedPostings::encode(rawLists.back()));
+            rawBytes += rawLists.back().size() * sizeof(uint32_t);
+            packedBytes += packedLists.back().bytes();
+        }
+        fprintf(stderr, "Списки пачки (%zu строк): %.2f МБ обычные, %.2f МБ сжатые\n", size,
+            rawBytes / 1048576.0, packedBytes / 1048576.0);
+
+        vector<pair<string, function<void()>>> cases = {
+            { "loadFromFile/json", [&] { sink += loadFromFile(jsonFile).size(); } },
+            { "loadFromFile/bin", [&] { sink += loadFromFile(binFile).size(); } },
+            { "saveToFile/json", [&] { saveToFile(catalog, tmpDir + "/out.json"); } },
+            { "saveToFile/bin", [&] { saveToFile(catalog, tmpDir + "/out.bin"); } },
+            { "findBySubstring", [&] { sink += findBySubstring(catalog, "мир").size(); } },
+            { "findByTag", [&] { sink += findByTag(catalog, "классика").size(); } },
+            { "findRowsBatch/k100", [&] { sink += findRowsBatch(catalog, batch).size(); } },
+            { "findRows/k100", [&] { //те же запросы по одному
+                for (const ScanQuery& q : batch) {
+                    sink += (q.kind == ScanQuery::Tag ? findRowsByTag(catalog, q.text) : findRowsBySubstring(catalog, q.text)).size();
+                }
+            } },
+            { "filterColumns/year+rating", [&] {
+                size_t n = catalog.size();
+                filterRange16(columns.years.data(), n, 1950, 1970, false, false, bits.data());
+                filterRange16(columns.ratings.data(), n, 90, INT16_MAX, false, true, bits.data());
+                vector<uint32_t> rows;
+                appendBitmapRows(bits.data(), bits.size(), 0, rows);
+                sink += rows.size();
+            } },
+            { "filterRecords/year+rating", [&] { //то же условие по записям
+                vector<uint32_t> rows;
+                for (size_t i = 0; i < catalog.size(); i++) {
+                    const Media& m = catalog[i];
+                    if (m.year >= 1950 && m.year <= 1970 && m.rating >= 9) rows.push_back((uint32_t)i);
+                }
+                sink += rows.size();
+            } },
+            { "getTopN", [&] { sink += getTopN(catalog, 10).size(); } },
+            { "getTopN/zones", [&] { sink += getTopRows(catalog, 10, &zones).size(); } },
+            { "suggest/k10", [&] {
+                for (const string& p : prefixes) sink += prefixIndex->complete(p, 10).size();
+            } },
+            { "suggestScan/k10", [&] { //те же подсказки проходом по записям
+                for (const string& p : prefixes) {
+                    map<string, double> best; //лучший рейтинг для каждого текста
+                    for (const Media& m : catalog) {
+                        for (const string* text : { &m.title, &m.author }) {
+                            string folded = foldCase(*text);
+                            if (folded.compare(0, p.size(), p) != 0) continue;
+                            auto it = best.emplace(folded, m.rating).first;
+                            it->second = max(it->second, m.rating);
+                        }
+                    }
+                    vector<double> found;
+                    for (auto& b : best) found.push_back(b.second);
+                    partial_sort(found.begin(), found.begin() + min<size_t>(found.size(), 10), found.end(), greater<double>());
+                    sink += min<size_t>(found.size(), 10);
+                }
+            } },
+            { "fuzzy/d2", [&] {
+                for (const string& t : typos) sink += fuzzySearch(*termIndex, t, 2).size();
+            } },
+            { "bm25/k10", [&] { //те же названия, WAND по основам
+                for (const string& t : typos) sink += textIndex->search(t, 10, 1).size();
+            } },
+            { "bm25Exhaustive/k10", [&] {
+                for (const string& t : typos) sink += textIndex->searchExhaustive(t, 10, 1).size();
+            } },
+            { "bm25/k10/w0", [&] { //без рейтинга в оценке
+                for (const string& t : typos) sink += textIndex->search(t, 10, 0).size();
+            } },
+            { "bm25Exhaustive/k10/w0", [&] {
+                for (const string& t : typos) sink += textIndex->searchExhaustive(t, 10, 0).size();
+            } },
+            { "bm25/rare/k10", [&] {
+                for (const string& q : rareQueries) sink += rareIndex->search(q, 10, 1).size();
+            } },
+            { "bm25Exhaustive/rare/k10", [&] {
+                for (const string& q : rareQueries) sink += rareIndex->searchExhaustive(q, 10, 1).size();
+            } },
+            { "intersect/raw", [&] {
+                for (size_t i = 0; i + 1 < rawLists.size(); i++) {
+                    vector<uint32_t> rows;
+                    set_intersection(rawLists[i].begin(), rawLists[i].end(), rawLists[i + 1].begin(), rawLists[i + 1].end(), back_inserter(rows));
+                    sink += rows.size();
+                }
+            } },
+            { "intersect/pfor", [&] {
+                for (size_t i = 0; i + 1 < packedLists.size(); i++) sink += intersectPostings({ &packedLists[i], &packedLists[i + 1] }).size();
+            } },
+            { "decode/pfor", [&] {
+                for (const CompressedPostings& list : packedLists) sink += list.decode().size();
+            } },
+            { "findDuplicates", [&] {
+                cout.rdbuf(nullptr);
+                findDuplicates(catalog);
+                cout.rdbuf(coutBuf);
+            } },
+            { "printStatistics", [&] {
+                cout.rdbuf(nullptr);
+                printStatistics(catalog);
+                cout.rdbuf(coutBuf);
+            } },
+            { "isValid", [&] {
+                for (const Media& m : catalog) sink += isValid(m);
+            } },
+        };
+
+        for (auto& c : cases) {
+            if (!filter.empty() && c.first.find(filter) == string::npos) continue;
+            results.push_back(runCase(c.first, size, warmup, reps, c.second));
+        }
+    }
+    for (const string& name : tmpFiles) unlink((tmpDir + "/" + name).c_str());
+    rmdir(tmpDir.c_str());
+    if (!traceFile.empty() && !stopTrace()) {
+        cerr << "Ошибка: не могу записать трассировку в " << traceFile << "\n";
+    }
+
+    string report = formatResults(results);
+    if (outFile.empty()) {
+        cout << report;
+    }
+    else {
+        ofstream(outFile) << report;
+    }
+
+    if (baselineFile.empty()) return 0;
+
+    //регрессия: медиана выросла больше порога и больше разброса обоих замеров
+    auto baseline = loadBaseline(baselineFile);
+    bool regressed = false;
+    for (const BenchResult& r : results) {
+        auto it = baseline.find({ r.name, r.size });
+        if (it == baseline.end()) continue;
+        const BenchResult& b = it->second;
+        double change = b.medianMs > 0 ? r.medianMs / b.medianMs - 1 : 0;
+        bool slower = change > threshold && r.medianMs - b.medianMs > 3 * max(r.madMs, b.madMs);
+        fprintf(stderr, "%-22s %10zu  %+7.1f%%%s\n", r.name.c_str(), r.size, change * 100,
+            slower ? "  РЕГРЕССИЯ" : "");
+        regressed = regressed || slower;
+    }
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+//Генератор тестовых каталогов.
+//  generator --count 1M --out catalog.jsonl [--format json|jsonl|bin] [--seed 42] [--threads N]
+//            [--zipf 1.1] [--tags 200] [--cyrillic 0.5] [--dup-rate 0.02] [--invalid-rate 0.01]
+//Один и тот же seed дает один и тот же файл при любом числе потоков.
+
+#include "media.h"
+#include "synthetic.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+//сколько записей генерирует и форматирует один поток за раз
+const size_t CHUNK = 65536;
+
+//число с необязательным суффиксом K/M: 100K, 10M
+uint64_t parseCount(const string& text) {
+    char* end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    if (end && (*end == 'k' || *end == 'K')) value *= 1e3;
+    if (end && (*end == 'm' || *end == 'M')) value *= 1e6;
+    return (uint64_t)value;
+}
+
+//генерирует и форматирует записи [first, first + n)
+string formatRange(const SyntheticCatalog& synth, uint64_t first, size_t n, CatalogFormat format) {
+    vector<Media> records = synth.generate(first, n);
+    string out;
+    out.reserve(n * 160);
+    uint64_t total = synth.config().count;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (format == CatalogFormat::JsonLines) {
+            appendJsonLine(out, records[i]);
+        }
+        else if (format == CatalogFormat::Snapshot) {
+            appendSnapshotRecord(out, records[i]);
+        }
+        else {
+            appendJsonRecord(out, records[i]);
+            if (first + i < total - 1) out += ",";
+            out += "\n";
+        }
+    }
+    return out;
+}
+
+void printUsage() {
+    cerr << "Использование: generator --count N --out файл [--format json|jsonl|bin] [--seed S]\n"
+        << "  [--threads T] [--zipf s] [--tags K] [--cyrillic доля] [--dup-rate доля] [--invalid-rate доля]\n"
+        << "N можно писать с суффиксом: 100K, 10M. Формат по умолчанию - по расширению файла.\n";
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorConfig config;
+    string outFile;
+    string formatName;
+    int threads = (int)max(1u, thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 2;
+        }
+        string value = argv[++i];
+        if (arg == "--count") config.count = parseCount(value);
+        else if (arg == "--out") outFile = value;
+        else if (arg == "--format") formatName = value;
+        else if (arg == "--seed") config.seed = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--threads") threads = max(1, atoi(value.c_str()));
+        else if (arg == "--zipf") config.zipfS = atof(value.c_str());
+        else if (arg == "--tags") config.tagVocabulary = max(1, atoi(value.c_str()));
+        else if (arg == "--cyrillic") config.cyrillicShare = atof(value.c_str());
+        else if (arg == "--dup-rate") config.duplicateRate = atof(value.c_str());
+        else if (arg == "--invalid-rate") config.invalidRate = atof(value.c_str());
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (outFile.empty() || config.count == 0) {
+        printUsage();
+        return 2;
+    }
+
+    CatalogFormat format = formatForFile(outFile);
+    if (formatName == "json") format = CatalogFormat::Json;
+    else if (formatName == "jsonl") format = CatalogFormat::JsonLines;
+    else if (formatName == "bin") format = CatalogFormat::Snapshot;
+    else if (!formatName.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    int fd = ::open(outFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << "Ошибка: не могу создать файл " << outFile << "\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    SyntheticCatalog synth(config);
+
+    string header;
+    if (format == CatalogFormat::Json) header = "[\n";
+    if (format == CatalogFormat::Snapshot) appendSnapshotHeader(header, config.count);
+    bool ok = writeAll(fd, header.data(), header.size());
+
+    //окно кусков в работе: пока один пишется, остальные генерируются
+    deque<future<string>> pending;
+    uint64_t next = 0;
+    size_t window = (size_t)threads * 2;
+    while (ok && (next < config.count || !pending.empty())) {
+        while (next < config.count && pending.size() < window) {
+            size_t n = (size_t)min<uint64_t>(CHUNK, config.count - next);
+            pending.push_back(async(threads > 1 ? launch::async : launch::deferred,
+                formatRange, cref(synth), next, n, format));
+            next += n;
+        }
+        string out = pending.front().get();
+        pending.pop_front();
+        ok = writeAll(fd, out.data(), out.size());
+    }
+    for (auto& f : pending) f.wait();
+
+    if (format == CatalogFormat::Json) ok = ok && writeAll(fd, "]\n", 2);
+    if (::close(fd) != 0) ok = false;
+    if (!ok) {
+        cerr << "Ошибка: не удалось записать файл " << outFile << "\n";
+        return 1;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Сгенерировано " << config.count << " записей в " << outFile
+        << " за " << seconds << " с\n";
+    return 0;
+}
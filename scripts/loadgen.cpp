@@ -0,0 +1,372 @@
+//Генератор нагрузки для серверного режима (LR serve): сквозные задержки и пропускная
+//способность под одновременными клиентами.
+//  loadgen --workload requests.jsonl [--socket /tmp/LR.sock | --port N]
+//          [--mode closed|open] [--connections 4] [--rate R] [--duration 10] [--warmup 1]
+//Запросы берутся из файла нагрузки по кругу (каждое соединение начинает со своего места).
+//closed - каждое соединение шлет следующий запрос после ответа на предыдущий; с --rate
+//  соединения выдерживают темп (R запросов/с на всех), а задержки исправляются на
+//  координированное умолчание: за ответ дольше интервала между запросами добавляются
+//  задержки запросов, которые клиент не отправил, пока ждал (как в HdrHistogram).
+//open - запросы уходят по расписанию start + i/R независимо от ответов (конвейером),
+//  задержка считается от запланированного момента отправки.
+//Выводятся исправленные перцентили по операциям и сводка, где для сравнения есть и
+//неисправленный p99 (от фактической отправки).
+
+#include "media.h"
+#include "workload.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct LoadConfig {
+    string socketPath = "/tmp/LR.sock";
+    int port = 0;
+    bool open = false;
+    int connections = 4;
+    double rate = 0;       //запросов в секунду на все соединения; 0 - без темпа
+    double duration = 10;  //секунд замера
+    double warmup = 1;     //секунд в начале, которые не попадают в замер
+};
+
+struct LoadQuery {
+    string op;
+    string frame; //кадр запроса целиком: длина + JSON
+};
+
+//задержки одного соединения (мкс) по операциям
+struct ConnectionStats {
+    map<string, vector<double>> corrected;
+    vector<double> raw;
+    size_t errors = 0;
+    bool failed = false;
+};
+
+/*------Соединение------*/
+int connectServer(const LoadConfig& config) {
+    int fd;
+    if (config.port > 0) {
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)config.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, config.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const string& data) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        ssize_t n = ::send(fd, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        pos += (size_t)n;
+    }
+    return true;
+}
+
+//читает ответы кадрами через общий буфер соединения
+class FrameReader {
+public:
+    explicit FrameReader(int fd) : fd_(fd) {}
+
+    //false - соединение закрыто
+    bool next(string& frame) {
+        while (true) {
+            if (buffer_.size() - pos_ >= 4) {
+                const unsigned char* p = (const unsigned char*)buffer_.data() + pos_;
+                size_t len = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+                if (buffer_.size() - pos_ - 4 >= len) {
+                    frame.assign(buffer_, pos_ + 4, len);
+                    pos_ += 4 + len;
+                    if (pos_ == buffer_.size()) {
+                        buffer_.clear();
+                        pos_ = 0;
+                    }
+                    return true;
+                }
+            }
+            char chunk[65536];
+            ssize_t n = ::read(fd_, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            if (pos_ > 0) {
+                buffer_.erase(0, pos_);
+                pos_ = 0;
+            }
+            buffer_.append(chunk, (size_t)n);
+        }
+    }
+
+private:
+    int fd_;
+    string buffer_;
+    size_t pos_ = 0;
+};
+
+/*------Запросы------*/
+//строки файла нагрузки уходят серверу как есть (это и есть формат запроса)
+vector<LoadQuery> loadQueries(const string& filename) {
+    vector<LoadQuery> queries;
+    if (loadWorkload(filename).empty()) return queries; //ошибки строк уже выведены
+    ifstream file(filename);
+    string line;
+    while (getline(file, line)) {
+        map<string, string> fields;
+        if (!parseJsonObject(line, fields) || !fields.count("op")) continue;
+        LoadQuery q;
+        q.op = fields["op"];
+        uint32_t len = htonl((uint32_t)line.size());
+        q.frame.assign((const char*)&len, 4);
+        q.frame += line;
+        queries.push_back(q);
+    }
+    return queries;
+}
+
+bool isError(const string& response) {
+    return response.compare(0, 12, "{\"ok\": false") == 0;
+}
+
+Clock::duration seconds(double s) {
+    return chrono::duration_cast<Clock::duration>(chrono::duration<double>(s));
+}
+
+double micros(Clock::duration d) {
+    return chrono::duration<double, micro>(d).count();
+}
+
+/*------Закрытая модель------*/
+void runClosed(const LoadConfig& config, const vector<LoadQuery>& queries, int c,
+    Clock::time_point start, ConnectionStats& stats) {
+    int fd = connectServer(config);
+    if (fd < 0) {
+        stats.failed = true;
+        return;
+    }
+    FrameReader reader(fd);
+    //интервал между запросами одного соединения при заданном темпе
+    double interval = config.rate > 0 ? config.connections / config.rate : 0;
+    Clock::time_point measureFrom = start + seconds(config.warmup);
+    Clock::time_point end = measureFrom + seconds(config.duration);
+    Clock::time_point planned = start + seconds(interval * c / config.connections);
+    string response;
+    for (size_t i = c; ; i++) {
+        if (interval > 0) {
+            this_thread::sleep_until(planned);
+            planned += seconds(interval);
+        }
+        Clock::time_point sent = Clock::now();
+        if (sent >= end) break;
+        const LoadQuery& q = queries[i % queries.size()];
+        if (!sendAll(fd, q.frame) || !reader.next(response)) {
+            stats.failed = true;
+            break;
+        }
+        if (sent < measureFrom) continue;
+        double latency = micros(Clock::now() - sent);
+        if (isError(response)) stats.errors++;
+        stats.raw.push_back(latency);
+        vector<double>& corrected = stats.corrected[q.op];
+        corrected.push_back(latency);
+        //запросы, которые клиент должен был отправить, пока ждал этот ответ
+        if (interval > 0) {
+            double step = interval * 1e6;
+            for (double missing = latency - step; missing >= step; missing -= step) {
+                corrected.push_back(missing);
+            }
+        }
+    }
+    ::close(fd);
+}
+
+/*------Открытая модель------*/
+//отправитель идет по расписанию, приемник сопоставляет ответы запросам по порядку
+void runOpen(const LoadConfig& config, const vector<LoadQuery>& queries, int c,
+    Clock::time_point start, ConnectionStats& stats) {
+    int fd = connectServer(config);
+    if (fd < 0) {
+        stats.failed = true;
+        return;
+    }
+    struct InFlight {
+        Clock::time_point planned;
+        Clock::time_point sent;
+        const LoadQuery* query;
+    };
+    mutex lock;
+    deque<InFlight> inFlight;
+
+    Clock::time_point measureFrom = start + seconds(config.warmup);
+    Clock::time_point end = measureFrom + seconds(config.duration);
+    thread sender([&] {
+        //запросы всех соединений вместе идут с темпом rate: у соединения c - номера c, c + N, ...
+        for (size_t i = c; ; i += config.connections) {
+            Clock::time_point planned = start + seconds(i / config.rate);
+            if (planned >= end) break;
+            this_thread::sleep_until(planned);
+            const LoadQuery& q = queries[i % queries.size()];
+            {
+                lock_guard<mutex> guard(lock);
+                inFlight.push_back({ planned, Clock::now(), &q });
+            }
+            if (!sendAll(fd, q.frame)) break;
+        }
+        ::shutdown(fd, SHUT_WR); //сервер ответит на все отправленное и закроет соединение
+    });
+
+    FrameReader reader(fd);
+    string response;
+    while (reader.next(response)) {
+        Clock::time_point received = Clock::now();
+        InFlight request;
+        {
+            lock_guard<mutex> guard(lock);
+            if (inFlight.empty()) break;
+            request = inFlight.front();
+            inFlight.pop_front();
+        }
+        if (request.planned < measureFrom) continue;
+        if (isError(response)) stats.errors++;
+        stats.raw.push_back(micros(received - request.sent));
+        stats.corrected[request.query->op].push_back(micros(received - request.planned));
+    }
+    sender.join();
+    {
+        lock_guard<mutex> guard(lock);
+        if (!inFlight.empty()) stats.failed = true; //ответы не дошли
+    }
+    ::close(fd);
+}
+
+void printUsage() {
+    cerr << "Использование: loadgen --workload файл [--socket путь | --port N]\n"
+        << "       [--mode closed|open] [--connections N] [--rate R] [--duration S] [--warmup S]\n"
+        << "open требует --rate (запросов в секунду на все соединения).\n";
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+    string workloadFile;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "Нет значения для параметра " << arg << "\n";
+            return 2;
+        }
+        string value = argv[++i];
+        if (arg == "--workload") workloadFile = value;
+        else if (arg == "--socket") config.socketPath = value;
+        else if (arg == "--port") config.port = max(0, atoi(value.c_str()));
+        else if (arg == "--mode") config.open = value == "open";
+        else if (arg == "--connections") config.connections = max(1, atoi(value.c_str()));
+        else if (arg == "--rate") config.rate = max(0.0, atof(value.c_str()));
+        else if (arg == "--duration") config.duration = max(0.1, atof(value.c_str()));
+        else if (arg == "--warmup") config.warmup = max(0.0, atof(value.c_str()));
+        else {
+            cerr << "Неизвестный параметр " << arg << "\n";
+            printUsage();
+            return 2;
+        }
+    }
+    if (workloadFile.empty() || (config.open && config.rate <= 0)) {
+        printUsage();
+        return 2;
+    }
+
+    logStream = &cerr;
+    vector<LoadQuery> queries = loadQueries(workloadFile);
+    if (queries.empty()) {
+        cerr << "Ошибка: в файле нагрузки нет запросов\n";
+        return 1;
+    }
+
+    vector<ConnectionStats> stats(config.connections);
+    vector<thread> clients;
+    Clock::time_point start = Clock::now() + chrono::milliseconds(50); //успеть запустить все потоки
+    for (int c = 0; c < config.connections; c++) {
+        clients.emplace_back(config.open ? runOpen : runClosed, cref(config), cref(queries), c, start, ref(stats[c]));
+    }
+    for (thread& t : clients) t.join();
+    double elapsed = chrono::duration<double>(Clock::now() - start).count() - config.warmup;
+
+    //сводим соединения
+    map<string, vector<double>> byOp;
+    vector<double> raw, all;
+    size_t errors = 0, failed = 0;
+    for (ConnectionStats& s : stats) {
+        for (auto& kv : s.corrected) {
+            byOp[kv.first].insert(byOp[kv.first].end(), kv.second.begin(), kv.second.end());
+            all.insert(all.end(), kv.second.begin(), kv.second.end());
+        }
+        raw.insert(raw.end(), s.raw.begin(), s.raw.end());
+        errors += s.errors;
+        failed += s.failed;
+    }
+    if (failed > 0) {
+        cerr << "Ошибка: соединений с обрывом или без подключения: " << failed << " (сервер запущен?)\n";
+    }
+    if (raw.empty()) return 1;
+
+    char line[320];
+    for (auto& kv : byOp) {
+        vector<double>& lat = kv.second;
+        sort(lat.begin(), lat.end());
+        snprintf(line, sizeof(line),
+            "{\"op\": \"%s\", \"count\": %zu, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, "
+            "\"p999_us\": %.1f, \"max_us\": %.1f}\n",
+            kv.first.c_str(), lat.size(), percentile(lat, 0.50), percentile(lat, 0.90),
+            percentile(lat, 0.99), percentile(lat, 0.999), lat.back());
+        cout << line;
+    }
+    sort(raw.begin(), raw.end());
+    sort(all.begin(), all.end());
+    snprintf(line, sizeof(line),
+        "{\"mode\": \"%s\", \"connections\": %d, \"rate\": %.1f, \"requests\": %zu, \"errors\": %zu, "
+        "\"seconds\": %.3f, \"qps\": %.1f, \"p99_us\": %.1f, \"raw_p99_us\": %.1f}\n",
+        config.open ? "open" : "closed", config.connections, config.rate, raw.size(), errors,
+        elapsed, elapsed > 0 ? raw.size() / elapsed : 0.0, percentile(all, 0.99), percentile(raw, 0.99));
+    cout << line;
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+#include "autocomplete.h"
+#include "catalog_index.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_set>
+
+using namespace std;
+
+struct PrefixIndex::Key {
+    string folded;
+    const string* text;
+    double rating;
+    uint32_t row;
+    bool author;
+};
+
+/*------Построение------*/
+shared_ptr<const PrefixIndex> PrefixIndex::build(MediaSpan catalog, uint64_t base) {
+    TRACE_SCOPE("autocomplete/build");
+    auto index = make_shared<PrefixIndex>();
+    index->rows_ = catalog.size();
+    index->base_ = base;
+
+    vector<Key> keys;
+    keys.reserve(catalog.size() * 2);
+    for (size_t i = 0; i < catalog.size(); i++) {
+        const Media& m = catalog[i];
+        if (!m.title.empty()) keys.push_back({ foldCase(m.title), &m.title, m.rating, (uint32_t)i, false });
+        if (!m.author.empty()) keys.push_back({ foldCase(m.author), &m.author, m.rating, (uint32_t)i, true });
+    }
+    //одинаковые ключи - рядом, первым лучший по рейтингу (при равенстве - с меньшим номером строки)
+    sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+        if (a.folded != b.folded) return a.folded < b.folded;
+        if (a.rating != b.rating) return a.rating > b.rating;
+        return a.row < b.row;
+    });
+    keys.erase(unique(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.folded == b.folded; }),
+        keys.end());
+
+    index->nodes_.resize(1);
+    if (!keys.empty()) index->buildNode(0, keys, 0, keys.size(), 0);
+    index->nodes_.shrink_to_fit();
+    index->entries_.shrink_to_fit();
+    return index;
+}
+
+//заполняет узел для ключей [begin, end) с общим префиксом длины depth; метку узла ставит родитель
+uint32_t PrefixIndex::buildNode(uint32_t node, const vector<Key>& keys, size_t begin, size_t end, size_t depth) {
+    double best = -1;
+    if (keys[begin].folded.size() == depth) { //ключ заканчивается здесь (при сортировке он первый)
+        const Key& key = keys[begin];
+        nodes_[node].entry = (int32_t)entries_.size();
+        entries_.push_back({ *key.text, key.author, key.rating, key.row });
+        best = key.rating;
+        begin++;
+    }
+    //дети - по первому байту продолжения, все подряд в массиве узлов
+    vector<pair<size_t, size_t>> groups;
+    for (size_t i = begin; i < end;) {
+        char first = keys[i].folded[depth];
+        size_t j = i + 1;
+        while (j < end && keys[j].folded[depth] == first) j++;
+        groups.push_back({ i, j });
+        i = j;
+    }
+    uint32_t firstChild = (uint32_t)nodes_.size();
+    nodes_.resize(nodes_.size() + groups.size());
+    nodes_[node].firstChild = firstChild;
+    nodes_[node].childCount = (uint16_t)groups.size();
+    for (size_t g = 0; g < groups.size(); g++) {
+        //общий префикс группы - общий префикс первого и последнего ключа
+        const string& a = keys[groups[g].first].folded;
+        const string& b = keys[groups[g].second - 1].folded;
+        size_t length = 1;
+        while (depth + length < min(a.size(), b.size()) && a[depth + length] == b[depth + length] && length < UINT16_MAX) {
+            length++;
+        }
+        uint32_t child = firstChild + (uint32_t)g;
+        nodes_[child].label = (uint32_t)labels_.size();
+        nodes_[child].labelLength = (uint16_t)length;
+        labels_.append(a, depth, length);
+        buildNode(child, keys, groups[g].first, groups[g].second, depth + length);
+        best = max(best, nodes_[child].maxRating);
+    }
+    nodes_[node].maxRating = best;
+    return node;
+}
+
+/*------Поиск------*/
+vector<Suggestion> PrefixIndex::complete(const string& prefix, size_t k) const {
+    vector<Suggestion> result;
+    if (k == 0 || entries_.empty()) return result;
+    //спуск по префиксу; префикс может закончиться посреди метки дуги
+    uint32_t node = 0;
+    size_t pos = 0;
+    while (pos < prefix.size()) {
+        const Node& parent = nodes_[node];
+        const Node* first = nodes_.data() + parent.firstChild;
+        const Node* last = first + parent.childCount;
+        unsigned char want = (unsigned char)prefix[pos];
+        const Node* child = lower_bound(first, last, want, [&](const Node& n, unsigned char b) {
+            return (unsigned char)labels_[n.label] < b;
+        });
+        if (child == last || (unsigned char)labels_[child->label] != want) return result;
+        size_t length = min<size_t>(child->labelLength, prefix.size() - pos);
+        if (memcmp(labels_.data() + child->label, prefix.data() + pos, length) != 0) return result;
+        pos += length;
+        node = (uint32_t)(child - nodes_.data());
+    }
+
+    //сначала лучший: в очереди узлы (с рейтингом поддерева) и готовые ключи
+    struct Item {
+        double score;
+        bool entry;
+        uint32_t id;
+    };
+    auto worse = [](const Item& a, const Item& b) {
+        if (a.score != b.score) return a.score < b.score;
+        if (a.entry != b.entry) return !a.entry; //при равенстве готовый ключ раньше узла
+        return a.id > b.id;
+    };
+    priority_queue<Item, vector<Item>, decltype(worse)> queue(worse);
+    queue.push({ nodes_[node].maxRating, false, node });
+    while (!queue.empty() && result.size() < k) {
+        Item item = queue.top();
+        queue.pop();
+        if (item.entry) {
+            const Entry& e = entries_[item.id];
+            result.push_back({ e.text, e.author, e.rating, e.row });
+            continue;
+        }
+        const Node& n = nodes_[item.id];
+        if (n.entry >= 0) queue.push({ entries_[n.entry].rating, true, (uint32_t)n.entry });
+        for (uint32_t c = n.firstChild; c < n.firstChild + n.childCount; c++) {
+            queue.push({ nodes_[c].maxRating, false, c });
+        }
+    }
+    return result;
+}
+
+/*------Подсказки для цепочки версий------*/
+//text начинается с prefix (оба - после foldCase; длина при нем не меняется, поэтому
+//достаточно привести начало text, с запасом в байт на разрезанную букву)
+static bool startsWithFolded(const string& text, const string& prefix) {
+    if (text.size() < prefix.size()) return false;
+    return foldCase(text.substr(0, prefix.size() + 1)).compare(0, prefix.size(), prefix) == 0;
+}
+
+vector<Suggestion> PrefixIndexHolder::complete(const CatalogSnapshot& snapshot, const string& prefix, size_t k) {
+    OpTimer timer(Op::Suggest);
+    TRACE_SCOPE("suggest");
+    MediaSpan catalog = snapshot.records();
+    vector<Suggestion> result;
+    if (catalog.empty() || k == 0) return result;
+    string folded = foldCase(prefix);
+
+    //nullptr - снимок старше дерева той же цепочки: отвечаем проходом по снимку
+    shared_ptr<const PrefixIndex> index = index_.get(snapshot, [&] { return PrefixIndex::build(catalog, snapshot.base()); });
+    if (index) result = index->complete(folded, k);
+
+    //строки после дерева: их ключи могут потеснить найденные или совпасть с ними по тексту
+    size_t from = index ? index->rows() : 0;
+    if (from < catalog.size()) {
+        for (size_t i = from; i < catalog.size(); i++) {
+            const Media& m = catalog[i];
+            if (startsWithFolded(m.title, folded)) result.push_back({ m.title, false, m.rating, i });
+            if (startsWithFolded(m.author, folded)) result.push_back({ m.author, true, m.rating, i });
+        }
+        sort(result.begin(), result.end(), [](const Suggestion& a, const Suggestion& b) {
+            if (a.rating != b.rating) return a.rating > b.rating;
+            return a.row < b.row;
+        });
+        unordered_set<string> seen;
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size() && kept < k; i++) {
+            if (!seen.insert(foldCase(result[i].text)).second) continue;
+            if (kept != i) result[kept] = move(result[i]);
+            kept++;
+        }
+        result.resize(kept);
+    }
+    timer.setRecords(result.size());
+    return result;
+}
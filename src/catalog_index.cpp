@@ -0,0 +1,211 @@
+#include "catalog_index.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//хвост без индекса, после которого индекс перестраивается (строк, не меньше)
+const size_t INDEX_TAIL_MIN = 65536;
+
+/*------Списки строк------*/
+size_t PostingLists::size(uint32_t key) const {
+    auto it = slots.find(key);
+    return it == slots.end() ? 0 : lists[it->second].size();
+}
+
+const CompressedPostings* PostingLists::find(uint32_t key) const {
+    auto it = slots.find(key);
+    return it == slots.end() ? nullptr : &lists[it->second];
+}
+
+uint32_t trigramKey(const string& s, size_t i) {
+    return ((uint32_t)(unsigned char)s[i] << 16) | ((uint32_t)(unsigned char)s[i + 1] << 8) | (unsigned char)s[i + 2];
+}
+
+//различные триграммы строки (по возрастанию ключа)
+void collectTrigrams(const string& s, vector<uint32_t>& keys) {
+    keys.clear();
+    for (size_t i = 0; i + 3 <= s.size(); i++) keys.push_back(trigramKey(s, i));
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+}
+
+//триграммы названий (в нижнем регистре) или авторов: ключи собираются по кускам
+//параллельно, списки заполняются по порядку строк (каждый отсортирован) в общий
+//массив и затем сжимаются
+void buildTrigrams(MediaSpan catalog, bool title, PostingLists& lists) {
+    TRACE_SCOPE(title ? "index/titleTrigrams" : "index/authorTrigrams");
+    size_t chunk = chunkSize(catalog.size(), 4096);
+    size_t chunks = (catalog.size() + chunk - 1) / chunk;
+    //по куску: ключи всех строк подряд и число ключей каждой строки
+    vector<vector<uint32_t>> chunkKeys(chunks);
+    vector<vector<uint32_t>> chunkCounts(chunks);
+    runChunks(chunks, [&](size_t c) {
+        size_t begin = c * chunk, end = min(catalog.size(), begin + chunk);
+        vector<uint32_t> keys;
+        string lower;
+        for (size_t i = begin; i < end; i++) {
+            if (title) {
+                lower = catalog[i].title;
+                transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+                collectTrigrams(lower, keys);
+            }
+            else {
+                collectTrigrams(catalog[i].author, keys);
+            }
+            chunkKeys[c].insert(chunkKeys[c].end(), keys.begin(), keys.end());
+            chunkCounts[c].push_back((uint32_t)keys.size());
+        }
+    });
+
+    vector<uint32_t> counts;
+    for (const vector<uint32_t>& keys : chunkKeys) {
+        for (uint32_t key : keys) {
+            auto it = lists.slots.emplace(key, (uint32_t)counts.size()).first;
+            if (it->second == counts.size()) counts.push_back(0);
+            counts[it->second]++;
+        }
+    }
+    vector<uint32_t> offsets(counts.size() + 1, 0);
+    for (size_t k = 0; k < counts.size(); k++) offsets[k + 1] = offsets[k] + counts[k];
+    vector<uint32_t> rows(offsets.back());
+    vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    uint32_t row = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        const uint32_t* key = chunkKeys[c].data();
+        for (uint32_t n : chunkCounts[c]) {
+            for (uint32_t j = 0; j < n; j++) rows[fill[lists.slots[*key++]]++] = row;
+            row++;
+        }
+    }
+
+    lists.lists.resize(counts.size());
+    size_t group = chunkSize(counts.size(), 256);
+    runChunks((counts.size() + group - 1) / group, [&](size_t c) {
+        for (size_t k = c * group; k < min(counts.size(), (c + 1) * group); k++) {
+            lists.lists[k] = CompressedPostings::encode(rows.data() + offsets[k], counts[k]);
+        }
+    });
+}
+
+shared_ptr<const CatalogIndex> CatalogIndex::build(MediaSpan catalog, uint64_t base) {
+    TRACE_SCOPE("index/build");
+    auto index = make_shared<CatalogIndex>();
+    index->rows_ = catalog.size();
+    index->base_ = base;
+    buildTrigrams(catalog, true, index->titleTrigrams_);
+    buildTrigrams(catalog, false, index->authorTrigrams_);
+
+    TRACE_SCOPE("index/columns");
+    unordered_map<string, vector<uint32_t>> tags;
+    for (size_t i = 0; i < catalog.size(); i++) {
+        for (const string& tag : catalog[i].tags) {
+            vector<uint32_t>& rows = tags[tag];
+            if (rows.empty() || rows.back() != i) rows.push_back((uint32_t)i); //тег мог повториться в записи
+        }
+    }
+    for (const auto& pair : tags) index->tags_[pair.first] = CompressedPostings::encode(pair.second);
+
+    for (size_t i = 0; i < catalog.size(); i++) index->years_.add(catalog[i].year, (uint32_t)i);
+
+    index->ratingCounts_.assign(101, 0);
+    for (const Media& m : catalog) {
+        index->ratingCounts_[(size_t)max(0.0, min(100.0, round(m.rating * 10)))]++;
+    }
+    index->columns_ = buildColumns(catalog);
+    index->zones_ = buildZoneMap(catalog);
+    return index;
+}
+
+/*------Оценки и выборки------*/
+size_t CatalogIndex::trigramEstimate(const string& pattern, bool title) const {
+    if (pattern.size() < 3) return SIZE_MAX;
+    const PostingLists& lists = title ? titleTrigrams_ : authorTrigrams_;
+    size_t best = SIZE_MAX;
+    for (size_t i = 0; i + 3 <= pattern.size(); i++) best = min(best, lists.size(trigramKey(pattern, i)));
+    return best;
+}
+
+size_t CatalogIndex::trigramWork(const string& pattern, bool title) const {
+    const PostingLists& lists = title ? titleTrigrams_ : authorTrigrams_;
+    vector<uint32_t> keys;
+    collectTrigrams(pattern, keys);
+    size_t work = 0;
+    for (uint32_t key : keys) work += lists.size(key);
+    return work;
+}
+
+vector<uint32_t> CatalogIndex::trigramCandidates(const string& pattern, bool title) const {
+    const PostingLists& lists = title ? titleTrigrams_ : authorTrigrams_;
+    vector<uint32_t> keys;
+    collectTrigrams(pattern, keys);
+    vector<const CompressedPostings*> postings;
+    for (uint32_t key : keys) {
+        const CompressedPostings* list = lists.find(key);
+        if (!list) return {};
+        postings.push_back(list);
+    }
+    return intersectPostings(move(postings));
+}
+
+size_t CatalogIndex::tagCount(const string& tag) const {
+    auto it = tags_.find(tag);
+    return it == tags_.end() ? 0 : it->second.size();
+}
+
+vector<uint32_t> CatalogIndex::tagRows(const string& tag) const {
+    auto it = tags_.find(tag);
+    return it == tags_.end() ? vector<uint32_t>() : it->second.decode();
+}
+
+size_t CatalogIndex::yearCount(int from, int to) const {
+    return years_.count(from, to);
+}
+
+vector<uint32_t> CatalogIndex::yearRows(int from, int to) const {
+    return years_.rows(from, to);
+}
+
+size_t CatalogIndex::ratingCount(double from, double to) const {
+    size_t count = 0;
+    for (size_t b = 0; b < ratingCounts_.size(); b++) {
+        double value = b / 10.0;
+        if (value >= from - 1e-9 && value <= to + 1e-9) count += ratingCounts_[b];
+    }
+    return count;
+}
+
+const uint32_t* gallop(const uint32_t* first, const uint32_t* last, uint32_t value) {
+    if (first == last || *first >= value) return first;
+    size_t step = 1;
+    while (step < (size_t)(last - first) && first[step] < value) {
+        first += step;
+        step *= 2;
+    }
+    return lower_bound(first + 1, first + min(step + 1, (size_t)(last - first)), value);
+}
+
+/*------Индекс для цепочки версий------*/
+bool coversSnapshot(size_t rows, uint64_t base, const CatalogSnapshot& snapshot) {
+    size_t size = snapshot.records().size();
+    return base == snapshot.base() && rows <= size && size - rows <= max(INDEX_TAIL_MIN, rows / 8);
+}
+
+shared_ptr<const CatalogIndex> IndexHolder::get(const CatalogSnapshot& snapshot) {
+    MediaSpan catalog = snapshot.records();
+    if (catalog.empty()) return nullptr;
+    //снимок старше индекса той же цепочки (nullptr): строк индекса в нем нет - пусть идет полным проходом
+    return index_.get(snapshot, [&] { return CatalogIndex::build(catalog, snapshot.base()); });
+}
+
+shared_ptr<const ZoneMap> IndexHolder::zones(const CatalogSnapshot& snapshot) {
+    MediaSpan catalog = snapshot.records();
+    if (catalog.empty()) return nullptr;
+    if (shared_ptr<const CatalogIndex> index = index_.peek(snapshot)) {
+        return shared_ptr<const ZoneMap>(index, &index->zones()); //живет вместе с индексом
+    }
+    return zones_.get(snapshot, [&] { return make_shared<const ZoneMap>(buildZoneMap(catalog)); });
+}
@@ -0,0 +1,190 @@
+#include "catalog_store.h"
+#include "metrics.h"
+#include "query_cache.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+/*------Эпохи читателей------*/
+//Глобальная эпоха растет при каждой публикации. Читатель записывает в свой слот
+//эпоху, которую видел при закреплении (0 - не читает). Слот занимает целую
+//строку кэша, чтобы читатели разных потоков не мешали друг другу.
+const int MAX_READERS = 256;
+
+struct alignas(64) ReaderSlot {
+    atomic<uint64_t> epoch{ 0 };
+    atomic<bool> used{ false };
+};
+
+atomic<uint64_t> globalEpoch{ 1 };
+ReaderSlot readerSlots[MAX_READERS];
+
+//слот потока: занимается при первом чтении и освобождается при завершении потока
+struct ReaderRegistration {
+    int slot = -1;
+    int depth = 0; //вложенные закрепления в одном потоке
+
+    ~ReaderRegistration() {
+        if (slot >= 0) readerSlots[slot].used.store(false, memory_order_release);
+    }
+};
+
+thread_local ReaderRegistration readerRegistration;
+
+ReaderSlot& acquireReaderSlot() {
+    ReaderRegistration& reg = readerRegistration;
+    while (reg.slot < 0) {
+        for (int i = 0; i < MAX_READERS; i++) {
+            bool expected = false;
+            if (readerSlots[i].used.compare_exchange_strong(expected, true)) {
+                reg.slot = i;
+                break;
+            }
+        }
+        if (reg.slot < 0) this_thread::yield(); //все слоты заняты - ждем завершения какого-нибудь потока
+    }
+    return readerSlots[reg.slot];
+}
+
+void pinReader() {
+    ReaderSlot& slot = acquireReaderSlot();
+    if (readerRegistration.depth++ > 0) return; //уже закреплена более ранняя эпоха
+    slot.epoch.store(globalEpoch.load()); //seq_cst: объявление видно до чтения указателя
+}
+
+void unpinReader() {
+    if (--readerRegistration.depth > 0) return;
+    readerSlots[readerRegistration.slot].epoch.store(0, memory_order_release);
+}
+
+//самая старая эпоха среди активных читателей (UINT64_MAX - читателей нет)
+uint64_t oldestReaderEpoch() {
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot& slot : readerSlots) {
+        uint64_t epoch = slot.epoch.load();
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+/*------Снимок------*/
+CatalogSnapshot::CatalogSnapshot(CatalogSnapshot&& other) noexcept
+    : store_(other.store_), version_(other.version_) {
+    other.store_ = nullptr;
+}
+
+CatalogSnapshot::~CatalogSnapshot() {
+    if (!store_) return;
+    //старые версии удаляет писатель (publish, reclaim): удаление большого каталога
+    //в потоке читателя добавило бы к его задержке время освобождения памяти
+    unpinReader();
+}
+
+/*------Хранилище------*/
+//версия со всеми записями буфера
+CatalogVersion* wholeBuffer(uint64_t number, uint64_t base, shared_ptr<vector<Media>> buffer) {
+    CatalogVersion* version = new CatalogVersion();
+    version->number = number;
+    version->base = base;
+    version->data = buffer->data();
+    version->size = buffer->size();
+    version->buffer = move(buffer);
+    return version;
+}
+
+CatalogStore::CatalogStore(vector<Media> records) {
+    current_.store(wholeBuffer(1, 1, make_shared<vector<Media>>(move(records))));
+}
+
+CatalogStore::~CatalogStore() {
+    delete current_.load();
+    for (auto& r : retired_) delete r.second;
+}
+
+CatalogSnapshot CatalogStore::snapshot() {
+    pinReader();
+    return CatalogSnapshot(this, current_.load()); //seq_cst: после объявления эпохи
+}
+
+//вызывается под writeLock_
+void CatalogStore::publish(CatalogVersion* next) {
+    const CatalogVersion* old = current_.exchange(next);
+    //читатель, объявивший эпоху после этого увеличения, уже видит новую версию
+    uint64_t epoch = globalEpoch.fetch_add(1);
+    retired_.push_back({ epoch, old });
+    retiredCount_.store(retired_.size(), memory_order_relaxed);
+    reclaimLocked();
+}
+
+void CatalogStore::reclaimLocked() {
+    if (retired_.empty()) return;
+    uint64_t oldest = oldestReaderEpoch();
+    size_t kept = 0;
+    for (auto& r : retired_) {
+        if (r.first < oldest) delete r.second; //все активные читатели пришли позже
+        else retired_[kept++] = r;
+    }
+    retired_.resize(kept);
+    retiredCount_.store(kept, memory_order_relaxed);
+}
+
+void CatalogStore::reclaim() {
+    lock_guard<mutex> lock(writeLock_);
+    reclaimLocked();
+}
+
+bool CatalogStore::insert(Media m) {
+    vector<Media> batch;
+    batch.push_back(move(m));
+    return insertBatch(move(batch)) == 1;
+}
+
+size_t CatalogStore::insertBatch(vector<Media> records) {
+    OpTimer timer(Op::Insert);
+    TRACE_SCOPE("store/insertBatch");
+
+    //проверка - вне блокировки писателя, параллельно; сообщения - по порядку
+    vector<char> valid(records.size());
+    parallelFor(records.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) valid[i] = checkRecord(records[i]);
+    });
+    size_t added = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (valid[i] || isValid(records[i])) {
+            records[i].cacheWidths(); //название и автор могли быть заданы после конструктора
+            if (added != i) records[added] = move(records[i]);
+            added++;
+        }
+    }
+    records.resize(added);
+    timer.setRecords(added);
+    if (added == 0) return 0;
+
+    lock_guard<mutex> lock(writeLock_);
+    const CatalogVersion* old = current_.load();
+    //в буфере после строк текущей версии ничего нет: в него пишет только писатель
+    shared_ptr<vector<Media>> buffer = old->buffer;
+    if (buffer->capacity() - buffer->size() < added) {
+        //хвост кончился: старые версии остаются на старом буфере, пока их читают
+        TRACE_SCOPE("store/grow");
+        auto grown = make_shared<vector<Media>>();
+        grown->reserve(max(buffer->size() + added, buffer->size() + buffer->size() / 2));
+        grown->insert(grown->end(), buffer->begin(), buffer->end());
+        buffer = move(grown);
+    }
+    if (cache_) cache_->onInsert(records, old->number, old->number + 1);
+    move(records.begin(), records.end(), back_inserter(*buffer));
+    publish(wholeBuffer(old->number + 1, old->base, move(buffer)));
+    return added;
+}
+
+void CatalogStore::replace(vector<Media> records) {
+    lock_guard<mutex> lock(writeLock_);
+    uint64_t number = current_.load()->number + 1;
+    if (cache_) cache_->clear();
+    publish(wholeBuffer(number, number, make_shared<vector<Media>>(move(records))));
+}
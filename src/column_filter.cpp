@@ -0,0 +1,123 @@
+#include "column_filter.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+CatalogColumns buildColumns(MediaSpan catalog) {
+    CatalogColumns columns;
+    columns.years.resize(catalog.size());
+    columns.ratings.resize(catalog.size());
+    //флаги по кускам, чтобы потоки не писали в одну переменную
+    size_t chunk = chunkSize(catalog.size(), 16384);
+    vector<char> exact((catalog.size() + chunk - 1) / chunk * 2, 1);
+    parallelFor(catalog.size(), chunk, [&](size_t begin, size_t end) {
+        char& yearsExact = exact[begin / chunk * 2];
+        char& ratingsExact = exact[begin / chunk * 2 + 1];
+        for (size_t i = begin; i < end; i++) {
+            int year = catalog[i].year;
+            double rating = catalog[i].rating;
+            double fixed = round(rating * 10);
+            if (year < INT16_MIN || year > INT16_MAX) yearsExact = 0;
+            if (!(fixed >= INT16_MIN && fixed <= INT16_MAX) || fixed / 10.0 != rating) ratingsExact = 0;
+            columns.years[i] = (int16_t)max(INT16_MIN, min(INT16_MAX, year));
+            columns.ratings[i] = (int16_t)max<double>(INT16_MIN, min<double>(INT16_MAX, fixed));
+        }
+    });
+    for (size_t c = 0; c < exact.size(); c += 2) {
+        columns.yearsExact = columns.yearsExact && exact[c];
+        columns.ratingsExact = columns.ratingsExact && exact[c + 1];
+    }
+    return columns;
+}
+
+/*------Ядро фильтра------*/
+//биты строк вне [lo, hi] для полного слова из 64 значений
+inline uint64_t outsideWord(const int16_t* v, int16_t lo, int16_t hi) {
+    uint64_t bits = 0;
+#ifdef __AVX2__
+    const __m256i low = _mm256_set1_epi16(lo);
+    const __m256i high = _mm256_set1_epi16(hi);
+    for (int i = 0; i < 64; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(v + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(v + i + 16));
+        __m256i outA = _mm256_or_si256(_mm256_cmpgt_epi16(low, a), _mm256_cmpgt_epi16(a, high));
+        __m256i outB = _mm256_or_si256(_mm256_cmpgt_epi16(low, b), _mm256_cmpgt_epi16(b, high));
+        //упаковка в байты идет по 128-битным половинам - возвращаем порядок строк перестановкой
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(outA, outB), 0xD8);
+        bits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(packed) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i low = _mm_set1_epi16(lo);
+    const __m128i high = _mm_set1_epi16(hi);
+    for (int i = 0; i < 64; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(v + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(v + i + 8));
+        __m128i outA = _mm_or_si128(_mm_cmpgt_epi16(low, a), _mm_cmpgt_epi16(a, high));
+        __m128i outB = _mm_or_si128(_mm_cmpgt_epi16(low, b), _mm_cmpgt_epi16(b, high));
+        bits |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_packs_epi16(outA, outB)) << i;
+    }
+#else
+    for (int i = 0; i < 64; i++) bits |= (uint64_t)(v[i] < lo || v[i] > hi) << i;
+#endif
+    return bits;
+}
+
+void filterRange16(const int16_t* values, size_t n, int16_t lo, int16_t hi, bool negate, bool combine,
+    uint64_t* out) {
+    size_t full = n / 64;
+    for (size_t w = 0; w < full; w++) {
+        uint64_t outside = outsideWord(values + w * 64, lo, hi);
+        uint64_t bits = negate ? outside : ~outside;
+        out[w] = combine ? out[w] & bits : bits;
+    }
+    if (n % 64 != 0) {
+        const int16_t* v = values + full * 64;
+        uint64_t bits = 0;
+        for (size_t i = 0; i < n % 64; i++) {
+            bool inside = v[i] >= lo && v[i] <= hi;
+            bits |= (uint64_t)(inside != negate) << i;
+        }
+        out[full] = combine ? out[full] & bits : bits;
+    }
+}
+
+int ratingAtLeast(double value) {
+    value = max(-4000.0, min(4000.0, value)); //за пределами int16 в фиксированной точке
+    int k = (int)floor(value * 10) - 1;
+    while (k / 10.0 < value) k++;
+    return k;
+}
+
+int ratingAtMost(double value) {
+    value = max(-4000.0, min(4000.0, value));
+    int k = (int)ceil(value * 10) + 1;
+    while (k / 10.0 > value) k--;
+    return k;
+}
+
+/*------Операции с картами------*/
+void setBitmapRows(const uint32_t* first, const uint32_t* last, uint64_t* bits, size_t words) {
+    for (; first != last && *first < words * 64; first++) bits[*first / 64] |= 1ull << (*first % 64);
+}
+
+void andBitmap(uint64_t* bits, const uint64_t* other, size_t words) {
+    for (size_t w = 0; w < words; w++) bits[w] &= other[w];
+}
+
+void appendBitmapRows(const uint64_t* bits, size_t words, uint32_t first, vector<uint32_t>& rows) {
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = bits[w];
+        while (word != 0) {
+            rows.push_back(first + (uint32_t)(w * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+}
@@ -0,0 +1,298 @@
+#include "fuzzy_search.h"
+#include "catalog_index.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+u32string decodeUtf8(const string& s) {
+    u32string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size();) {
+        unsigned char c = s[i];
+        size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        if (length == 1 || i + length > s.size()) {
+            out.push_back(c);
+            i++;
+            continue;
+        }
+        char32_t letter = c & (0x7F >> length);
+        for (size_t k = 1; k < length; k++) letter = (letter << 6) | ((unsigned char)s[i + k] & 0x3F);
+        out.push_back(letter);
+        i += length;
+    }
+    return out;
+}
+
+int fuzzyDistanceFor(size_t letters, int limit) {
+    int distance = letters <= 2 ? 0 : letters <= 5 ? 1 : 2;
+    return max(0, min(distance, limit));
+}
+
+//расстояние Левенштейна, если оно не больше limit, иначе limit + 1
+static int boundedDistance(const u32string& a, const u32string& b, int limit) {
+    size_t n = a.size(), m = b.size();
+    if ((n > m ? n - m : m - n) > (size_t)limit) return limit + 1;
+    vector<int> row(m + 1);
+    for (size_t j = 0; j <= m; j++) row[j] = (int)j;
+    for (size_t i = 1; i <= n; i++) {
+        int diagonal = row[0];
+        row[0] = (int)i;
+        int best = row[0];
+        for (size_t j = 1; j <= m; j++) {
+            int up = row[j];
+            row[j] = min({ up + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1]) });
+            diagonal = up;
+            best = min(best, row[j]);
+        }
+        if (best > limit) return limit + 1;
+    }
+    return min(row[m], limit + 1);
+}
+
+/*------Построение------*/
+shared_ptr<const TermIndex> TermIndex::build(MediaSpan catalog, uint64_t base) {
+    TRACE_SCOPE("fuzzy/build");
+    auto index = make_shared<TermIndex>();
+    index->rows_ = catalog.size();
+    index->base_ = base;
+
+    //слова в порядке появления, потом - по алфавиту
+    unordered_map<string, uint32_t> ids;
+    vector<vector<uint32_t>> lists;
+    vector<string> words;
+    index->ratings_.reserve(catalog.size());
+    for (size_t i = 0; i < catalog.size(); i++) {
+        index->ratings_.push_back((float)catalog[i].rating);
+        words = splitWords(catalog[i].title);
+        vector<string> author = splitWords(catalog[i].author);
+        words.insert(words.end(), author.begin(), author.end());
+        for (const string& word : words) {
+            auto it = ids.emplace(word, (uint32_t)lists.size()).first;
+            if (it->second == lists.size()) lists.emplace_back();
+            vector<uint32_t>& list = lists[it->second];
+            if (list.empty() || list.back() != (uint32_t)i) list.push_back((uint32_t)i); //слово дважды в записи
+        }
+    }
+    vector<pair<string, uint32_t>> sorted(ids.begin(), ids.end());
+    sort(sorted.begin(), sorted.end());
+
+    index->terms_.reserve(sorted.size());
+    index->offsets_.reserve(sorted.size() + 1);
+    index->offsets_.push_back(0);
+    size_t total = 0;
+    for (const vector<uint32_t>& list : lists) total += list.size();
+    index->postings_.reserve(total);
+    vector<u32string> letters;
+    letters.reserve(sorted.size());
+    for (auto& term : sorted) {
+        vector<uint32_t>& list = lists[term.second];
+        index->postings_.insert(index->postings_.end(), list.begin(), list.end());
+        index->offsets_.push_back((uint32_t)index->postings_.size());
+        vector<uint32_t>().swap(list);
+        letters.push_back(decodeUtf8(term.first));
+        index->terms_.push_back(move(term.first));
+    }
+
+    //порядок байтов UTF-8 совпадает с порядком букв - слова уже отсортированы по буквам
+    index->nodes_.resize(1);
+    if (!letters.empty()) index->buildNode(0, letters, 0, letters.size(), 0);
+    index->nodes_.shrink_to_fit();
+    return index;
+}
+
+//заполняет узел для слов [begin, end) с общими первыми depth буквами
+void TermIndex::buildNode(uint32_t node, const vector<u32string>& words, size_t begin, size_t end, size_t depth) {
+    if (words[begin].size() == depth) {
+        nodes_[node].term = (int32_t)begin;
+        begin++;
+    }
+    vector<pair<size_t, size_t>> groups;
+    for (size_t i = begin; i < end;) {
+        size_t j = i + 1;
+        while (j < end && words[j][depth] == words[i][depth]) j++;
+        groups.push_back({ i, j });
+        i = j;
+    }
+    uint32_t firstChild = (uint32_t)nodes_.size();
+    nodes_.resize(nodes_.size() + groups.size());
+    nodes_[node].firstChild = firstChild;
+    nodes_[node].childCount = (uint32_t)groups.size();
+    for (size_t g = 0; g < groups.size(); g++) {
+        nodes_[firstChild + g].letter = words[groups[g].first][depth];
+        buildNode(firstChild + (uint32_t)g, words, groups[g].first, groups[g].second, depth + 1);
+    }
+}
+
+/*------Похожие слова------*/
+vector<pair<uint32_t, int>> TermIndex::similarTerms(const u32string& word, int maxDistance) const {
+    vector<pair<uint32_t, int>> out;
+    if (terms_.empty()) return out;
+    //table[d] - строка таблицы Левенштейна для узла на глубине d
+    vector<vector<int>> table(1, vector<int>(word.size() + 1));
+    for (size_t j = 0; j <= word.size(); j++) table[0][j] = (int)j;
+    const Node& root = nodes_[0];
+    for (uint32_t c = root.firstChild; c < root.firstChild + root.childCount; c++) {
+        walk(c, word, maxDistance, 1, table, out);
+    }
+    if (root.term >= 0 && (int)word.size() <= maxDistance) out.push_back({ (uint32_t)root.term, (int)word.size() });
+    return out;
+}
+
+void TermIndex::walk(uint32_t node, const u32string& word, int maxDistance, size_t depth,
+    vector<vector<int>>& table, vector<pair<uint32_t, int>>& out) const {
+    if (table.size() <= depth) table.emplace_back(word.size() + 1);
+    const vector<int>& prev = table[depth - 1];
+    vector<int>& row = table[depth];
+    const Node& n = nodes_[node];
+    row[0] = (int)depth;
+    int best = row[0];
+    for (size_t j = 1; j <= word.size(); j++) {
+        row[j] = min({ prev[j] + 1, row[j - 1] + 1, prev[j - 1] + (word[j - 1] != n.letter) });
+        best = min(best, row[j]);
+    }
+    if (n.term >= 0 && row[word.size()] <= maxDistance) out.push_back({ (uint32_t)n.term, row[word.size()] });
+    if (best > maxDistance) return; //дальше расстояние только растет
+    for (uint32_t c = n.firstChild; c < n.firstChild + n.childCount; c++) {
+        walk(c, word, maxDistance, depth + 1, table, out);
+    }
+}
+
+/*------Поиск------*/
+static void sortMatches(vector<FuzzyMatch>& matches) {
+    sort(matches.begin(), matches.end(), [](const FuzzyMatch& a, const FuzzyMatch& b) {
+        if (a.distance != b.distance) return a.distance < b.distance;
+        if (a.rating != b.rating) return a.rating > b.rating;
+        return a.row < b.row;
+    });
+}
+
+//строки со словами из terms (по возрастанию расстояния): (строка, наименьшее расстояние)
+//по возрастанию строки
+static vector<pair<uint32_t, int>> mergeTermRows(const TermIndex& index, const vector<pair<uint32_t, int>>& terms) {
+    vector<pair<uint32_t, int>> rows;
+    for (auto& term : terms) {
+        auto range = index.termRows(term.first);
+        size_t middle = rows.size();
+        for (const uint32_t* r = range.first; r != range.second; r++) rows.push_back({ *r, term.second });
+        //списки уже отсортированы - сливаем с накопленным; при равных строках раньше ближнее слово
+        inplace_merge(rows.begin(), rows.begin() + middle, rows.end());
+    }
+    rows.erase(unique(rows.begin(), rows.end(), [](const pair<uint32_t, int>& a, const pair<uint32_t, int>& b) {
+        return a.first == b.first;
+    }), rows.end());
+    return rows;
+}
+
+vector<FuzzyMatch> fuzzySearch(const TermIndex& index, const string& text, int maxDistance) {
+    TRACE_SCOPE("fuzzySearch");
+    vector<FuzzyMatch> result;
+    vector<string> words = splitWords(text);
+    if (words.empty()) return result;
+
+    struct WordTerms {
+        vector<pair<uint32_t, int>> terms; //по возрастанию расстояния
+        size_t total = 0;                  //сумма длин списков
+    };
+    vector<WordTerms> query(words.size());
+    for (size_t w = 0; w < words.size(); w++) {
+        u32string letters = decodeUtf8(words[w]);
+        query[w].terms = index.similarTerms(letters, fuzzyDistanceFor(letters.size(), maxDistance));
+        if (query[w].terms.empty()) return result;
+        sort(query[w].terms.begin(), query[w].terms.end(), [](const pair<uint32_t, int>& a, const pair<uint32_t, int>& b) {
+            return a.second < b.second;
+        });
+        for (auto& term : query[w].terms) {
+            auto range = index.termRows(term.first);
+            query[w].total += range.second - range.first;
+        }
+    }
+    //сначала самые редкие слова: кандидатов меньше, остальные слова только проверяются
+    sort(query.begin(), query.end(), [](const WordTerms& a, const WordTerms& b) { return a.total < b.total; });
+
+    vector<pair<uint32_t, int>> candidates = mergeTermRows(index, query[0].terms);
+    vector<int> found; //для кандидата - расстояние до ближнего слова из списков, -1 - не найден
+    for (size_t w = 1; w < query.size() && !candidates.empty(); w++) {
+        found.assign(candidates.size(), -1);
+        for (auto& term : query[w].terms) {
+            auto range = index.termRows(term.first);
+            const uint32_t* pos = range.first;
+            for (size_t c = 0; c < candidates.size() && pos != range.second; c++) {
+                if (found[c] >= 0) continue;
+                pos = gallop(pos, range.second, candidates[c].first);
+                if (pos != range.second && *pos == candidates[c].first) found[c] = term.second;
+            }
+        }
+        size_t kept = 0;
+        for (size_t c = 0; c < candidates.size(); c++) {
+            if (found[c] >= 0) candidates[kept++] = { candidates[c].first, candidates[c].second + found[c] };
+        }
+        candidates.resize(kept);
+    }
+
+    result.reserve(candidates.size());
+    for (auto& candidate : candidates) {
+        result.push_back({ candidate.first, candidate.second, index.rating(candidate.first) });
+    }
+    sortMatches(result);
+    return result;
+}
+
+vector<size_t> fuzzyRows(const vector<FuzzyMatch>& matches) {
+    vector<size_t> rows;
+    rows.reserve(matches.size());
+    for (const FuzzyMatch& m : matches) rows.push_back(m.row);
+    return rows;
+}
+
+//сумма опечаток для записи без индекса; -1 - какое-то слово запроса не нашлось
+static int recordDistance(const Media& item, const vector<u32string>& query, const vector<int>& limits) {
+    vector<string> words = splitWords(item.title);
+    vector<string> author = splitWords(item.author);
+    words.insert(words.end(), author.begin(), author.end());
+    vector<u32string> letters;
+    for (const string& word : words) letters.push_back(decodeUtf8(word));
+    int total = 0;
+    for (size_t w = 0; w < query.size(); w++) {
+        int best = limits[w] + 1;
+        for (const u32string& word : letters) best = min(best, boundedDistance(query[w], word, limits[w]));
+        if (best > limits[w]) return -1;
+        total += best;
+    }
+    return total;
+}
+
+/*------Индекс для цепочки версий------*/
+vector<FuzzyMatch> FuzzyIndexHolder::search(const CatalogSnapshot& snapshot, const string& text, int maxDistance) {
+    OpTimer timer(Op::Fuzzy);
+    MediaSpan catalog = snapshot.records();
+    vector<FuzzyMatch> result;
+    if (catalog.empty()) return result;
+
+    //nullptr - снимок старше индекса той же цепочки: проверяем все его строки напрямую
+    shared_ptr<const TermIndex> index = index_.get(snapshot, [&] { return TermIndex::build(catalog, snapshot.base()); });
+    if (index) result = fuzzySearch(*index, text, maxDistance);
+
+    size_t from = index ? index->rows() : 0;
+    if (from < catalog.size()) {
+        TRACE_SCOPE("fuzzy/tail");
+        vector<u32string> query;
+        vector<int> limits;
+        for (const string& word : splitWords(text)) {
+            query.push_back(decodeUtf8(word));
+            limits.push_back(fuzzyDistanceFor(query.back().size(), maxDistance));
+        }
+        if (!query.empty()) {
+            for (size_t i = from; i < catalog.size(); i++) {
+                int distance = recordDistance(catalog[i], query, limits);
+                if (distance >= 0) result.push_back({ i, distance, (float)catalog[i].rating });
+            }
+            sortMatches(result);
+        }
+    }
+    timer.setRecords(result.size());
+    return result;
+}
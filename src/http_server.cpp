@@ -0,0 +1,412 @@
+#include "http_server.h"
+#include "planner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+using namespace std;
+
+const size_t CHUNK_SIZE = 64 << 10; //размер части ответа с записями
+
+/*------Разбор запроса------*/
+struct HttpRequest {
+    string method;
+    string path;
+    map<string, string> params; //параметры строки запроса
+    string version;
+    map<string, string> headers; //имена - в нижнем регистре
+    string body;
+};
+
+string toLowerAscii(string s) {
+    for (char& ch : s) ch = (char)tolower((unsigned char)ch);
+    return s;
+}
+
+string trimSpaces(const string& s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == string::npos) return "";
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+//%XX и '+' в строке запроса
+string urlDecode(const string& s) {
+    string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') out += ' ';
+        else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+            out += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else out += s[i];
+    }
+    return out;
+}
+
+void parseQueryString(const string& query, map<string, string>& params) {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == string::npos) end = query.size();
+        string pair = query.substr(pos, end - pos);
+        if (!pair.empty()) {
+            size_t eq = pair.find('=');
+            if (eq == string::npos) params[urlDecode(pair)] = "";
+            else params[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+        }
+        pos = end + 1;
+    }
+}
+
+//значение заголовка из head (без учета регистра имени); false - заголовка нет
+bool findHeader(const string& head, const char* name, string& value) {
+    size_t nameLength = strlen(name);
+    size_t pos = head.find("\r\n");
+    while (pos != string::npos && pos + 2 < head.size()) {
+        size_t lineStart = pos + 2;
+        size_t lineEnd = head.find("\r\n", lineStart);
+        if (lineEnd == string::npos) lineEnd = head.size();
+        if (lineEnd - lineStart > nameLength && head[lineStart + nameLength] == ':' &&
+            strncasecmp(head.data() + lineStart, name, nameLength) == 0) {
+            value = trimSpaces(head.substr(lineStart + nameLength + 1, lineEnd - lineStart - nameLength - 1));
+            return true;
+        }
+        pos = lineEnd;
+    }
+    return false;
+}
+
+//длина тела из Content-Length; false - не число или больше MAX_BODY
+bool parseContentLength(const string& value, size_t& length) {
+    char* end = nullptr;
+    unsigned long long parsed = strtoull(value.c_str(), &end, 10);
+    if (value.empty() || !isdigit((unsigned char)value[0]) || *end != '\0' || parsed > MAX_BODY) return false;
+    length = (size_t)parsed;
+    return true;
+}
+
+//делит входной поток на запросы (заголовок + тело по Content-Length). Запрос, тело
+//которого нельзя отделить от следующего (Transfer-Encoding или неверный Content-Length),
+//отдается одним заголовком, а остаток потока отбрасывается: обработчик ответит ошибкой
+//и закроет соединение
+bool parseHttpRequests(string& in, vector<string>& requests) {
+    size_t pos = 0;
+    while (pos < in.size()) {
+        //пустые строки между запросами допустимы (RFC 9112, 2.2)
+        if (in[pos] == '\r' || in[pos] == '\n') {
+            pos++;
+            continue;
+        }
+        size_t headEnd = in.find("\r\n\r\n", pos);
+        if (headEnd == string::npos) {
+            if (in.size() - pos > MAX_HEAD) return false;
+            break;
+        }
+        string head = in.substr(pos, headEnd - pos);
+        string value;
+        size_t bodyLength = 0;
+        bool framed = !findHeader(head, "transfer-encoding", value); //тела частями не поддерживаются
+        if (framed && findHeader(head, "content-length", value)) framed = parseContentLength(value, bodyLength);
+        if (!framed) {
+            requests.emplace_back(in, pos, headEnd + 4 - pos);
+            in.clear();
+            return true;
+        }
+        size_t requestEnd = headEnd + 4 + bodyLength;
+        if (requestEnd > in.size()) break; //тело еще не дочитано
+        requests.emplace_back(in, pos, requestEnd - pos);
+        pos = requestEnd;
+    }
+    in.erase(0, pos);
+    return true;
+}
+
+bool parseHttpRequest(const string& raw, HttpRequest& r) {
+    size_t headEnd = raw.find("\r\n\r\n");
+    size_t lineEnd = raw.find("\r\n");
+    string requestLine = raw.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = requestLine.rfind(' ');
+    if (sp1 == string::npos || sp2 == sp1) return false;
+    r.method = requestLine.substr(0, sp1);
+    string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    r.version = requestLine.substr(sp2 + 1);
+    if (r.version.compare(0, 5, "HTTP/") != 0) return false;
+
+    size_t question = target.find('?');
+    r.path = urlDecode(target.substr(0, question));
+    if (question != string::npos) parseQueryString(target.substr(question + 1), r.params);
+
+    size_t pos = lineEnd;
+    while (pos < headEnd) {
+        size_t start = pos + 2;
+        size_t end = raw.find("\r\n", start);
+        if (end > headEnd) end = headEnd;
+        size_t colon = raw.find(':', start);
+        if (colon != string::npos && colon < end) {
+            r.headers[toLowerAscii(raw.substr(start, colon - start))] = trimSpaces(raw.substr(colon + 1, end - colon - 1));
+        }
+        pos = end;
+    }
+    r.body = raw.substr(headEnd + 4);
+    return true;
+}
+
+//HTTP/1.1 держит соединение по умолчанию, HTTP/1.0 - только по просьбе клиента
+bool wantsKeepAlive(const HttpRequest& r) {
+    auto it = r.headers.find("connection");
+    string connection = it == r.headers.end() ? "" : toLowerAscii(it->second);
+    if (r.version == "HTTP/1.0") return connection == "keep-alive";
+    return connection != "close";
+}
+
+/*------Ответы------*/
+//куда и в каком виде отвечать на запрос
+struct HttpReply {
+    const ResponseSender& send;
+    bool http10;    //клиент HTTP/1.0: статус той же версии, без chunked
+    bool keepAlive;
+};
+
+const char* statusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 501: return "Not Implemented";
+    default: return "Error";
+    }
+}
+
+string responseHead(const HttpReply& reply, int status, bool keepAlive) {
+    return string(reply.http10 ? "HTTP/1.0 " : "HTTP/1.1 ") + to_string(status) + " " + statusText(status) + "\r\n" +
+        "Content-Type: application/json; charset=utf-8\r\n" +
+        (keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+}
+
+//ответ целиком, с Content-Length
+void sendJson(const HttpReply& reply, int status, const string& body) {
+    string out = responseHead(reply, status, reply.keepAlive);
+    out += "Content-Length: " + to_string(body.size()) + "\r\n\r\n";
+    out += body;
+    reply.send(move(out), !reply.keepAlive);
+}
+
+void sendError(const HttpReply& reply, int status, const string& error) {
+    string body;
+    appendErrorJson(body, error);
+    sendJson(reply, status, body);
+}
+
+//одна часть chunked-ответа: длина в hex, данные
+void appendChunk(string& out, const string& data) {
+    char size[20];
+    snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    out += size;
+    out += data;
+    out += "\r\n";
+}
+
+//записи rows[offset, offset + limit) (rows == nullptr - весь каталог по порядку) отдаются
+//частями по мере сериализации, не дожидаясь конца и без промежуточного vector<Media>.
+//Части готовит продолжение: цикл событий вызывает его снова, когда клиент забрал
+//предыдущие. Продолжение держит буфер записей снимка, а не сам снимок (его освобождают
+//в потоке, где взяли). HTTP/1.0 не знает chunked: тело идет как есть, его конец -
+//закрытие соединения
+ResponseContinuation streamRows(const HttpReply& reply, const CatalogSnapshot& snapshot,
+    shared_ptr<const vector<size_t>> rows, size_t offset, size_t limit) {
+    bool chunked = !reply.http10;
+    bool keepAlive = chunked && reply.keepAlive;
+    MediaSpan catalog = snapshot.records();
+    size_t count = rows ? rows->size() : catalog.size();
+    size_t end = offset + min(limit, count > offset ? count - offset : 0);
+    string head = responseHead(reply, 200, keepAlive) + (chunked ? "Transfer-Encoding: chunked\r\n\r\n" : "\r\n");
+    string data = "{\"ok\": true, \"count\": " + to_string(count) + ", \"results\": [";
+    return [buffer = snapshot.buffer(), catalog, rows, offset, end, next = offset, chunked, keepAlive,
+        head = move(head), data = move(data)](const ResponseSender& send) mutable {
+        (void)buffer; //держит записи catalog
+        string out;
+        out.swap(head); //заголовок - в первой части
+        while (next < end) {
+            if (next > offset) data += ", ";
+            appendJsonObject(data, catalog[rows ? (*rows)[next] : next]);
+            next++;
+            if (data.size() >= CHUNK_SIZE) {
+                if (chunked) appendChunk(out, data);
+                else out += data;
+                data.clear();
+                return send(move(out), false); //false - соединение закрыто, отдавать некому
+            }
+        }
+        data += "]}";
+        if (chunked) {
+            appendChunk(out, data);
+            out += "0\r\n\r\n";
+        }
+        else out += data;
+        send(move(out), !keepAlive);
+        return false;
+    };
+}
+
+size_t paramSize(const HttpRequest& r, const char* name, size_t fallback) {
+    auto it = r.params.find(name);
+    if (it == r.params.end() || it->second.empty()) return fallback;
+    return (size_t)max(0LL, atoll(it->second.c_str()));
+}
+
+int paramInt(const HttpRequest& r, const char* name, int fallback) {
+    auto it = r.params.find(name);
+    if (it == r.params.end() || it->second.empty()) return fallback;
+    return atoi(it->second.c_str());
+}
+
+ResponseContinuation handleHttp(QueryContext& context, const string& raw, const ResponseSender& send) {
+    HttpRequest r;
+    if (!parseHttpRequest(raw, r)) {
+        sendError({ send, false, false }, 400, "запрос не разобран");
+        return nullptr;
+    }
+    HttpReply reply{ send, r.version == "HTTP/1.0", wantsKeepAlive(r) };
+    //тело не отделено от следующего запроса (parseHttpRequests) - отвечаем и закрываем соединение
+    size_t bodyLength = 0;
+    if (r.headers.count("transfer-encoding")) {
+        sendError({ send, reply.http10, false }, 501, "Transfer-Encoding не поддерживается");
+        return nullptr;
+    }
+    if (r.headers.count("content-length") && !parseContentLength(r.headers["content-length"], bodyLength)) {
+        sendError({ send, reply.http10, false }, 400, "неверный Content-Length");
+        return nullptr;
+    }
+
+    if (r.path == "/records" && r.method == "POST") {
+        QueryRequest q;
+        q.op = "insert";
+        if (!parseJsonLine(r.body, q.record)) {
+            sendError(reply, 400, "запись не разобрана");
+            return nullptr;
+        }
+        string body;
+        executeQuery(context, q, body);
+        sendJson(reply, body.compare(0, 11, "{\"ok\": true") == 0 ? 201 : 400, body);
+        return nullptr;
+    }
+    bool known = r.path == "/search" || r.path == "/tag" || r.path == "/top" ||
+        r.path == "/stats" || r.path == "/records" || r.path == "/query" ||
+        r.path == "/years" || r.path == "/histogram" || r.path == "/suggest" ||
+        r.path == "/fuzzy" || r.path == "/text";
+    if (!known) {
+        sendError(reply, 404, "неизвестный путь " + r.path);
+        return nullptr;
+    }
+    if (r.method != "GET") {
+        sendError(reply, 405, "метод " + r.method + " не поддерживается");
+        return nullptr;
+    }
+
+    QueryRequest q;
+    q.op = r.path.substr(1);
+    q.limit = paramSize(r, "limit", q.limit);
+    if (q.op == "search" || q.op == "query" || q.op == "suggest" || q.op == "fuzzy" || q.op == "text") {
+        q.text = r.params["q"];
+    }
+    else if (q.op == "tag") q.text = r.params["tag"];
+    else if (q.op == "top") q.n = (int)paramSize(r, "n", (size_t)q.n);
+    if (q.op == "suggest" || q.op == "text") q.n = (int)paramSize(r, "k", (size_t)q.n);
+    if (q.op == "fuzzy") q.distance = paramInt(r, "d", q.distance);
+    if (q.op == "text" && r.params.count("w")) q.weight = atof(r.params["w"].c_str());
+    if ((q.op == "search" || q.op == "tag" || q.op == "query" || q.op == "suggest" || q.op == "fuzzy" ||
+        q.op == "text") && q.text.empty()) {
+        sendError(reply, 400, "пустой текст запроса");
+        return nullptr;
+    }
+    if (q.op == "top" && q.n <= 0) {
+        sendError(reply, 400, "n должно быть больше 0");
+        return nullptr;
+    }
+    if ((q.op == "suggest" || q.op == "text") && q.n <= 0) {
+        sendError(reply, 400, "k должно быть больше 0");
+        return nullptr;
+    }
+    if (q.op == "text" && q.weight < 0) {
+        sendError(reply, 400, "w не может быть отрицательным");
+        return nullptr;
+    }
+    if (q.op == "fuzzy" && (q.distance < 0 || q.distance > 2)) {
+        sendError(reply, 400, "d должно быть от 0 до 2");
+        return nullptr;
+    }
+
+    if (q.op == "years" || q.op == "histogram") {
+        q.from = paramInt(r, "from", q.from);
+        q.to = paramInt(r, "to", q.to);
+        q.step = paramInt(r, "step", q.step);
+        if (q.op == "years" && !r.params.count("from") && !r.params.count("to")) {
+            sendError(reply, 400, "нужен from или to");
+            return nullptr;
+        }
+        if (q.step <= 0) {
+            sendError(reply, 400, "step должно быть больше 0");
+            return nullptr;
+        }
+        if (q.from > q.to) {
+            sendError(reply, 400, "from больше to");
+            return nullptr;
+        }
+    }
+    if (q.op == "stats" || q.op == "histogram" || q.op == "suggest") {
+        string body;
+        executeQuery(context, q, body);
+        sendJson(reply, 200, body);
+        return nullptr;
+    }
+    CatalogSnapshot snapshot = context.store.snapshot();
+    if (q.op == "records") {
+        //весь каталог по порядку - без списка строк
+        return streamRows(reply, snapshot, nullptr, paramSize(r, "offset", 0), paramSize(r, "limit", snapshot.records().size()));
+    }
+    if (q.op == "years") {
+        auto rows = make_shared<const vector<size_t>>(context.years.rows(snapshot, q.from, q.to));
+        return streamRows(reply, snapshot, rows, 0, q.limit);
+    }
+    if (q.op == "text") {
+        auto rows = make_shared<const vector<size_t>>(textRows(context.text.search(snapshot, q.text, (size_t)q.n, q.weight)));
+        return streamRows(reply, snapshot, rows, 0, q.limit);
+    }
+    if (q.op == "fuzzy") {
+        auto rows = make_shared<const vector<size_t>>(fuzzyRows(context.fuzzy.search(snapshot, q.text, q.distance)));
+        return streamRows(reply, snapshot, rows, 0, q.limit);
+    }
+    if (q.op == "query") {
+        vector<size_t> rows;
+        string plan, error;
+        if (!runCompositeQuery(context.index, snapshot, q.text, rows, plan, error)) {
+            sendError(reply, 400, "запрос: " + error);
+            return nullptr;
+        }
+        if (!plan.empty()) {
+            string body = "{\"ok\": true, \"plan\": ";
+            appendJsonString(body, plan);
+            sendJson(reply, 200, body + "}");
+            return nullptr;
+        }
+        return streamRows(reply, snapshot, make_shared<const vector<size_t>>(move(rows)), 0, q.limit);
+    }
+    shared_ptr<const CachedResult> result = queryResult(context, snapshot, q);
+    //строки живут вместе с результатом из кэша
+    return streamRows(reply, snapshot, shared_ptr<const vector<size_t>>(result, &result->rows), 0, q.limit);
+}
+
+int runHttpServer(QueryContext& context, const ServerConfig& config) {
+    RequestHandler handler = [&context](const string& request, const ResponseSender& send) {
+        return handleHttp(context, request, send);
+    };
+    return runEventLoop(config, parseHttpRequests, handler);
+}
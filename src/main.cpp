@@ -0,0 +1,660 @@
+#include "media.h"
+#include "workload.h"
+#include "catalog_store.h"
+#include "query.h"
+#include "shared_scan.h"
+#include "planner.h"
+#include "year_index.h"
+#include "autocomplete.h"
+#include "fuzzy_search.h"
+#include "text_search.h"
+#include "server.h"
+#include "http_server.h"
+#include "metrics.h"
+#include "trace.h"
+#include "thread_pool.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+/*------Пакетный режим------*/
+
+void printUsage() {
+    cerr << "Использование: LR [--catalog файл] [команда аргументы]\n"
+        << "Без команды запускается интерактивное меню. Команды:\n"
+        << "  search <текст>   поиск по названию/автору\n"
+        << "  tag <тег>        фильтр по тегу\n"
+        << "  top <N>          топ-N по рейтингу\n"
+        << "  dups             дубликаты\n"
+        << "  stats            статистика\n"
+        << "  import <файл>    добавить записи из файла в каталог\n"
+        << "  export <файл>    сохранить каталог в файл\n"
+        << "  replay <файл> [--threads N] [--rate R] [--repeat K]\n"
+        << "                   прогнать запросы из файла нагрузки (JSON-строки),\n"
+        << "                   R запросов/с или на полной скорости, вывести задержки\n"
+        << "                   [--import файл] [--import-batch N] - одновременно вставлять\n"
+        << "                   записи из файла пачками по N (чтение не блокируется)\n"
+        << "  batch <файл>     все запросы search/tag из файла нагрузки за один проход\n"
+        << "                   по каталогу; выводит число найденных по каждому\n"
+        << "  query <запрос>   составной запрос с планировщиком, например\n"
+        << "                   'title~\"мир\" AND tag:роман AND year>=1990 ORDER BY rating DESC LIMIT 10';\n"
+        << "                   EXPLAIN перед запросом - вывести план вместо записей\n"
+        << "  years <от> <до>  записи за годы от и до включительно (по годовому индексу)\n"
+        << "  histogram [шаг] [от до]\n"
+        << "                   число записей по столбцам в шаг лет (по умолчанию 10 - десятилетия)\n"
+        << "  suggest <начало> [k]\n"
+        << "                   k подсказок (по умолчанию 10) среди названий и авторов, начинающихся\n"
+        << "                   так (без учета регистра), по убыванию рейтинга\n"
+        << "  fuzzy <текст> [d]\n"
+        << "                   поиск с опечатками: в каждом слове до d (0-2, по умолчанию 2; в коротких\n"
+        << "                   словах меньше); по числу опечаток, затем по убыванию рейтинга\n"
+        << "  text <слова> [k] [w]\n"
+        << "                   полнотекстовый поиск: k записей (по умолчанию 10) с лучшей оценкой\n"
+        << "                   BM25 по словам названия и автора + w * рейтинг / 10 (по умолчанию w = 1)\n"
+        << "  serve [--socket путь] [--port N]\n"
+        << "                   сервер запросов: кадры 4 байта длины (big-endian) + JSON-запрос\n"
+        << "                   (op search/tag/top/stats/dups/insert/query/years/histogram/suggest/fuzzy/text),\n"
+        << "                   по умолчанию /tmp/LR.sock;\n"
+        << "                   вставки дописываются в дельту каталога. Остановка - Ctrl+C.\n"
+        << "  http [--port N]  HTTP/1.1 JSON API на 127.0.0.1:N (по умолчанию 8080):\n"
+        << "                   GET /search?q=, /tag?tag=, /top?n=, /stats, /query?q=, /years?from=&to=,\n"
+        << "                   /histogram?step=, /suggest?q=&k=, /fuzzy?q=&d=,\n"
+        << "                   /text?q=&k=&w=, /records; POST /records\n"
+        << "Записи выводятся в stdout по одной JSON-строке, сообщения - в stderr.\n"
+        << "--metrics-out <файл> - при выходе записать метрики операций в формате Prometheus.\n"
+        << "--trace <файл.json>  - записать фазы операций в формате Chrome trace event\n"
+        << "                       (открывается в chrome://tracing или ui.perfetto.dev).\n"
+        << "--perf               - профилирование аппаратными счетчиками (такты, инструкции,\n"
+        << "                       промахи кэша и переходов) по операциям; в пакетном режиме\n"
+        << "                       таблица выводится в stderr при выходе, в меню - пункт 10.\n"
+        << "--workers <N>        - потоков в общем пуле для поиска, статистики и сохранения\n"
+        << "                       (по умолчанию - по числу ядер; 1 - все в одном потоке).\n"
+        << "--pin-workers        - закрепить потоки пула за ядрами.\n"
+        << "--cache <N>          - результатов запросов в кэше меню и серверов (по умолчанию 1024,\n"
+        << "                       0 - без кэша); вставка сбрасывает только затронутые результаты.\n";
+}
+
+//выводит записи по одной JSON-строке
+void printJsonLines(const vector<Media>& records) {
+    string out;
+    for (const Media& item : records) {
+        appendJsonLine(out, item);
+    }
+    cout << out;
+}
+
+//выполняет одну команду без меню; возвращает код завершения процесса
+int runBatch(const vector<string>& args, const string& filename, size_t cacheSize) {
+    logStream = &cerr; //в stdout - только результат
+
+    const string& command = args[0];
+    bool hasArg = args.size() > 1;
+    bool needsArg = command == "search" || command == "tag" || command == "top" ||
+        command == "import" || command == "export" || command == "replay" || command == "batch" ||
+        command == "query" || command == "years" || command == "suggest" || command == "fuzzy" ||
+        command == "text";
+    bool known = needsArg || command == "dups" || command == "stats" || command == "histogram" ||
+        command == "serve" || command == "http";
+    if (!known || (needsArg && !hasArg)) {
+        printUsage();
+        return 2;
+    }
+
+    vector<Media> catalog = loadFromFile(filename);
+
+    if (command == "search") {
+        printJsonLines(findBySubstring(catalog, args[1]));
+    }
+    else if (command == "tag") {
+        printJsonLines(findByTag(catalog, args[1]));
+    }
+    else if (command == "top") {
+        int n = atoi(args[1].c_str());
+        if (n <= 0) {
+            printUsage();
+            return 2;
+        }
+        printJsonLines(getTopN(catalog, n));
+    }
+    else if (command == "dups") {
+        string out;
+        for (const auto& pair : collectDuplicates(catalog)) {
+            out += "{\"key\": ";
+            appendJsonString(out, pair.first);
+            out += ", \"count\": " + to_string(pair.second) + "}\n";
+        }
+        cout << out;
+    }
+    else if (command == "stats") {
+        string out;
+        appendStatsJson(out, computeStatistics(catalog));
+        cout << out << "\n";
+    }
+    else if (command == "import") {
+        size_t loadedCount = catalog.size(), savedCount = catalog.size();
+        CatalogStore store(move(catalog));
+        store.insertBatch(loadFromFile(args[1])); //одна новая версия на весь импорт
+        CatalogSnapshot snapshot = store.snapshot();
+        MediaSpan records = snapshot.records();
+        //новые записи дописываем дельтой, основной файл не переписываем
+        if (!saveDelta(records, filename, savedCount)) return 1;
+        cout << "{\"imported\": " << records.size() - loadedCount << ", \"total\": " << records.size() << "}\n";
+    }
+    else if (command == "replay") {
+        int threads = 1, repeat = 1;
+        double rate = 0;
+        string importFile;
+        size_t importBatch = 10000;
+        for (size_t i = 2; i + 1 < args.size(); i += 2) {
+            if (args[i] == "--threads") threads = max(1, atoi(args[i + 1].c_str()));
+            else if (args[i] == "--rate") rate = atof(args[i + 1].c_str());
+            else if (args[i] == "--repeat") repeat = max(1, atoi(args[i + 1].c_str()));
+            else if (args[i] == "--import") importFile = args[i + 1];
+            else if (args[i] == "--import-batch") importBatch = (size_t)max(1, atoi(args[i + 1].c_str()));
+        }
+        vector<WorkloadQuery> queries = loadWorkload(args[1]);
+        if (queries.empty()) {
+            logOut() << "Ошибка: в файле нагрузки нет запросов\n";
+            return 1;
+        }
+        CatalogStore store(move(catalog));
+        replayWorkload(store, queries, threads, rate, repeat, importFile, importBatch);
+    }
+    else if (command == "batch") {
+        vector<WorkloadQuery> workload = loadWorkload(args[1]);
+        vector<ScanQuery> queries;
+        vector<const WorkloadQuery*> sources;
+        for (const WorkloadQuery& w : workload) {
+            if (w.op != "search" && w.op != "tag") continue; //остальные операции не просматривают строки по отдельности
+            ScanQuery q;
+            q.kind = w.op == "tag" ? ScanQuery::Tag : ScanQuery::Substring;
+            q.text = w.text;
+            queries.push_back(q);
+            sources.push_back(&w);
+        }
+        vector<vector<size_t>> rows = findRowsBatch(catalog, queries);
+        string out;
+        for (size_t i = 0; i < queries.size(); i++) {
+            out += "{\"op\": \"" + sources[i]->op + "\", \"text\": ";
+            appendJsonString(out, queries[i].text);
+            out += ", \"count\": " + to_string(rows[i].size()) + "}\n";
+        }
+        cout << out;
+    }
+    else if (command == "query") {
+        //индекс строится под один запрос: планировщик все равно сравнит его с полным проходом
+        CatalogStore store(move(catalog));
+        IndexHolder indexes;
+        CatalogSnapshot snapshot = store.snapshot();
+        vector<size_t> rows;
+        string plan, error;
+        if (!runCompositeQuery(indexes, snapshot, args[1], rows, plan, error)) {
+            logOut() << "Ошибка в запросе: " << error << "\n";
+            return 2;
+        }
+        if (!plan.empty()) cout << plan;
+        else printJsonLines(selectRows(snapshot.records(), rows));
+    }
+    else if (command == "years" || command == "histogram") {
+        int step = 10, from = INT_MIN, to = INT_MAX; //по умолчанию - все годы
+        if (command == "years") {
+            if (args.size() < 3) {
+                printUsage();
+                return 2;
+            }
+            from = atoi(args[1].c_str());
+            to = atoi(args[2].c_str());
+        }
+        else {
+            if (args.size() > 1) step = atoi(args[1].c_str());
+            if (args.size() > 3) {
+                from = atoi(args[2].c_str());
+                to = atoi(args[3].c_str());
+            }
+            if (step <= 0) {
+                printUsage();
+                return 2;
+            }
+        }
+        if (from > to) {
+            logOut() << "Ошибка: год \"от\" больше года \"до\"\n";
+            return 2;
+        }
+        CatalogStore store(move(catalog));
+        YearIndexHolder years;
+        CatalogSnapshot snapshot = store.snapshot();
+        if (command == "years") {
+            printJsonLines(selectRows(snapshot.records(), years.rows(snapshot, from, to)));
+        }
+        else {
+            string out;
+            for (const YearBucket& b : years.histogram(snapshot, from, to, step)) {
+                out += "{\"from\": " + to_string(b.from) + ", \"to\": " + to_string(b.to) +
+                    ", \"count\": " + to_string(b.count) + "}\n";
+            }
+            cout << out;
+        }
+    }
+    else if (command == "suggest") {
+        int k = args.size() > 2 ? atoi(args[2].c_str()) : 10;
+        if (k <= 0) {
+            printUsage();
+            return 2;
+        }
+        string out;
+        for (const Suggestion& s : PrefixIndex::build(catalog, 0)->complete(foldCase(args[1]), (size_t)k)) {
+            appendSuggestionJson(out, s);
+            out += "\n";
+        }
+        cout << out;
+    }
+    else if (command == "fuzzy") {
+        int distance = args.size() > 2 ? atoi(args[2].c_str()) : 2;
+        if (distance < 0 || distance > 2) {
+            printUsage();
+            return 2;
+        }
+        shared_ptr<const TermIndex> index = TermIndex::build(catalog, 0);
+        printJsonLines(selectRows(catalog, fuzzyRows(fuzzySearch(*index, args[1], distance))));
+    }
+    else if (command == "text") {
+        int k = args.size() > 2 ? atoi(args[2].c_str()) : 10;
+        double weight = args.size() > 3 ? atof(args[3].c_str()) : 1;
+        if (k <= 0 || weight < 0) {
+            printUsage();
+            return 2;
+        }
+        shared_ptr<const TextIndex> index = TextIndex::build(catalog, 0);
+        TextSearchStats stats;
+        vector<TextMatch> matches = index->search(args[1], (size_t)k, weight, &stats);
+        logOut() << "Оценено записей: " << stats.scored << " из " << stats.postings << " в списках\n";
+        printJsonLines(selectRows(catalog, textRows(matches)));
+    }
+    else if (command == "serve" || command == "http") {
+        ServerConfig config;
+        bool http = command == "http";
+        config.socketPath = http ? "" : "/tmp/LR.sock";
+        config.port = http ? 8080 : 0;
+        bool socketSet = false;
+        for (size_t i = 1; i + 1 < args.size(); i += 2) {
+            if (args[i] == "--socket") {
+                config.socketPath = args[i + 1];
+                socketSet = true;
+            }
+            else if (args[i] == "--port") config.port = max(0, atoi(args[i + 1].c_str()));
+        }
+        if (!http && config.port > 0 && !socketSet) config.socketPath.clear(); //только TCP
+        size_t savedCount = catalog.size();
+        CatalogStore store(move(catalog));
+        QueryContext context(store, filename, savedCount, cacheSize);
+        static ostream nullStream(nullptr); //сообщения отдельных запросов серверу не нужны
+        logStream = &nullStream;
+        return http ? runHttpServer(context, config) : runServer(context, config);
+    }
+    else if (command == "export") {
+        if (!saveToFile(catalog, args[1])) return 1;
+        cout << "{\"exported\": " << catalog.size() << "}\n";
+    }
+    return 0;
+}
+
+/*------Main------*/
+
+//интерактивное меню
+int runMenu(const string& filename, size_t cacheSize);
+
+int main(int argc, char* argv[]) {
+    string filename = "media_catalog.txt";
+    string metricsFile, traceFile;
+    bool perf = false, pinWorkers = false;
+    int workers = 0;
+    size_t cacheSize = 1024;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--catalog" && i + 1 < argc) {
+            filename = argv[++i];
+        }
+        else if (arg == "--metrics-out" && i + 1 < argc) {
+            metricsFile = argv[++i];
+        }
+        else if (arg == "--perf") {
+            perf = true;
+        }
+        else if (arg == "--workers" && i + 1 < argc) {
+            workers = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--cache" && i + 1 < argc) {
+            cacheSize = (size_t)max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--pin-workers") {
+            pinWorkers = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        }
+        else if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        }
+        else {
+            args.push_back(arg);
+        }
+    }
+
+    configureThreadPool(workers, pinWorkers);
+    if (!traceFile.empty()) startTrace(traceFile);
+    string perfError;
+    if (perf && !enablePerfCounters(perfError)) {
+        cerr << "Аппаратные счетчики недоступны: " << perfError << ". Продолжаю без них.\n";
+    }
+
+    //есть команда - выполняем ее без меню
+    int code = args.empty() ? runMenu(filename, cacheSize) : runBatch(args, filename, cacheSize);
+    if (!args.empty() && perfCountersEnabled()) printPerfCounters(cerr);
+
+    if (!metricsFile.empty() && !writePrometheusFile(metricsFile)) {
+        cerr << "Ошибка: не могу записать метрики в " << metricsFile << "\n";
+    }
+    if (!traceFile.empty() && !stopTrace()) {
+        cerr << "Ошибка: не могу записать трассировку в " << traceFile << "\n";
+    }
+    return code;
+}
+
+int runMenu(const string& filename, size_t cacheSize) {
+#ifdef _WIN32
+    system("chcp 1251 > nul"); //включаем русские буквы в консоли
+#endif
+    cout << "=========================================\n";
+    cout << "     КАТАЛОГ МЕДИА \n";
+    cout << "=========================================\n\n";
+
+    //пытаемся загрузить данные из файла
+    vector<Media> loaded = loadFromFile(filename);
+
+    //если файл не найден - создаем тестовые данные
+    if (loaded.empty()) {
+        cout << "Файл не найден. Создаю тестовый каталог...\n";
+        loaded = createTestCatalog();
+        saveToFile(loaded, filename);//сохраняем тестовые данные
+    }
+    size_t savedCount = loaded.size(); //сколько записей уже лежит в файле (основном или дельте)
+    CatalogStore store(move(loaded)); //версии каталога: чтение без блокировок во время вставки
+    QueryCache cache(cacheSize); //повторные поиски и топ - без нового прохода по каталогу
+    store.attachCache(&cache);
+    IndexHolder indexes; //для составных запросов; вставки идут в хвост без перестройки
+    YearIndexHolder years; //годовой индекс: вставки дописываются в него перед запросом
+    PrefixIndexHolder suggest; //подсказки при поиске
+    FuzzyIndexHolder fuzzy; //поиск с опечатками, когда точных совпадений нет
+    TextIndexHolder text; //полнотекстовый поиск
+
+    //основной цикл программы
+    bool running = true;
+    while (running) {
+        store.reclaim(); //снимок прошлого действия отпущен - старые версии можно удалить
+
+        cout << "\n=== ГЛАВНОЕ МЕНЮ ===\n";
+        cout << "1 - Показать весь каталог\n";
+        cout << "2 - Поиск по названию/автору\n";
+        cout << "3 - Фильтр по тегу\n";
+        cout << "4 - Топ-N по рейтингу\n";
+        cout << "5 - Найти дубликаты\n";
+        cout << "6 - Показать статистику\n";
+        cout << "7 - Сохранить каталог\n";
+        cout << "8 - Добавить новую запись\n";
+        cout << "9 - Сохранить только изменения (дельта)\n";
+        cout << "10 - Метрики операций\n";
+        cout << "11 - Составной запрос\n";
+        cout << "12 - Записи за годы и гистограмма по годам\n";
+        cout << "13 - Полнотекстовый поиск (BM25)\n";
+        cout << "0 - Выход\n";
+        cout << "Выберите действие: ";
+
+        int choice;
+        if (!(cin >> choice)) { //ввод закончился (или не число) - выходим, а не крутимся в цикле
+            break;
+        }
+        cin.ignore(); //очищаем буфер после ввода числа
+
+        //действие работает с одной версией каталога, даже если ее заменит вставка
+        CatalogSnapshot snapshot = store.snapshot();
+        MediaSpan catalog = snapshot.records();
+
+        switch (choice) {
+        case 0: {//выход из программы
+            running = false;
+            cout << "До свидания!\n";
+            break;
+        }
+
+        case 1: {//показать весь каталог
+            printCatalog(catalog);
+            break;
+        }
+
+        case 2: {//поиск по подстроке
+            cout << "Введите текст для поиска (? в конце - подсказки): ";
+            string searchText;
+            getline(cin, searchText);
+            //"начало?" - показываем продолжения и спрашиваем снова
+            while (searchText.size() > 1 && searchText.back() == '?') {
+                searchText.pop_back();
+                vector<Suggestion> hints = suggest.complete(snapshot, searchText, 10);
+                if (hints.empty()) cout << "Подсказок нет\n";
+                for (const Suggestion& h : hints) {
+                    cout << "  " << h.text << (h.author ? " (автор)" : "") << " - " << h.rating << "\n";
+                }
+                cout << "Введите текст для поиска: ";
+                getline(cin, searchText);
+            }
+
+            if (!searchText.empty()) {
+                vector<size_t> rows = runCachedQuery(cache, catalog, snapshot.version(), { "search", searchText, 0 })->rows;
+                if (rows.empty()) { //возможно, опечатка - ищем похожие слова
+                    rows = fuzzyRows(fuzzy.search(snapshot, searchText, 2));
+                    if (!rows.empty()) {
+                        cout << "Точных совпадений нет. Похожие (" << rows.size() << "):\n";
+                        if (rows.size() > 10) rows.resize(10);
+                        printCatalog(selectRows(catalog, rows));
+                        break;
+                    }
+                }
+                cout << "Найдено " << rows.size() << " записей по запросу '" << searchText << "'\n";
+                printCatalog(selectRows(catalog, rows));
+            }
+            break;
+        }
+
+        case 3: {//фильтр по тегу
+            cout << "Доступные теги: роман, классика, фантастика, история, "
+                << "антиутопия, мистика, психология, приключения, фэнтези\n";
+            cout << "Введите тег для фильтрации: ";
+            string tag;
+            getline(cin, tag);
+
+            if (!tag.empty()) {
+                vector<size_t> rows = runCachedQuery(cache, catalog, snapshot.version(), { "tag", tag, 0 })->rows;
+                cout << "Найдено " << rows.size() << " записей с тегом '" << tag << "'\n";
+                printCatalog(selectRows(catalog, rows));
+            }
+            break;
+        }
+
+        case 4: {//топ-N по рейтингу
+            cout << "Сколько записей показать? ";
+            int n;
+            cin >> n;
+
+            if (n > 0) {
+                shared_ptr<const ZoneMap> zones = indexes.zones(snapshot); //карта блоков для отсечения
+                vector<size_t> rows = runCachedQuery(cache, catalog, snapshot.version(), { "top", "", n },
+                    zones.get())->rows;
+                cout << "Топ-" << rows.size() << " по рейтингу:\n";
+                printCatalog(selectRows(catalog, rows));
+            }
+            break;
+        }
+
+        case 5: {//поиск дубликатов
+            findDuplicates(catalog);
+            break;
+        }
+
+        case 6: {//статистика
+            if (catalog.empty()) printStatistics(catalog);
+            else printStatistics(runCachedQuery(cache, catalog, snapshot.version(), { "stats", "", 0 })->stats);
+            break;
+        }
+
+        case 7: {//сохранение каталога
+            cout << "Введите имя файла для сохранения (по умолчанию: "
+                << filename << "): ";
+            string saveFile;
+            getline(cin, saveFile);
+
+            if (saveFile.empty()) {
+                saveFile = filename;
+            }
+
+            if (saveToFile(catalog, saveFile) && saveFile == filename) {
+                savedCount = catalog.size();
+            }
+            break;
+        }
+
+        case 9: {//сохранение только новых записей
+            saveDelta(catalog, filename, savedCount);
+            break;
+        }
+
+        case 8: {//добавление новой записи
+            cout << "=== ДОБАВЛЕНИЕ НОВОЙ ЗАПИСИ ===\n";
+
+            Media newMedia;
+            newMedia.id = to_string(catalog.size() + 1);
+
+            cout << "Название: ";
+            getline(std::cin, newMedia.title);
+
+            cout << "Автор/режиссер: ";
+            getline(std::cin, newMedia.author);
+
+            cout << "Год: ";
+            cin >> newMedia.year;
+
+            cout << "Рейтинг (0.0-10.0): ";
+            cin >> newMedia.rating;
+            cin.ignore();
+
+            cout << "Теги (через запятую): ";
+            string tagsInput;
+            getline(cin, tagsInput);
+
+            //разбиваем теги по запятым
+            string tag;
+            for (char c : tagsInput) {
+                if (c == ',') {
+                    if (!tag.empty()) {
+                        newMedia.tags.push_back(tag);
+                        tag.clear();
+                    }
+                }
+                else if (c != ' ') {
+                    tag += c;
+                }
+            }
+            if (!tag.empty()) {
+                newMedia.tags.push_back(tag);
+            }
+
+            //проверка и добавление
+            if (store.insert(newMedia)) {
+                cout << "Запись добавлена!\n";
+            }
+            else {
+                cout << "Ошибка: запись не добавлена из-за некорректных данных\n";
+            }
+            break;
+        }
+
+        case 10: {//метрики операций
+            printMetrics(cout);
+            break;
+        }
+
+        case 11: {//составной запрос
+            cout << "Запрос (например: tag:роман AND year>=1990 ORDER BY rating DESC LIMIT 10;\n"
+                << "EXPLAIN в начале - показать план): ";
+            string text;
+            getline(cin, text);
+
+            vector<size_t> rows;
+            string plan, error;
+            if (!runCompositeQuery(indexes, snapshot, text, rows, plan, error)) {
+                cout << "Ошибка в запросе: " << error << "\n";
+            }
+            else if (!plan.empty()) {
+                cout << plan;
+            }
+            else {
+                cout << "Найдено " << rows.size() << " записей\n";
+                printCatalog(selectRows(catalog, rows));
+            }
+            break;
+        }
+
+        case 12: {//годовой индекс
+            cout << "Годы от и до (пусто - гистограмма по десятилетиям): ";
+            string range;
+            getline(cin, range);
+
+            int from = 0, to = 0;
+            if (sscanf(range.c_str(), "%d %d", &from, &to) == 2) {
+                vector<size_t> rows = years.rows(snapshot, from, to);
+                cout << "Найдено " << rows.size() << " записей за " << from << "-" << to << "\n";
+                printCatalog(selectRows(catalog, rows));
+            }
+            else {
+                for (const YearBucket& b : years.histogram(snapshot, INT_MIN, INT_MAX, 10)) {
+                    cout << "  " << b.from << "-" << b.to << ": " << b.count << "\n";
+                }
+            }
+            break;
+        }
+
+        case 13: {//полнотекстовый поиск
+            cout << "Слова для поиска: ";
+            string words;
+            getline(cin, words);
+
+            if (!words.empty()) {
+                vector<TextMatch> matches = text.search(snapshot, words, 10, 1);
+                cout << "Лучшие " << matches.size() << " записей (BM25 + рейтинг / 10):\n";
+                for (const TextMatch& m : matches) {
+                    printf("  %6.2f  %s - %s\n", m.score, catalog[m.row].title.c_str(), catalog[m.row].author.c_str());
+                }
+            }
+            break;
+        }
+
+        default: {
+            cout << "Неверный выбор. Попробуйте снова.\n";
+            break;
+        }
+        }
+
+        //пауза перед следующим действием
+        if (running && choice != 0) {
+            cout << "\nНажмите Enter для продолжения...";
+            cin.get();
+        }
+    }
+
+    return 0;
+}
@@ -1,52 +1,140 @@
-#include <iostream>      
+#include "media.h"
+#include "metrics.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "zone_map.h"
+
+#include <iostream>
 #include <fstream>       // для работы с файлами
-#include <vector>        // для динамических массивов
-#include <string>        
 #include <algorithm>     // для сортировки, поиска
-#include <unordered_map> // для словаря 
+#include <unordered_map> // для словаря
 #include <iomanip>       // для форматирования вывода
-#include <sstream>       // для работы со строками как с потоками
+#include <cstdio>        // snprintf
+#include <cstdlib>       // strtoul
+#include <cctype>        // isxdigit
+#include <cerrno>
+#include <cstring>       // memcmp, memcpy
+#include <iterator>
+#include <deque>
+#include <future>        // параллельное форматирование при сохранении
+#include <fcntl.h>       // open
+#include <sys/stat.h>    // fstat
+#include <unistd.h>      // write, close
+#ifdef __SSE2__
+#include <emmintrin.h>   // SIMD-проверка строк перед экранированием
+#endif
 
 using namespace std;
 
-/*------Медиа------*/
-struct Media {
-    string id;        // уникальный номер
-    string title;     // название
-    string author;    // автор/режиссер
-    int year;              // год выпуска
-    vector<string> tags;  // теги/категории
-    double rating;         // рейтинг от 0.0 до 10.0 (9.8)
-
-    // простой конструктор для удобства
-    Media(string i = "", string t = "", string a = "",
-        int y = 0, vector<string> tg = {}, double r = 0.0)
-        : id(i), title(t), author(a), year(y), tags(tg), rating(r) {
-    }
-};
+//поток служебных сообщений: в меню это cout, в пакетном режиме - cerr,
+//чтобы в stdout попадали только данные
+ostream* logStream = &cout;
+
+ostream& logOut() {
+    return *logStream;
+}
+
+/*------UTF-8------*/
+//декодирует один символ UTF-8 с позиции pos и сдвигает pos на следующий символ
+//битые последовательности считаются одним символом на байт
+uint32_t decodeUtf8(const string& s, size_t& pos) {
+    unsigned char c = s[pos];
+    int len = 1;
+    uint32_t cp = c;
+    if (c >= 0xF0 && c < 0xF8) { len = 4; cp = c & 0x07; }
+    else if (c >= 0xE0) { len = (c < 0xF0) ? 3 : 1; cp = c & 0x0F; }
+    else if (c >= 0xC0) { len = 2; cp = c & 0x1F; }
+    if (len == 1 || pos + len > s.size()) {
+        pos++;
+        return c;
+    }
+    for (int k = 1; k < len; k++) {
+        unsigned char cc = s[pos + k];
+        if ((cc & 0xC0) != 0x80) { //не байт продолжения
+            pos++;
+            return c;
+        }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    pos += len;
+    return cp;
+}
+
+//ширина символа в колонках терминала: 0 - комбинируемые знаки, 2 - широкие (CJK, эмодзи), иначе 1
+int charWidth(uint32_t cp) {
+    if (cp == 0) return 0;
+    if ((cp >= 0x0300 && cp <= 0x036F) || //комбинируемые диакритические знаки (й, ё в NFD)
+        (cp >= 0x200B && cp <= 0x200F) || //пробелы нулевой ширины
+        (cp >= 0xFE00 && cp <= 0xFE0F)) { //селекторы вариантов
+        return 0;
+    }
+    if ((cp >= 0x1100 && cp <= 0x115F) || //хангыль чамо
+        (cp >= 0x2E80 && cp <= 0xA4CF && cp != 0x303F) || //CJK, кана
+        (cp >= 0xAC00 && cp <= 0xD7A3) || //слоги хангыля
+        (cp >= 0xF900 && cp <= 0xFAFF) || //CJK совместимость
+        (cp >= 0xFE30 && cp <= 0xFE4F) ||
+        (cp >= 0xFF00 && cp <= 0xFF60) || //полноширинные формы
+        (cp >= 0xFFE0 && cp <= 0xFFE6) ||
+        (cp >= 0x1F300 && cp <= 0x1F64F) || //эмодзи
+        (cp >= 0x1F900 && cp <= 0x1F9FF) ||
+        (cp >= 0x20000 && cp <= 0x3FFFD)) {
+        return 2;
+    }
+    return 1;
+}
+
+//считает ширину строки и место обрезки, чтобы префикс занимал не больше limit колонок
+TextWidth measureText(const string& s, int limit) {
+    TextWidth w;
+    size_t pos = 0;
+    bool cutDone = false;
+    while (pos < s.size()) {
+        size_t charStart = pos;
+        int cw = charWidth(decodeUtf8(s, pos));
+        if (!cutDone && w.width + cw > limit) { //символ не влезает - режем перед ним
+            w.cutBytes = charStart;
+            w.cutWidth = w.width;
+            cutDone = true;
+        }
+        w.width += cw;
+    }
+    if (!cutDone) {
+        w.cutBytes = s.size();
+        w.cutWidth = w.width;
+    }
+    return w;
+}
+
 /*------Валидация------*/
+//проверка без сообщений (можно вызывать из нескольких потоков)
+bool checkRecord(const Media& m) {
+    return !m.title.empty() && m.rating >= 0.0 && m.rating <= 10.0 &&
+        m.year >= 1800 && m.year <= 2100 && !m.author.empty();
+}
+
 //функция проверяет корректность данных в медиа
 bool isValid(const Media& m) {
+    if (checkRecord(m)) return true;
 
     if (m.title.empty()) { //не пустое название
-        cout << "Ошибка: у медиа с id=" << m.id << " пустое название\n";
+        logOut() << "Ошибка: у медиа с id=" << m.id << " пустое название\n";
         return false;
     }
 
     if (m.rating < 0.0 || m.rating > 10.0) { //рейтинг от 0 до 10
-        cout << "Ошибка: у '" << m.title << "' рейтинг " << m.rating
+        logOut() << "Ошибка: у '" << m.title << "' рейтинг " << m.rating
             << " (должен быть 0-10)\n";
         return false;
     }
 
     if (m.year < 1800 || m.year > 2100) { //год издания
-        cout << "Ошибка: у '" << m.title << "' год " << m.year
+        logOut() << "Ошибка: у '" << m.title << "' год " << m.year
             << " (должен быть 1800-2100)\n";
         return false;
     }
 
     if (m.author.empty()) { //автор
-        cout << "Ошибка: у '" << m.title << "' нет автора\n";
+        logOut() << "Ошибка: у '" << m.title << "' нет автора\n";
         return false;
     }
 
@@ -54,7 +142,53 @@ bool isValid(const Media& m) {
     return true;
 }
 
+//добавляет запись в каталог, если она корректна
+bool insertRecord(vector<Media>& catalog, Media m) {
+    OpTimer timer(Op::Insert);
+    timer.setRecords(1);
+    if (!isValid(m)) return false;
+    m.cacheWidths(); //название и автор могли быть заданы после конструктора
+    catalog.push_back(move(m));
+    return true;
+}
+
 /*------JSON-парсер-------*/
+//файл с записями, добавленными после последнего полного сохранения
+string deltaFileName(const string& filename) {
+    return filename + ".delta";
+}
+
+//первая строка дельты: сколько записей было в основном файле, когда дельта начата.
+//Полное сохранение переименовывает новый файл и только потом удаляет дельту; если между
+//этими шагами был сбой, число записей файла уже другое - дельта устарела
+const char DELTA_BASE_PREFIX[] = "{\"delta_base\": ";
+
+//дописывает символ с кодом cp в строку в кодировке UTF-8
+void appendUtf8(string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    }
+    else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+static bool isHexDigit(char c) {
+    return isxdigit((unsigned char)c) != 0;
+}
+
 //вспомогательная функция для чтения строки из JSON
 string readJsonString(istringstream& stream) {
     string result;
@@ -68,8 +202,42 @@ string readJsonString(istringstream& stream) {
             switch (c) {
             case 'n': result += '\n'; break;//перевод строки
             case 't': result += '\t'; break;//табуляция
+            case 'r': result += '\r'; break;//возврат каретки
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
             case '"': result += '"'; break;//обычная кавычка
             case '\\': result += '\\'; break;//обычный слэш
+            case 'u': { //\uXXXX - код символа, переводим в UTF-8
+                streampos start = stream.tellg();
+                char hex[5] = {};
+                if (!stream.read(hex, 4) || !all_of(hex, hex + 4, isHexDigit)) {
+                    //не четыре hex-цифры: U+FFFD, а символы после \u (вместе с закрывающей
+                    //кавычкой) разбираются как обычно
+                    stream.clear();
+                    stream.seekg(start);
+                    appendUtf8(result, 0xFFFD);
+                    break;
+                }
+                uint32_t cp = (uint32_t)strtoul(hex, nullptr, 16);
+                if (cp == 0) cp = 0xFFFD; //NUL внутри строки не храним
+                if (cp >= 0xD800 && cp <= 0xDFFF) { //суррогат: старший + \u младший, иначе U+FFFD
+                    streampos mark = stream.tellg();
+                    char low[7] = {};
+                    uint32_t lo = 0;
+                    bool paired = cp <= 0xDBFF && stream.read(low, 6) && low[0] == '\\' && low[1] == 'u' &&
+                        all_of(low + 2, low + 6, isHexDigit);
+                    if (paired) lo = (uint32_t)strtoul(low + 2, nullptr, 16);
+                    if (paired && lo >= 0xDC00 && lo <= 0xDFFF) cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    else {
+                        //следующие символы - не младший суррогат: разбираются как обычно
+                        stream.clear();
+                        stream.seekg(mark);
+                        cp = 0xFFFD;
+                    }
+                }
+                appendUtf8(result, cp);
+                break;
+            }
             default: result += c;//другой символ
             }
         }
@@ -80,248 +248,614 @@ string readJsonString(istringstream& stream) {
     return result; //возвращаем собранную строку
 }
 
-//загрузка данных из текстового файла
+//разбирает значение поля key из потока (позиция - сразу после двоеточия) и записывает в m
+void readJsonField(istringstream& stream, const string& key, Media& currentMedia) {
+    //обрабатываем разные поля (строки читаем с учетом экранирования)
+    stream >> ws;
+    if (key == "id") {
+        currentMedia.id = readJsonString(stream);
+    }
+    else if (key == "title") {
+        currentMedia.title = readJsonString(stream);
+    }
+    else if (key == "author") {
+        currentMedia.author = readJsonString(stream);
+    }
+    else if (key == "year") {
+        if (!(stream >> currentMedia.year)) { //число до запятой
+            logOut() << "Ошибка: неверный год у '" << currentMedia.title << "'\n";
+        }
+    }
+    else if (key == "rating") {
+        if (!(stream >> currentMedia.rating)) {
+            logOut() << "Ошибка: неверный рейтинг у '" << currentMedia.title << "'\n";
+        }
+    }
+    else if (key == "tags" && stream.peek() == '[') {
+        stream.get(); //открывающая скобка
+        char c;
+        while (stream >> ws && stream.peek() != EOF) {
+            c = (char)stream.peek();
+            if (c == '"') {
+                currentMedia.tags.push_back(readJsonString(stream));
+            }
+            else if (c == ',') {
+                stream.get();
+            }
+            else {
+                if (c == ']') stream.get(); //закрывающая скобка
+                break;
+            }
+        }
+    }
+    else if (stream.peek() == '"') { //неизвестное строковое поле пропускаем
+        readJsonString(stream);
+    }
+    else { //неизвестное значение-число пропускаем до конца
+        while (stream.peek() != EOF && stream.peek() != ',' && stream.peek() != '}') {
+            stream.get();
+        }
+    }
+}
+
+//разбирает запись, записанную в одну строку: {"id": "1", "title": "...", ...}
+//возвращает false, если строка оборвана (например, при сбое во время дописывания)
+bool parseJsonLine(const string& line, Media& m) {
+    istringstream stream(line);
+    char c;
+    if (!(stream >> c) || c != '{') return false;
+    m = Media();
+    while (stream >> ws && stream.peek() == '"') {
+        string key = readJsonString(stream);
+        if (!(stream >> c) || c != ':') return false;
+        readJsonField(stream, key, m);
+        if (!(stream >> c)) return false;
+        if (c == '}') {
+            m.cacheWidths();
+            return true;
+        }
+        if (c != ',') return false;
+    }
+    return false;
+}
+
+//разбирает плоский JSON-объект в одну строку: {"ключ": "строка", "ключ2": 10}
+//строки раскодируются, числа, массивы и вложенные объекты сохраняются как текст
+bool parseJsonObject(const string& line, map<string, string>& fields) {
+    istringstream stream(line);
+    char c;
+    if (!(stream >> c) || c != '{') return false;
+    stream >> ws;
+    if (stream.peek() == '}') return true; //пустой объект
+    while (stream >> ws && stream.peek() == '"') {
+        string key = readJsonString(stream);
+        if (!(stream >> c) || c != ':') return false;
+        stream >> ws;
+        string value;
+        if (stream.peek() == '"') {
+            value = readJsonString(stream);
+        }
+        else if (stream.peek() == '[' || stream.peek() == '{') { //массив/объект - текстом целиком
+            int depth = 0;
+            bool inString = false;
+            do {
+                char ch = (char)stream.get();
+                value += ch;
+                if (inString) {
+                    if (ch == '\\') value += (char)stream.get();
+                    else if (ch == '"') inString = false;
+                }
+                else if (ch == '"') inString = true;
+                else if (ch == '[' || ch == '{') depth++;
+                else if (ch == ']' || ch == '}') depth--;
+            } while (depth > 0 && stream.peek() != EOF);
+        }
+        else {
+            while (stream.peek() != EOF && stream.peek() != ',' && stream.peek() != '}') {
+                value += (char)stream.get();
+            }
+            size_t end = value.find_last_not_of(" \t\r");
+            value.resize(end == string::npos ? 0 : end + 1);
+        }
+        fields[key] = value;
+        if (!(stream >> c)) return false;
+        if (c == '}') return true;
+        if (c != ',') return false;
+    }
+    return false;
+}
+
+//дочитывает дельту (записи, дописанные после последнего полного сохранения)
+void loadDelta(vector<Media>& catalog, const string& filename) {
+    TRACE_SCOPE("load/delta");
+    ifstream file(deltaFileName(filename));
+    if (!file.is_open()) return; //дельты нет - это нормально
+
+    string line;
+    size_t added = 0;
+    bool first = true;
+    while (getline(file, line)) {
+        if (first && line.compare(0, sizeof(DELTA_BASE_PREFIX) - 1, DELTA_BASE_PREFIX) == 0) {
+            first = false;
+            unsigned long long base = strtoull(line.c_str() + sizeof(DELTA_BASE_PREFIX) - 1, nullptr, 10);
+            if (base != catalog.size()) {
+                //записи дельты уже в основном файле; удаляем, чтобы новые вставки не попали в нее
+                logOut() << "Дельта " << deltaFileName(filename) << " начата к " << base << " записям, а в файле "
+                    << catalog.size() << " - она устарела и удалена\n";
+                file.close();
+                ::unlink(deltaFileName(filename).c_str());
+                return;
+            }
+            continue;
+        }
+        first = false; //дельта без заголовка (старые версии) дочитывается как есть
+        Media m;
+        if (parseJsonLine(line, m) && isValid(m)) {
+            catalog.push_back(m);
+            added++;
+        }
+    }
+    logOut() << "Из дельты добавлено " << added << " записей\n";
+}
+
+//записи разбираются пачками: разбор, проверка и перенос в каталог видны в трассировке
+//отдельными отрезками (поштучные отрезки на миллионах записей были бы дороже самой загрузки)
+const size_t LOAD_BATCH = 65536;
+
+//проверяет пачку разобранных записей и переносит корректные в каталог
+void appendBatch(vector<Media>& catalog, vector<Media>& batch) {
+    {
+        TRACE_SCOPE("load/validate");
+        //проверка - параллельно, сообщения об ошибках - по порядку в этом потоке
+        vector<char> valid(batch.size());
+        parallelFor(batch.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) valid[i] = checkRecord(batch[i]);
+        });
+        size_t kept = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (valid[i] || isValid(batch[i])) {
+                if (kept != i) batch[kept] = move(batch[i]);
+                kept++;
+            }
+        }
+        batch.resize(kept);
+    }
+    if (catalog.size() + batch.size() > catalog.capacity()) {
+        TRACE_SCOPE("load/realloc"); //рост вектора каталога (как у push_back - в два раза)
+        catalog.reserve(max(catalog.capacity() * 2, catalog.size() + batch.size()));
+    }
+    TRACE_SCOPE("load/append");
+    move(batch.begin(), batch.end(), back_inserter(catalog));
+    batch.clear();
+}
+
+/*------Бинарный снимок------*/
+//Формат: 8 байт SNAPSHOT_MAGIC, uint64 число записей, затем записи подряд:
+//id, title, author (uint32 длина + байты), int32 год, double рейтинг,
+//uint16 число тегов и теги (uint32 длина + байты). Числа - в порядке байт машины (little-endian).
+const char SNAPSHOT_MAGIC[8] = { 'L', 'R', 'S', 'N', 'A', 'P', '0', '1' };
+
+//читает значение простого типа из буфера; false, если данные кончились
+template <typename T>
+bool readPod(const string& data, size_t& pos, T& value) {
+    if (pos + sizeof(T) > data.size()) return false;
+    memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+bool readSnapshotString(const string& data, size_t& pos, string& value) {
+    uint32_t len;
+    if (!readPod(data, pos, len) || pos + len > data.size()) return false;
+    value.assign(data, pos, len);
+    pos += len;
+    return true;
+}
+
+//разбирает одну запись снимка в конец пачки; false, если снимок оборван
+bool decodeSnapshotRecord(const string& data, size_t& pos, vector<Media>& batch) {
+    Media m;
+    int32_t year;
+    uint16_t tagCount;
+    bool ok = readSnapshotString(data, pos, m.id) && readSnapshotString(data, pos, m.title) &&
+        readSnapshotString(data, pos, m.author) && readPod(data, pos, year) &&
+        readPod(data, pos, m.rating) && readPod(data, pos, tagCount);
+    m.tags.resize(ok ? tagCount : 0);
+    for (size_t t = 0; ok && t < m.tags.size(); t++) {
+        ok = readSnapshotString(data, pos, m.tags[t]);
+    }
+    if (!ok) return false;
+    m.year = year;
+    m.cacheWidths();
+    batch.push_back(move(m));
+    return true;
+}
+
+//загрузка бинарного снимка (файл читается целиком; сигнатура уже прочитана)
+void loadSnapshot(ifstream& file, vector<Media>& catalog, const string& filename) {
+    string data;
+    {
+        TRACE_SCOPE("load/read");
+        data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+    size_t pos = 0;
+    uint64_t count = 0;
+    if (!readPod(data, pos, count)) {
+        logOut() << "Ошибка: поврежден заголовок снимка " << filename << "\n";
+        return;
+    }
+    //запись занимает не меньше 30 байт - не верим счетчику больше, чем размеру файла
+    catalog.reserve((size_t)min<uint64_t>(count, data.size() / 30));
+
+    vector<Media> batch;
+    for (uint64_t i = 0; i < count; ) {
+        bool ok = true;
+        {
+            TRACE_SCOPE("load/decode");
+            uint64_t batchEnd = min<uint64_t>(i + LOAD_BATCH, count);
+            for (; ok && i < batchEnd; i++) {
+                ok = decodeSnapshotRecord(data, pos, batch);
+            }
+        }
+        appendBatch(catalog, batch);
+        if (!ok) {
+            logOut() << "Ошибка: снимок " << filename << " оборван на записи " << i << "\n";
+            return;
+        }
+    }
+}
+
+//загрузка данных из файла: JSON-массив (одно поле на строку), JSON-строки или бинарный снимок
 vector<Media> loadFromFile(const string& filename) {
+    OpTimer timer(Op::Load);
+    TRACE_SCOPE("loadFromFile");
     vector<Media> catalog; //хранение всех медиа
-    ifstream file(filename);//открываем файл с данными для чтения
+    ifstream file(filename, ios::binary);//открываем файл с данными для чтения
 
     if (!file.is_open()) {
-        cout << "Ошибка: не могу открыть файл " << filename << "\n"; //если файла нет сообщаем об ошибке
+        logOut() << "Ошибка: не могу открыть файл " << filename << "\n"; //если файла нет сообщаем об ошибке
+        return catalog;
+    }
+
+    char magic[sizeof(SNAPSHOT_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    if (file.gcount() == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0) {
+        loadSnapshot(file, catalog, filename);
+        logOut() << "Загружено " << catalog.size() << " записей из файла\n";
+        loadDelta(catalog, filename);
+        timer.setRecords(catalog.size());
         return catalog;
     }
+    file.clear();
+    file.seekg(0); //текстовый формат - читаем с начала
 
     string line;//текущая строка
     Media currentMedia;//текущий объект
     bool inMedia = false;
     string currentKey;//ключ JSON
-
-    while (getline(file, line)) {//читаем файл построчно
-        size_t start = line.find_first_not_of(" \t\n\r");//убираем лишние пробелы в начале строки
-        if (start == string::npos) continue; // Пустая строка
-        size_t end = line.find_last_not_of(" \t\n\r");//убираем лишние пробелы в конце строки
-        string trimmed = line.substr(start, end - start + 1);
-
-        if (trimmed == "{") {//если находим начало нового объекта медиа
-            currentMedia = Media(); //создаем новый пустой объект
-            inMedia = true;
-        }
-
-        else if (trimmed == "}," || trimmed == "}") { //если находим конец объекта медиа
-            if (inMedia && isValid(currentMedia)) {
-                catalog.push_back(currentMedia); //добавляем в каталог
-            }
-            inMedia = false;
-        }
-        else if (inMedia && trimmed.find(':') != string::npos) {//если находим пару ключ-значение
-            size_t colonPos = trimmed.find(':');
-            string key = trimmed.substr(colonPos - 2); //без кавычек
-            string value = trimmed.substr(colonPos + 1);
-            //убираем пробелы в начале и в конце
-            size_t valueStart = value.find_first_not_of(" \t\n\r\"");
-            size_t valueEnd = value.find_last_not_of(" \t\n\r\"");
-            if (valueStart != string::npos && valueEnd != string::npos) {
-                value = value.substr(valueStart, valueEnd - valueStart +1);
-            }
-
-            //обрабатываем разные поля
-            if (key == "id") {
-                currentMedia.id = value;
-            }
-            else if (key == "title") {
-                currentMedia.title = value;
-            }
-            else if (key == "author") {
-                currentMedia.author = value;
-            }
-            else if (key == "year") {
-                try {
-                    currentMedia.year = stoi(value); //преобразуем строку в число
+    vector<Media> batch; //разобранные, но еще не проверенные записи
+    bool more = true;
+
+    while (more) {
+        {
+            TRACE_SCOPE("load/parse");
+            while (batch.size() < LOAD_BATCH && (more = (bool)getline(file, line))) {//читаем файл построчно
+                size_t start = line.find_first_not_of(" \t\n\r");//убираем лишние пробелы в начале строки
+                if (start == string::npos) continue; // Пустая строка
+                size_t end = line.find_last_not_of(" \t\n\r");//убираем лишние пробелы в конце строки
+                string trimmed = line.substr(start, end - start + 1);
+
+                if (trimmed == "{") {//если находим начало нового объекта медиа
+                    currentMedia = Media(); //создаем новый пустой объект
+                    inMedia = true;
                 }
-                catch (...) {
-                    cout << "Ошибка: неверный год у '" << currentMedia.title << "'\n";
-                }
-            }
-            else if (key == "rating") {
-                try {
-                    currentMedia.rating = stod(value); //преобразуем строку в дробное число
-                }
-                catch (...) {
-                    cout << "Ошибка: неверный рейтинг у '" << currentMedia.title << "'\n";
-                }
-            }
-            else if (key == "tags" && value[0] == '[') {
-                //упрощенная обработка тегов
-                size_t start = value.find('[');
-                size_t end = value.find(']');
-                if (start != string::npos && end != string::npos) {
-                    string tagsStr = value.substr(start + 1, end - start - 1);
-                    string tag;
-                    for (char c : tagsStr) {
-                        if (c == '"' || c == ',') {
-                            if (!tag.empty()) {
-                                currentMedia.tags.push_back(tag);
-                                tag.clear();
-                            }
-                        }
-                        else if (c != ' ') {
-                            tag += c;
-                        }
+
+                else if (trimmed[0] == '{') {//запись целиком в одной строке (JSON-строки)
+                    if (parseJsonLine(trimmed, currentMedia)) {
+                        batch.push_back(move(currentMedia));
                     }
-                    if (!tag.empty()) {
-                        currentMedia.tags.push_back(tag);
+                    inMedia = false;
+                }
+                else if (trimmed == "}," || trimmed == "}") { //если находим конец объекта медиа
+                    if (inMedia) {
+                        currentMedia.cacheWidths(); //ширины считаем один раз при загрузке
+                        batch.push_back(move(currentMedia)); //добавляем в пачку
                     }
+                    inMedia = false;
+                }
+                else if (inMedia && trimmed[0] == '"') {//если находим пару "ключ": значение
+                    istringstream stream(trimmed);
+                    string key = readJsonString(stream);
+                    char colon;
+                    stream >> colon; //пропускаем двоеточие
+                    readJsonField(stream, key, currentMedia);
                 }
             }
         }
+        appendBatch(catalog, batch); //проверка и перенос в каталог
     }
 
     file.close();
-    cout << "Загружено " << catalog.size() << " записей из файла\n";
+    logOut() << "Загружено " << catalog.size() << " записей из файла\n";
+    loadDelta(catalog, filename);
+    timer.setRecords(catalog.size());
     return catalog;
 }
 
 /*-------Поиск и фильтрация------*/
 
-//поиск по подстроке в названии или авторе
-vector<Media> findBySubstring(const vector<Media>& catalog,
-    const string& searchText) {
+//копирует записи с данными номерами строк
+vector<Media> selectRows(MediaSpan catalog, const vector<size_t>& rows) {
     vector<Media> results;
+    results.reserve(rows.size());
+    for (size_t row : rows) results.push_back(catalog[row]);
+    return results;
+}
 
-    for (const Media& item : catalog) {//перебираем все медиа в каталоге
-        //ищем подстроку в названии без учета регистра
-        string titleLower = item.title;
-        string searchLower = searchText;
+//сливает номера строк кусков (куски идут по порядку, поэтому результат отсортирован)
+vector<size_t> concatRows(vector<size_t> a, vector<size_t> b) {
+    if (a.empty()) return b;
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
 
-        //преобразуем к нижнему регистру для поиска без учета регистра
-        transform(titleLower.begin(), titleLower.end(), titleLower.begin(), ::tolower);
-        transform(searchLower.begin(), searchLower.end(), searchLower.begin(), ::tolower);
+//совпадение для поиска по подстроке: searchLower - текст в нижнем регистре,
+//titleLower - буфер под название (чтобы не выделять память на каждую запись)
+bool matchesSubstring(const Media& item, const string& searchLower, const string& searchText, string& titleLower) {
+    titleLower = item.title;
+    transform(titleLower.begin(), titleLower.end(), titleLower.begin(), ::tolower);
+    return titleLower.find(searchLower) != string::npos || item.author.find(searchText) != string::npos;
+}
 
-        //если нашли подстроку в названии или авторе - добавляем в результаты
-        if (titleLower.find(searchLower) != string::npos ||
-            item.author.find(searchText) != string::npos) {
-            results.push_back(item);
+string foldCase(const string& s) {
+    string out = s;
+    for (size_t i = 0; i < out.size(); i++) {
+        unsigned char c = out[i];
+        if (c < 0x80) {
+            out[i] = (char)tolower(c);
+        }
+        else if (c == 0xD0 && i + 1 < out.size()) {
+            unsigned char next = out[i + 1];
+            if (next >= 0x90 && next <= 0x9F) { //А-П -> а-п (D0 B0-BF)
+                out[i + 1] = (char)(next + 0x20);
+            }
+            else if (next >= 0xA0 && next <= 0xAF) { //Р-Я -> р-я (D1 80-8F)
+                out[i] = (char)0xD1;
+                out[i + 1] = (char)(next - 0x20);
+            }
+            else if (next == 0x81) { //Ё -> ё
+                out[i] = (char)0xD1;
+                out[i + 1] = (char)0x91;
+            }
+            i++;
         }
     }
-
-    cout << "Найдено " << results.size() << " записей по запросу '" << searchText << "'\n";
-    return results;
+    return out;
 }
 
-//фильтрация по тегу
-vector<Media> findByTag(const vector<Media>& catalog,
-    const string& tag) {
-    vector<Media> results;
-
-    for (const Media& item : catalog) {
-        //ищем тег в списке тегов текущего медиа
-        for (const string& itemTag : item.tags) {
-            if (itemTag == tag) {
-                results.push_back(item);
-                break; //нашли тег - переходим к следующему медиа
-            }
+vector<string> splitWords(const string& s) {
+    vector<string> words;
+    string folded = foldCase(s);
+    string word;
+    for (size_t i = 0; i < folded.size();) {
+        unsigned char c = folded[i];
+        size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        length = min(length, folded.size() - i);
+        bool letter;
+        if (c < 0x80) letter = isalnum(c) != 0;
+        else if (c == 0xC2 && length == 2) { //«», неразрывный пробел и прочее из Latin-1 - разделители
+            letter = false;
+        }
+        else if (c == 0xE2 && length == 3 && (unsigned char)folded[i + 1] == 0x80) { //тире, кавычки, многоточие
+            letter = false;
         }
+        else letter = true;
+        if (letter) word.append(folded, i, length);
+        else if (!word.empty()) {
+            words.push_back(word);
+            word.clear();
+        }
+        i += length;
     }
+    if (!word.empty()) words.push_back(word);
+    return words;
+}
 
-    cout << "Найдено " << results.size() << " записей с тегом '" << tag << "'\n";
+//поиск по подстроке в названии (без учета регистра латиницы) или авторе; номера строк
+vector<size_t> findRowsBySubstring(MediaSpan catalog, const string& searchText) {
+    OpTimer timer(Op::SearchSubstring);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("findBySubstring");
+
+    //преобразуем к нижнему регистру для поиска без учета регистра
+    string searchLower = searchText;
+    transform(searchLower.begin(), searchLower.end(), searchLower.begin(), ::tolower);
+
+    return parallelReduce(catalog.size(), 4096, vector<size_t>(),
+        [&](size_t begin, size_t end) {
+            vector<size_t> rows;
+            string titleLower;
+            for (size_t i = begin; i < end; i++) {
+                //если нашли подстроку в названии или авторе - добавляем в результаты
+                if (matchesSubstring(catalog[i], searchLower, searchText, titleLower)) rows.push_back(i);
+            }
+            return rows;
+        },
+        concatRows);
+}
+
+vector<Media> findBySubstring(MediaSpan catalog,
+    const string& searchText) {
+    vector<Media> results = selectRows(catalog, findRowsBySubstring(catalog, searchText));
+    logOut() << "Найдено " << results.size() << " записей по запросу '" << searchText << "'\n";
     return results;
 }
 
-//получение топ-N по рейтингу
-vector<Media> getTopN(const vector<Media>& catalog, int n) {
+//фильтрация по тегу; номера строк
+vector<size_t> findRowsByTag(MediaSpan catalog, const string& tag) {
+    OpTimer timer(Op::SearchTag);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("findByTag");
+
+    return parallelReduce(catalog.size(), 4096, vector<size_t>(),
+        [&](size_t begin, size_t end) {
+            vector<size_t> rows;
+            for (size_t i = begin; i < end; i++) {
+                const vector<string>& tags = catalog[i].tags;
+                //ищем тег в списке тегов текущего медиа
+                if (find(tags.begin(), tags.end(), tag) != tags.end()) rows.push_back(i);
+            }
+            return rows;
+        },
+        concatRows);
+}
 
-    vector<Media> sortedCatalog = catalog;//создаем копию каталога для сортировки
+vector<Media> findByTag(MediaSpan catalog,
+    const string& tag) {
+    vector<Media> results = selectRows(catalog, findRowsByTag(catalog, tag));
+    logOut() << "Найдено " << results.size() << " записей с тегом '" << tag << "'\n";
+    return results;
+}
 
-    sort(sortedCatalog.begin(), sortedCatalog.end(),//сортируем по рейтингу (от большего к меньшему)
-        [](const Media& a, const Media& b) {
-            return a.rating > b.rating; //сравниваем рейтинги
-        });
+//получение топ-N по рейтингу
+//номера строк N лучших по рейтингу (при равном рейтинге - по порядку в каталоге)
+vector<size_t> getTopRows(MediaSpan catalog, int n, const ZoneMap* zones) {
+    OpTimer timer(Op::TopN);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("getTopN");
 
     //если запросили больше, чем есть - возвращаем все
-    if (n > sortedCatalog.size()) {
-        n = sortedCatalog.size();
+    size_t count = min((size_t)max(n, 0), catalog.size());
+    auto better = [&](size_t a, size_t b) {
+        if (catalog[a].rating != catalog[b].rating) return catalog[a].rating > catalog[b].rating;
+        return a < b;
+    };
+
+    vector<size_t> rows;
+    if (zones && !zones->zones.empty() && zones->rows <= catalog.size()) {
+        //кандидаты из блоков карты с отсечением, строки после карты - все
+        rows = topRowsByZones(catalog, *zones, count, true, [](size_t begin, size_t end, vector<uint32_t>& out) {
+            for (size_t i = begin; i < end; i++) out.push_back((uint32_t)i);
+        });
+        for (size_t i = zones->rows; i < catalog.size(); i++) rows.push_back(i);
     }
+    else {
+        rows.resize(catalog.size());
+        for (size_t i = 0; i < rows.size(); i++) rows[i] = i;
+    }
+    //сортируем номера строк, а не копию каталога, и только первые count
+    partial_sort(rows.begin(), rows.begin() + count, rows.end(), better);
+    rows.resize(count);
+    return rows;
+}
 
-    //создаем вектор только с первыми N элементами
-    vector<Media> topN(sortedCatalog.begin(), sortedCatalog.begin() + n);
-
-    cout << "Топ-" << n << " по рейтингу:\n";
+vector<Media> getTopN(MediaSpan catalog, int n) {
+    vector<Media> topN = selectRows(catalog, getTopRows(catalog, n));
+    logOut() << "Топ-" << topN.size() << " по рейтингу:\n";
     return topN;
 }
 
 //поиск дубликатов (одинаковые название + автор + год)
-void findDuplicates(const vector<Media>& catalog) {
-
-    unordered_map<string, int> countMap;//создаем словарь ключ - количество вхождений
-
-    for (const Media& item : catalog) {//подсчитываем сколько раз встречается каждая комбинация
+//возвращает пары ключ - количество вхождений для ключей, встречающихся больше одного раза
+vector<pair<string, int>> collectDuplicates(MediaSpan catalog) {
+    OpTimer timer(Op::Duplicates);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("collectDuplicates");
+
+    //ключ: название|автор|год
+    auto makeKey = [](const Media& item) {
+        return item.title + "|" + item.author + "|" + to_string(item.year);
+    };
+
+    //одинаковые ключи имеют одинаковый хеш, поэтому строки делятся на независимые
+    //части по хешу ключа, и каждая часть считается своим словарем без слияния
+    size_t parts = runSequential(catalog.size()) ? 1 : (size_t)threadPool().size() * 4;
+    vector<size_t> hashes(parts > 1 ? catalog.size() : 0);
+    parallelFor(hashes.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) hashes[i] = hash<string>()(makeKey(catalog[i]));
+    });
+
+    vector<vector<pair<string, int>>> found(parts);
+    runChunks(parts, [&](size_t part) {
+        unordered_map<string, int> countMap;//создаем словарь ключ - количество вхождений
+        for (size_t i = 0; i < catalog.size(); i++) {//подсчитываем сколько раз встречается каждая комбинация
+            if (parts == 1 || hashes[i] % parts == part) countMap[makeKey(catalog[i])]++;
+        }
+        for (const auto& pair : countMap) {
+            if (pair.second > 1) found[part].push_back(pair);
+        }
+    });
 
-        string key = item.title + "|" + item.author + "|" + to_string(item.year);//создаем уникальный ключ: название|автор|год
-        countMap[key]++; //увеличиваем счетчик для этого ключа
+    vector<pair<string, int>> duplicates;
+    for (auto& part : found) {
+        duplicates.insert(duplicates.end(), part.begin(), part.end());
     }
+    sort(duplicates.begin(), duplicates.end()); //порядок не зависит от хеш-таблицы
+    return duplicates;
+}
+
+//вывод дубликатов
+void findDuplicates(MediaSpan catalog) {
+    vector<pair<string, int>> duplicates = collectDuplicates(catalog);
 
-    //выводим дубликаты
-    bool foundDuplicates = false;
     cout << "\n=== ПОИСК ДУБЛИКАТОВ ===\n";
 
-    for (const auto& pair : countMap) {
-        if (pair.second > 1) {
-            cout << "Дубликат: " << pair.first
-                << " (встречается " << pair.second << " раз)\n";
-            foundDuplicates = true;
-        }
+    for (const auto& pair : duplicates) {
+        cout << "Дубликат: " << pair.first
+            << " (встречается " << pair.second << " раз)\n";
     }
 
-    if (!foundDuplicates) {
+    if (duplicates.empty()) {
         cout << "Дубликаты не найдены\n";
     }
 }
 
 /*------Вывод информации------*/
 
+//выводит текст в колонку по закэшированной ширине: длинный обрезается с "...", короткий дополняется пробелами
+void printCell(ostream& out, const string& text, const TextWidth& w, int colWidth) {
+    if (w.width > colWidth - 3) {
+        out.write(text.data(), w.cutBytes);
+        out << "..." << string(colWidth - 3 - w.cutWidth, ' ');
+    }
+    else {
+        out << text << string(colWidth - w.width, ' ');
+    }
+}
+
+//выводит заголовок колонки (заголовков мало, ширину считаем на месте)
+void printHeaderCell(ostream& out, const string& text, int colWidth) {
+    printCell(out, text, measureText(text, colWidth - 3), colWidth);
+}
+
 //красивый табличный вывод
-void printCatalog(const vector<Media>& catalog) {
+void printCatalog(MediaSpan catalog) {
     if (catalog.empty()) {
         cout << "Каталог пуст\n";
         return;
     }
 
-    //настройки ширины колонок
-    const int TITLE_WIDTH = 30;
-    const int AUTHOR_WIDTH = 25;
-    const int YEAR_WIDTH = 8;
-    const int RATING_WIDTH = 10;
-
     //выводим заголовок таблицы
     cout << "\n" << string(80, '=') << "\n";
     cout << "КАТАЛОГ МЕДИА (" << catalog.size() << " записей)\n";
     cout << string(80, '=') << "\n";
 
-    //заголовки колонок
-    cout << left
-        << setw(TITLE_WIDTH) << "НАЗВАНИЕ"
-        << setw(AUTHOR_WIDTH) << "АВТОР"
-        << setw(YEAR_WIDTH) << "ГОД"
-        << setw(RATING_WIDTH) << "РЕЙТИНГ"
-        << "ТЕГИ\n";
+    //заголовки колонок (setw считает байты, поэтому кириллицу выравниваем сами)
+    printHeaderCell(cout, "НАЗВАНИЕ", TITLE_WIDTH);
+    printHeaderCell(cout, "АВТОР", AUTHOR_WIDTH);
+    printHeaderCell(cout, "ГОД", YEAR_WIDTH);
+    printHeaderCell(cout, "РЕЙТИНГ", RATING_WIDTH);
+    cout << "ТЕГИ\n";
 
     cout << string(80, '-') << "\n";
 
     //выводим каждую запись
-    for (const Media& item : catalog) {//обрезаем длинные названия и авторов
-        string title = item.title;
-        if (title.length() > TITLE_WIDTH - 3) {
-            title = title.substr(0, TITLE_WIDTH - 3) + "...";
-        }
-
-        string author = item.author;
-        if (author.length() > AUTHOR_WIDTH - 3) {
-            author = author.substr(0, AUTHOR_WIDTH - 3) + "...";
-        }
+    for (const Media& item : catalog) {//обрезаем длинные названия и авторов по закэшированной ширине
+        printCell(cout, item.title, item.titleWidth, TITLE_WIDTH);
+        printCell(cout, item.author, item.authorWidth, AUTHOR_WIDTH);
 
         //выводим основную информацию
         cout << left
-            << setw(TITLE_WIDTH) << title
-            << setw(AUTHOR_WIDTH) << author
             << setw(YEAR_WIDTH) << item.year
             << fixed << setprecision(1) //один знак после запятой
             << setw(RATING_WIDTH) << item.rating;
@@ -341,96 +875,397 @@ void printCatalog(const vector<Media>& catalog) {
     cout << string(80, '=') << "\n";
 }
 
+//собираем статистику
+CatalogStats computeStatistics(MediaSpan catalog) {
+    OpTimer timer(Op::Stats);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("computeStatistics");
+    CatalogStats stats;
+    stats.total = catalog.size();
+    if (catalog.empty()) return stats;
+
+    //частичная статистика куска строк
+    struct Partial {
+        double sumRating = 0;
+        int minYear = 9999, maxYear = 0;
+        unordered_map<string, int> tagCount;
+    };
+
+    Partial total = parallelReduce(catalog.size(), 4096, Partial(),
+        [&](size_t begin, size_t end) {
+            Partial p;
+            for (size_t i = begin; i < end; i++) {
+                const Media& item = catalog[i];
+                p.sumRating += item.rating;
+
+                if (item.year < p.minYear) p.minYear = item.year;
+                if (item.year > p.maxYear) p.maxYear = item.year;
+
+                for (const string& tag : item.tags) {
+                    p.tagCount[tag]++;
+                }
+            }
+            return p;
+        },
+        [](Partial a, Partial b) {
+            a.sumRating += b.sumRating;
+            a.minYear = min(a.minYear, b.minYear);
+            a.maxYear = max(a.maxYear, b.maxYear);
+            for (const auto& pair : b.tagCount) a.tagCount[pair.first] += pair.second;
+            return a;
+        });
+
+    stats.minYear = total.minYear;
+    stats.maxYear = total.maxYear;
+    stats.avgRating = total.sumRating / stats.total;
+    unordered_map<string, int>& tagCount = total.tagCount;
+
+    //находим самые популярные теги
+    stats.tagCounts.assign(tagCount.begin(), tagCount.end());
+    sort(stats.tagCounts.begin(), stats.tagCounts.end(),
+        [](const auto& a, const auto& b) {
+            if (a.second != b.second) return a.second > b.second; //сортируем по убыванию частоты
+            return a.first < b.first;
+        });
+    return stats;
+}
+
 //вывод статистики
-void printStatistics(const vector<Media>& catalog) {
+void printStatistics(MediaSpan catalog) {
     if (catalog.empty()) {
         cout << "Нет данных для статистики\n";
         return;
     }
 
-    //собираем статистику
-    int total = catalog.size();
-    double sumRating = 0;
-    int minYear = 9999, maxYear = 0;
-    unordered_map<string, int> tagCount;
-
-    for (const Media& item : catalog) {
-        sumRating += item.rating;
-
-        if (item.year < minYear) minYear = item.year;
-        if (item.year > maxYear) maxYear = item.year;
-
-        for (const string& tag : item.tags) {
-            tagCount[tag]++;
-        }
-    }
-
-    double avgRating = sumRating / total;
-
-    //находим самые популярные теги
-    vector<pair<string, int>> tagVector(tagCount.begin(), tagCount.end());
-    sort(tagVector.begin(), tagVector.end(),
-        [](const auto& a, const auto& b) {
-            return a.second > b.second; //сортируем по убыванию частоты
-        });
+    printStatistics(computeStatistics(catalog));
+}
 
+void printStatistics(const CatalogStats& stats) {
     //выводим статистику
     cout << "\n=== СТАТИСТИКА КАТАЛОГА ===\n";
-    cout << "Всего записей: " << total << "\n";
-    cout << "Средний рейтинг: " << fixed << setprecision(2) << avgRating << "\n";
-    cout << "Диапазон годов: " << minYear << " - " << maxYear << "\n";
+    cout << "Всего записей: " << stats.total << "\n";
+    cout << "Средний рейтинг: " << fixed << setprecision(2) << stats.avgRating << "\n";
+    cout << "Диапазон годов: " << stats.minYear << " - " << stats.maxYear << "\n";
 
     //топ-5 тегов
     cout << "\nСамые популярные теги:\n";
-    int limit = min(5, (int)tagVector.size());
+    int limit = min(5, (int)stats.tagCounts.size());
     for (int i = 0; i < limit; i++) {
-        cout << "  " << i + 1 << ". " << setw(15) << left << tagVector[i].first
-            << " - " << tagVector[i].second << " раз\n";
+        cout << "  " << i + 1 << ". " << setw(15) << left << stats.tagCounts[i].first
+            << " - " << stats.tagCounts[i].second << " раз\n";
     }
 }
 
 /*------Сохранение в файл------*/
 
-//сохранение каталога в файл
-void saveToFile(const vector<Media>& catalog, const string& filename) {
-    ofstream file(filename);
+//сколько записей форматирует один поток за раз
+const size_t SAVE_CHUNK = 16384;
+
+//true, если в строке есть символы, которые в JSON надо экранировать (кавычка, слэш, управляющие)
+//проверяем по 16 байт за раз: обычные названия проходят без посимвольного разбора
+bool needsJsonEscape(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, slash));
+        //x <= 0x1F без знака  <=>  max(x, 0x1F) == 0x1F
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl));
+        if (_mm_movemask_epi8(hit) != 0) return true;
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned char c = p[i];
+        if (c == '"' || c == '\\' || c < 0x20) return true;
+    }
+    return false;
+}
 
-    if (!file.is_open()) {
-        cout << "Ошибка: не могу создать файл " << filename << "\n";
+//дописывает строку в кавычках с экранированием по правилам JSON
+void appendJsonString(string& out, const string& s) {
+    out += '"';
+    if (!needsJsonEscape(s.data(), s.size())) { //быстрый путь - копируем целиком
+        out += s;
+        out += '"';
         return;
     }
+    for (char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        case '\r': out += "\\r"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            if ((unsigned char)c < 0x20) { //прочие управляющие символы - \u00XX
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(unsigned char)c);
+                out += buf;
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
 
-    file << "[\n";
+//форматирует одну запись в том же виде, в каком ее читает loadFromFile (одно поле на строку)
+void appendJsonRecord(string& out, const Media& item) {
+    char num[32];
+    out += "  {\n    \"id\": ";
+    appendJsonString(out, item.id);
+    out += ",\n    \"title\": ";
+    appendJsonString(out, item.title);
+    out += ",\n    \"author\": ";
+    appendJsonString(out, item.author);
+    out += ",\n    \"year\": ";
+    out += to_string(item.year);
+    snprintf(num, sizeof(num), "%.1f", item.rating);
+    out += ",\n    \"rating\": ";
+    out += num;
+    out += ",\n    \"tags\": [";
+    for (size_t j = 0; j < item.tags.size(); j++) {
+        appendJsonString(out, item.tags[j]);
+        if (j < item.tags.size() - 1) out += ", ";
+    }
+    out += "]\n  }";
+}
+
+//формат по расширению имени файла
+CatalogFormat formatForFile(const string& filename) {
+    auto endsWith = [&](const string& ext) {
+        return filename.size() >= ext.size() &&
+            filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    if (endsWith(".jsonl")) return CatalogFormat::JsonLines;
+    if (endsWith(".bin")) return CatalogFormat::Snapshot;
+    return CatalogFormat::Json;
+}
+
+//заголовок бинарного снимка
+void appendSnapshotHeader(string& out, uint64_t count) {
+    out.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    out.append((const char*)&count, sizeof(count));
+}
+
+void appendSnapshotString(string& out, const string& s) {
+    uint32_t len = (uint32_t)s.size();
+    out.append((const char*)&len, sizeof(len));
+    out += s;
+}
 
-    for (size_t i = 0; i < catalog.size(); i++) {
-        const Media& item = catalog[i];
+//одна запись бинарного снимка
+void appendSnapshotRecord(string& out, const Media& item) {
+    appendSnapshotString(out, item.id);
+    appendSnapshotString(out, item.title);
+    appendSnapshotString(out, item.author);
+    int32_t year = item.year;
+    out.append((const char*)&year, sizeof(year));
+    out.append((const char*)&item.rating, sizeof(item.rating));
+    uint16_t tagCount = (uint16_t)item.tags.size();
+    out.append((const char*)&tagCount, sizeof(tagCount));
+    for (uint16_t t = 0; t < tagCount; t++) {
+        appendSnapshotString(out, item.tags[t]);
+    }
+}
 
-        file << "  {\n";
-        file << "    \"id\": \"" << item.id << "\",\n";
-        file << "    \"title\": \"" << item.title << "\",\n";
-        file << "    \"author\": \"" << item.author << "\",\n";
-        file << "    \"year\": " << item.year << ",\n";
-        file << "    \"rating\": " << fixed << setprecision(1) << item.rating << ",\n";
-        file << "    \"tags\": [";
+//форматирует записи [begin, end) в буфер (в JSON - с запятыми между записями)
+string formatChunk(MediaSpan catalog, size_t begin, size_t end, CatalogFormat format) {
+    TRACE_SCOPE("save/format");
+    string out;
+    out.reserve((end - begin) * 160);
+    for (size_t i = begin; i < end; i++) {
+        if (format == CatalogFormat::JsonLines) {
+            appendJsonLine(out, catalog[i]);
+        }
+        else if (format == CatalogFormat::Snapshot) {
+            appendSnapshotRecord(out, catalog[i]);
+        }
+        else {
+            appendJsonRecord(out, catalog[i]);
+            if (i < catalog.size() - 1) out += ",";
+            out += "\n";
+        }
+    }
+    return out;
+}
 
-        //сохраняем теги
-        for (size_t j = 0; j < item.tags.size(); j++) {
-            file << "\"" << item.tags[j] << "\"";
-            if (j < item.tags.size() - 1) file << ", ";
+//пишет буфер целиком (write может записать меньше запрошенного)
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
 
-        file << "]\n";
-        file << "  }";
+//сбрасывает на диск запись о файлах в каталоге (нужно после rename/unlink)
+bool syncParentDir(const string& filename) {
+    size_t slash = filename.find_last_of('/');
+    string dir = (slash == string::npos) ? "." : filename.substr(0, slash + 1);
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd < 0) return false;
+    bool ok = ::fsync(dirFd) == 0;
+    ::close(dirFd);
+    return ok;
+}
 
-        if (i < catalog.size() - 1) file << ",";
-        file << "\n";
+//сохранение каталога в файл
+//формат выбирается по расширению (formatForFile).
+//Записи форматируются кусками по SAVE_CHUNK в потоках общего пула (thread_pool.h),
+//готовые куски пишутся по порядку через один файловый дескриптор.
+//Пишем во временный файл, делаем fsync и атомарно переименовываем поверх старого:
+//при сбое на диске остается либо старый каталог, либо новый целиком.
+bool saveToFile(MediaSpan catalog, const string& filename) {
+    OpTimer timer(Op::Save);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("saveToFile");
+    string tmpName = filename + ".tmp";
+    int fd = ::open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        logOut() << "Ошибка: не могу создать файл " << tmpName << "\n";
+        return false;
     }
 
-    file << "]\n";
-    file.close();
+    CatalogFormat format = formatForFile(filename);
+    string header;
+    if (format == CatalogFormat::Json) header = "[\n";
+    if (format == CatalogFormat::Snapshot) appendSnapshotHeader(header, catalog.size());
+    bool ok = writeAll(fd, header.data(), header.size());
+
+    if (catalog.size() <= SAVE_CHUNK) { //маленький каталог - без потоков
+        string out = formatChunk(catalog, 0, catalog.size(), format);
+        ok = ok && writeAll(fd, out.data(), out.size());
+    }
+    else {
+        //окно из нескольких кусков в работе: пока пишем один, остальные форматируются в пуле
+        size_t window = (size_t)threadPool().size() * 2 + 2;
+        deque<future<string>> pending;
+        size_t next = 0;
+        while (ok && (next < catalog.size() || !pending.empty())) {
+            while (next < catalog.size() && pending.size() < window) {
+                size_t end = min(next + SAVE_CHUNK, catalog.size());
+                pending.push_back(threadPool().async([&catalog, next, end, format] {
+                    return formatChunk(catalog, next, end, format);
+                }));
+                next = end;
+            }
+            string out;
+            {
+                TRACE_SCOPE("save/wait"); //ожидание форматирования куска
+                out = pending.front().get();
+            }
+            pending.pop_front();
+            TRACE_SCOPE("save/write");
+            ok = writeAll(fd, out.data(), out.size());
+        }
+        for (auto& f : pending) f.wait(); //при ошибке записи дожидаемся потоков
+    }
+
+    if (format == CatalogFormat::Json) ok = ok && writeAll(fd, "]\n", 2);
+    {
+        TRACE_SCOPE("save/fsync");
+        ok = ok && ::fsync(fd) == 0; //данные на диске до переименования
+    }
+    if (::close(fd) != 0) ok = false;
+    ok = ok && ::rename(tmpName.c_str(), filename.c_str()) == 0;
+
+    if (!ok) {
+        logOut() << "Ошибка: не удалось записать файл " << filename << "\n";
+        ::unlink(tmpName.c_str());
+        return false;
+    }
+
+    //полный снимок уже содержит все записи из дельты
+    ::unlink(deltaFileName(filename).c_str());
+    if (!syncParentDir(filename)) {
+        logOut() << "Предупреждение: не удалось сбросить на диск каталог файла " << filename << "\n";
+    }
+
+    logOut() << "Сохранено " << catalog.size() << " записей в файл " << filename << "\n";
+    return true;
+}
 
-    cout << "Сохранено " << catalog.size() << " записей в файл " << filename << "\n";
+//форматирует запись в одну строку для файла дельты
+void appendJsonLine(string& out, const Media& item) {
+    appendJsonObject(out, item);
+    out += "\n";
+}
+
+//запись одним JSON-объектом без перевода строки (для ответов сервера)
+void appendJsonObject(string& out, const Media& item) {
+    char num[32];
+    out += "{\"id\": ";
+    appendJsonString(out, item.id);
+    out += ", \"title\": ";
+    appendJsonString(out, item.title);
+    out += ", \"author\": ";
+    appendJsonString(out, item.author);
+    out += ", \"year\": ";
+    out += to_string(item.year);
+    snprintf(num, sizeof(num), "%.1f", item.rating);
+    out += ", \"rating\": ";
+    out += num;
+    out += ", \"tags\": [";
+    for (size_t j = 0; j < item.tags.size(); j++) {
+        appendJsonString(out, item.tags[j]);
+        if (j < item.tags.size() - 1) out += ", ";
+    }
+    out += "]}";
 }
+
+//дописывает в файл дельты записи, добавленные после последнего сохранения (с savedCount до конца).
+//Записи в каталоге только добавляются, поэтому изменения с прошлого сохранения - это его хвост.
+//Дописываем и делаем fsync; оборванная при сбое последняя строка при загрузке пропускается.
+//Новая дельта начинается строкой с числом записей основного файла (DELTA_BASE_PREFIX).
+bool saveDelta(MediaSpan catalog, const string& filename, size_t& savedCount) {
+    OpTimer timer(Op::SaveDelta);
+    TRACE_SCOPE("saveDelta");
+    if (savedCount >= catalog.size()) {
+        logOut() << "Нет изменений с последнего сохранения\n";
+        return true;
+    }
+
+    timer.setRecords(catalog.size() - savedCount);
+    string out;
+    string deltaName = deltaFileName(filename);
+    int fd = ::open(deltaName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        logOut() << "Ошибка: не могу открыть файл " << deltaName << "\n";
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size == 0) { //новая дельта: до нее в файле savedCount записей
+        out += DELTA_BASE_PREFIX + to_string(savedCount) + "}\n";
+    }
+    for (size_t i = savedCount; i < catalog.size(); i++) {
+        appendJsonLine(out, catalog[i]);
+    }
+    bool ok = writeAll(fd, out.data(), out.size()) && ::fsync(fd) == 0;
+    if (::close(fd) != 0) ok = false;
+    if (!ok) {
+        logOut() << "Ошибка: не удалось записать файл " << deltaName << "\n";
+        return false;
+    }
+    syncParentDir(deltaName); //файл дельты мог быть только что создан
+
+    logOut() << "В дельту " << deltaName << " записано " << catalog.size() - savedCount << " записей\n";
+    savedCount = catalog.size();
+    return true;
+}
+
 /*------Создание тестовых данных------*/
 
 //функция для создания тестового каталога (если файла нет)
@@ -468,184 +1303,3 @@ vector<Media> createTestCatalog() {
 
     return testCatalog;
 }
-
-/*------Main------*/
-
-int main() {
-    system("chcp 1251 > nul"); //включаем русские буквы в консоли
-    cout << "=========================================\n";
-    cout << "     КАТАЛОГ МЕДИА \n";
-    cout << "=========================================\n\n";
-
-    vector<Media> catalog; //создаем пустой каталог
-
-    //пытаемся загрузить данные из файла
-    string filename = "media_catalog.txt";
-    catalog = loadFromFile(filename);
-
-    //если файл не найден - создаем тестовые данные
-    if (catalog.empty()) {
-        cout << "Файл не найден. Создаю тестовый каталог...\n";
-        catalog = createTestCatalog();
-        saveToFile(catalog, filename);//сохраняем тестовые данные
-    }
-
-    //основной цикл программы
-    bool running = true;
-    while (running) {
-        cout << "\n=== ГЛАВНОЕ МЕНЮ ===\n";
-        cout << "1 - Показать весь каталог\n";
-        cout << "2 - Поиск по названию/автору\n";
-        cout << "3 - Фильтр по тегу\n";
-        cout << "4 - Топ-N по рейтингу\n";
-        cout << "5 - Найти дубликаты\n";
-        cout << "6 - Показать статистику\n";
-        cout << "7 - Сохранить каталог\n";
-        cout << "8 - Добавить новую запись\n";
-        cout << "0 - Выход\n";
-        cout << "Выберите действие: ";
-
-        int choice;
-        cin >> choice;
-        cin.ignore(); //очищаем буфер после ввода числа
-
-        switch (choice) {
-        case 0: {//выход из программы
-            running = false;
-            cout << "До свидания!\n";
-            break;
-        }
-
-        case 1: {//показать весь каталог
-            printCatalog(catalog);
-            break;
-        }
-
-        case 2: {//поиск по подстроке
-            cout << "Введите текст для поиска: ";
-            string searchText;
-            getline(cin, searchText);
-
-            if (!searchText.empty()) {
-                vector<Media> results = findBySubstring(catalog, searchText);
-                printCatalog(results);
-            }
-            break;
-        }
-
-        case 3: {//фильтр по тегу
-            cout << "Доступные теги: роман, классика, фантастика, история, "
-                << "антиутопия, мистика, психология, приключения, фэнтези\n";
-            cout << "Введите тег для фильтрации: ";
-            string tag;
-            getline(cin, tag);
-
-            if (!tag.empty()) {
-                std::vector<Media> results = findByTag(catalog, tag);
-                printCatalog(results);
-            }
-            break;
-        }
-
-        case 4: {//топ-N по рейтингу
-            cout << "Сколько записей показать? ";
-            int n;
-            cin >> n;
-
-            if (n > 0) {
-                vector<Media> top = getTopN(catalog, n);
-                printCatalog(top);
-            }
-            break;
-        }
-
-        case 5: {//поиск дубликатов
-            findDuplicates(catalog);
-            break;
-        }
-
-        case 6: {//статистика
-            printStatistics(catalog);
-            break;
-        }
-
-        case 7: {//сохранение каталога
-            cout << "Введите имя файла для сохранения (по умолчанию: "
-                << filename << "): ";
-            string saveFile;
-            getline(cin, saveFile);
-
-            if (saveFile.empty()) {
-                saveFile = filename;
-            }
-
-            saveToFile(catalog, saveFile);
-            break;
-        }
-
-        case 8: {//добавление новой записи
-            cout << "=== ДОБАВЛЕНИЕ НОВОЙ ЗАПИСИ ===\n";
-
-            Media newMedia;
-            newMedia.id = to_string(catalog.size() + 1);
-
-            cout << "Название: ";
-            getline(std::cin, newMedia.title);
-
-            cout << "Автор/режиссер: ";
-            getline(std::cin, newMedia.author);
-
-            cout << "Год: ";
-            cin >> newMedia.year;
-
-            cout << "Рейтинг (0.0-10.0): ";
-            cin >> newMedia.rating;
-            cin.ignore();
-
-            cout << "Теги (через запятую): ";
-            string tagsInput;
-            getline(cin, tagsInput);
-
-            //разбиваем теги по запятым
-            string tag;
-            for (char c : tagsInput) {
-                if (c == ',') {
-                    if (!tag.empty()) {
-                        newMedia.tags.push_back(tag);
-                        tag.clear();clear();    return 0;();
-                    }
-                }
-                else if (c != ' ') {else if (c != ' ') {
-                    day += C;
-                }
-            }
-            if (!day.empty()) {if (!day.empty()) {
-                newMedia.tags.push_back(day); tags.push_back(day);
-            }
-
-            Checking and addingChecking and adding
-            if (isValid(newMedia)) {if (isValid(newMedia)) {
-                catalog.push_back(newMedia);push_back(newMedia);
-                cost << "Record added!\n";"Entry added!\n";
-            }
-            else {else {
-                cost << "Error: record not added due to invalid data\n";"Error: Record not added due to incorrect data\n";
-            }
-            break;break;
-        }
-
-        default: {default: {
-            cost << "Wrong choice. Try again.\n";"Wrong choice. Try again.\n";
-            break;break;
-        }
-        }
-
-        Pause before the next actionPause before the next action
-        if (running && choice != 0) {if (running && choice != 0) {
-            cost << "\nPress Enter to continue...";"\nPress Enter to continue...";
-            cin.get();get();
-        }
-    }
-
-    return 0;return 0;
-                                   }
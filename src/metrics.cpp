@@ -0,0 +1,309 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+const char* opName(Op op) {
+    switch (op) {
+    case Op::Load: return "load";
+    case Op::Save: return "save";
+    case Op::SaveDelta: return "save_delta";
+    case Op::SearchSubstring: return "search_substring";
+    case Op::SearchTag: return "search_tag";
+    case Op::TopN: return "top_n";
+    case Op::Duplicates: return "duplicates";
+    case Op::Stats: return "stats";
+    case Op::Insert: return "insert";
+    case Op::BatchScan: return "batch_scan";
+    case Op::CatalogQuery: return "query";
+    case Op::YearIndex: return "year_index";
+    case Op::Suggest: return "suggest";
+    case Op::Fuzzy: return "fuzzy";
+    case Op::TextSearch: return "text";
+    default: return "unknown";
+    }
+}
+
+/*------Гистограмма------*/
+//значения меньше SUB_COUNT лежат в своих корзинах как есть; дальше каждая степень двойки
+//делится на SUB_COUNT равных частей
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < (uint64_t)SUB_COUNT) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + (int)((value >> shift) - SUB_COUNT);
+}
+
+uint64_t LatencyHistogram::bucketValue(int index) {
+    if (index < SUB_COUNT) return (uint64_t)index;
+    int shift = index / SUB_COUNT - 1;
+    uint64_t low = (uint64_t)(index % SUB_COUNT + SUB_COUNT) << shift;
+    return low + ((uint64_t)1 << shift) / 2;
+}
+
+//писатель один (поток-владелец), поэтому достаточно load + store без атомарного сложения
+void LatencyHistogram::record(uint64_t value) {
+    atomic<uint64_t>& bucket = counts[bucketIndex(value)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    total.store(total.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    sum.store(sum.load(memory_order_relaxed) + value, memory_order_relaxed);
+    if (value > max.load(memory_order_relaxed)) max.store(value, memory_order_relaxed);
+}
+
+/*------Копии по потокам------*/
+struct MetricsShard {
+    LatencyHistogram histograms[(int)Op::Count];
+    PerfTotals perf[(int)Op::Count];
+    CacheCounters cache;
+};
+
+//реестр копий: блокировка только при регистрации нового потока и при выводе
+mutex shardsMutex;
+vector<unique_ptr<MetricsShard>> shards; //копии не удаляются: данные завершившихся потоков сохраняются
+const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+MetricsShard& localShard() {
+    thread_local MetricsShard* shard = nullptr;
+    if (!shard) {
+        lock_guard<mutex> lock(shardsMutex);
+        shards.push_back(make_unique<MetricsShard>());
+        shard = shards.back().get();
+    }
+    return *shard;
+}
+
+void recordLatency(Op op, uint64_t nanoseconds) {
+    localShard().histograms[(int)op].record(nanoseconds);
+}
+
+void recordPerf(Op op, const PerfSample& delta, size_t records) {
+    PerfTotals& totals = localShard().perf[(int)op];
+    totals.samples.store(totals.samples.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    totals.records.store(totals.records.load(memory_order_relaxed) + records, memory_order_relaxed);
+    for (int i = 0; i < (int)PerfCounter::Count; i++) {
+        if (delta.values[i] < 0) continue; //счетчик не открылся
+        atomic<uint64_t>& value = totals.values[i];
+        value.store(value.load(memory_order_relaxed) + (uint64_t)delta.values[i], memory_order_relaxed);
+    }
+}
+
+void addRelaxed(atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void recordCacheLookup(bool hit) {
+    CacheCounters& cache = localShard().cache;
+    addRelaxed(hit ? cache.hits : cache.misses, 1);
+}
+
+void recordCacheInvalidations(size_t count) {
+    if (count > 0) addRelaxed(localShard().cache.invalidations, count);
+}
+
+CacheSummary summarizeCache() {
+    CacheSummary s;
+    lock_guard<mutex> lock(shardsMutex);
+    for (const auto& shard : shards) {
+        s.hits += shard->cache.hits.load(memory_order_relaxed);
+        s.misses += shard->cache.misses.load(memory_order_relaxed);
+        s.invalidations += shard->cache.invalidations.load(memory_order_relaxed);
+    }
+    uint64_t lookups = s.hits + s.misses;
+    s.hitRatio = lookups > 0 ? (double)s.hits / lookups : 0;
+    return s;
+}
+
+PerfSummary summarizePerf(Op op) {
+    PerfSummary s;
+    lock_guard<mutex> lock(shardsMutex);
+    for (const auto& shard : shards) {
+        const PerfTotals& totals = shard->perf[(int)op];
+        s.samples += totals.samples.load(memory_order_relaxed);
+        s.records += totals.records.load(memory_order_relaxed);
+        for (int i = 0; i < (int)PerfCounter::Count; i++) {
+            s.values[i] += totals.values[i].load(memory_order_relaxed);
+        }
+    }
+    PerfSample probe = readPerfCounters(); //какие счетчики открылись в этом процессе
+    for (int i = 0; i < (int)PerfCounter::Count; i++) s.available[i] = probe.values[i] >= 0;
+    return s;
+}
+
+OpSummary summarize(Op op) {
+    vector<uint64_t> counts(LatencyHistogram::BUCKETS, 0);
+    OpSummary s;
+    uint64_t sum = 0, maxValue = 0;
+    {
+        lock_guard<mutex> lock(shardsMutex);
+        for (const auto& shard : shards) {
+            const LatencyHistogram& h = shard->histograms[(int)op];
+            for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+                counts[i] += h.counts[i].load(memory_order_relaxed);
+            }
+            s.count += h.total.load(memory_order_relaxed);
+            sum += h.sum.load(memory_order_relaxed);
+            maxValue = std::max(maxValue, h.max.load(memory_order_relaxed));
+        }
+    }
+    s.sumSeconds = sum / 1e9;
+    s.max = maxValue / 1e9;
+    double uptime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    s.throughput = uptime > 0 ? s.count / uptime : 0;
+    if (s.count == 0) return s;
+
+    //перцентили: первая корзина, где накопленное число достигает нужного ранга
+    uint64_t total = 0;
+    for (uint64_t c : counts) total += c; //счетчики разных полей читаются не одновременно
+    double* targets[] = { &s.p50, &s.p90, &s.p99 };
+    double ranks[] = { 0.50, 0.90, 0.99 };
+    uint64_t seen = 0;
+    int next = 0;
+    for (int i = 0; i < LatencyHistogram::BUCKETS && next < 3; i++) {
+        seen += counts[i];
+        while (next < 3 && seen >= (uint64_t)(ranks[next] * total + 0.5) && seen > 0) {
+            *targets[next] = std::min(LatencyHistogram::bucketValue(i), maxValue) / 1e9;
+            next++;
+        }
+    }
+    return s;
+}
+
+/*------Вывод------*/
+void printMetrics(ostream& out) {
+    out << "\n=== МЕТРИКИ ОПЕРАЦИЙ ===\n";
+    //заголовок выровнен вручную: setw считает байты, а не буквы кириллицы
+    out << "операция              кол-во     p50, мс     p90, мс     p99, мс     max, мс        оп/с\n";
+    for (int i = 0; i < (int)Op::Count; i++) {
+        OpSummary s = summarize((Op)i);
+        if (s.count == 0) continue;
+        out << left << setw(18) << opName((Op)i) << right << setw(10) << s.count
+            << fixed << setprecision(3)
+            << setw(12) << s.p50 * 1e3 << setw(12) << s.p90 * 1e3 << setw(12) << s.p99 * 1e3
+            << setw(12) << s.max * 1e3 << setw(12) << setprecision(1) << s.throughput << "\n";
+    }
+    CacheSummary cache = summarizeCache();
+    if (cache.hits + cache.misses > 0) {
+        out << "\nКэш запросов: попаданий " << cache.hits << ", промахов " << cache.misses
+            << " (" << fixed << setprecision(1) << cache.hitRatio * 100 << "% попаданий), удалено при вставках "
+            << cache.invalidations << "\n";
+    }
+    if (perfCountersEnabled()) printPerfCounters(out);
+}
+
+//на запись: такты, инструкции, промахи LLC и переходов; IPC - инструкций за такт
+void printPerfCounters(ostream& out) {
+    out << "\n=== АППАРАТНЫЕ СЧЕТЧИКИ (на запись) ===\n";
+    out << "операция              записей       такты  инструкции       IPC    LLC-пром.  перех-пром.\n";
+    for (int i = 0; i < (int)Op::Count; i++) {
+        PerfSummary s = summarizePerf((Op)i);
+        if (s.samples == 0) continue;
+        double records = (double)max<uint64_t>(s.records, 1);
+        out << left << setw(18) << opName((Op)i) << right << setw(12) << s.records << fixed;
+        for (int c = 0; c < (int)PerfCounter::Count; c++) {
+            if (c == (int)PerfCounter::CacheMisses) { //IPC перед промахами
+                double cycles = (double)s.values[(int)PerfCounter::Cycles];
+                if (s.available[(int)PerfCounter::Instructions] && cycles > 0) {
+                    out << setw(10) << setprecision(2) << s.values[(int)PerfCounter::Instructions] / cycles;
+                }
+                else {
+                    out << setw(10) << "-";
+                }
+            }
+            int width = c < (int)PerfCounter::CacheMisses ? 12 : 13;
+            if (s.available[c]) out << setw(width) << setprecision(3) << s.values[c] / records;
+            else out << setw(width) << "-";
+        }
+        out << "\n";
+    }
+}
+
+string formatPrometheus() {
+    string out;
+    char line[256];
+    out += "# HELP lr_op_latency_seconds Latency of catalog operations.\n";
+    out += "# TYPE lr_op_latency_seconds summary\n";
+    vector<OpSummary> summaries;
+    for (int i = 0; i < (int)Op::Count; i++) summaries.push_back(summarize((Op)i));
+    for (int i = 0; i < (int)Op::Count; i++) {
+        const OpSummary& s = summaries[i];
+        const char* name = opName((Op)i);
+        snprintf(line, sizeof(line), "lr_op_latency_seconds{op=\"%s\",quantile=\"0.5\"} %.9f\n", name, s.p50);
+        out += line;
+        snprintf(line, sizeof(line), "lr_op_latency_seconds{op=\"%s\",quantile=\"0.9\"} %.9f\n", name, s.p90);
+        out += line;
+        snprintf(line, sizeof(line), "lr_op_latency_seconds{op=\"%s\",quantile=\"0.99\"} %.9f\n", name, s.p99);
+        out += line;
+        snprintf(line, sizeof(line), "lr_op_latency_seconds_sum{op=\"%s\"} %.9f\n", name, s.sumSeconds);
+        out += line;
+        snprintf(line, sizeof(line), "lr_op_latency_seconds_count{op=\"%s\"} %llu\n", name,
+            (unsigned long long)s.count);
+        out += line;
+    }
+    out += "# HELP lr_op_latency_max_seconds Longest observed operation.\n";
+    out += "# TYPE lr_op_latency_max_seconds gauge\n";
+    for (int i = 0; i < (int)Op::Count; i++) {
+        snprintf(line, sizeof(line), "lr_op_latency_max_seconds{op=\"%s\"} %.9f\n", opName((Op)i), summaries[i].max);
+        out += line;
+    }
+    out += "# HELP lr_op_throughput Operations per second since start.\n";
+    out += "# TYPE lr_op_throughput gauge\n";
+    for (int i = 0; i < (int)Op::Count; i++) {
+        snprintf(line, sizeof(line), "lr_op_throughput{op=\"%s\"} %.3f\n", opName((Op)i), summaries[i].throughput);
+        out += line;
+    }
+    CacheSummary cache = summarizeCache();
+    out += "# HELP lr_query_cache_lookups_total Query result cache lookups.\n";
+    out += "# TYPE lr_query_cache_lookups_total counter\n";
+    snprintf(line, sizeof(line), "lr_query_cache_lookups_total{result=\"hit\"} %llu\n", (unsigned long long)cache.hits);
+    out += line;
+    snprintf(line, sizeof(line), "lr_query_cache_lookups_total{result=\"miss\"} %llu\n", (unsigned long long)cache.misses);
+    out += line;
+    out += "# HELP lr_query_cache_hit_ratio Share of cache lookups that were hits.\n";
+    out += "# TYPE lr_query_cache_hit_ratio gauge\n";
+    snprintf(line, sizeof(line), "lr_query_cache_hit_ratio %.6f\n", cache.hitRatio);
+    out += line;
+    out += "# HELP lr_query_cache_invalidations_total Cache entries dropped by inserts and clears.\n";
+    out += "# TYPE lr_query_cache_invalidations_total counter\n";
+    snprintf(line, sizeof(line), "lr_query_cache_invalidations_total %llu\n", (unsigned long long)cache.invalidations);
+    out += line;
+    if (!perfCountersEnabled()) return out;
+
+    vector<PerfSummary> perf;
+    for (int i = 0; i < (int)Op::Count; i++) perf.push_back(summarizePerf((Op)i));
+    out += "# HELP lr_op_records_total Records processed by profiled operations.\n";
+    out += "# TYPE lr_op_records_total counter\n";
+    for (int i = 0; i < (int)Op::Count; i++) {
+        snprintf(line, sizeof(line), "lr_op_records_total{op=\"%s\"} %llu\n", opName((Op)i),
+            (unsigned long long)perf[i].records);
+        out += line;
+    }
+    out += "# HELP lr_op_cpu_events_total Hardware counter totals of profiled operations.\n";
+    out += "# TYPE lr_op_cpu_events_total counter\n";
+    for (int i = 0; i < (int)Op::Count; i++) {
+        for (int c = 0; c < (int)PerfCounter::Count; c++) {
+            if (!perf[i].available[c]) continue;
+            snprintf(line, sizeof(line), "lr_op_cpu_events_total{op=\"%s\",event=\"%s\"} %llu\n",
+                opName((Op)i), perfCounterName((PerfCounter)c), (unsigned long long)perf[i].values[c]);
+            out += line;
+        }
+    }
+    return out;
+}
+
+//пишем во временный файл и переименовываем, чтобы сборщик не прочитал файл наполовину
+bool writePrometheusFile(const string& filename) {
+    string tmpName = filename + ".tmp";
+    {
+        ofstream file(tmpName);
+        if (!file.is_open()) return false;
+        file << formatPrometheus();
+        if (!file) return false;
+    }
+    return rename(tmpName.c_str(), filename.c_str()) == 0;
+}
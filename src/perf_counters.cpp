@@ -0,0 +1,187 @@
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+const char* perfCounterName(PerfCounter counter) {
+    switch (counter) {
+    case PerfCounter::Cycles: return "cycles";
+    case PerfCounter::Instructions: return "instructions";
+    case PerfCounter::CacheMisses: return "llc_misses";
+    case PerfCounter::BranchMisses: return "branch_misses";
+    default: return "unknown";
+    }
+}
+
+atomic<bool> perfEnabled{ false };
+
+bool perfCountersEnabled() {
+    return perfEnabled.load(memory_order_relaxed);
+}
+
+#ifdef __linux__
+
+struct PerfGroup;
+
+//открытые группы всех потоков - для readProcessPerfCounters
+mutex groupsLock;
+vector<PerfGroup*> groups;
+
+//группа счетчиков одного потока; fds[0] - лидер группы (такты)
+struct PerfGroup {
+    bool opened = false;
+    int fds[(int)PerfCounter::Count] = { -1, -1, -1, -1 };
+    int slot[(int)PerfCounter::Count] = { -1, -1, -1, -1 }; //место значения в ответе read
+    int members = 0;
+    int error = 0; //errno открытия лидера
+
+    ~PerfGroup() {
+        if (fds[0] >= 0) {
+            lock_guard<mutex> lock(groupsLock);
+            groups.erase(remove(groups.begin(), groups.end(), this), groups.end());
+        }
+        for (int fd : fds) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+};
+
+int openCounter(uint32_t type, uint64_t config, int groupFd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = groupFd < 0 ? 1 : 0; //группа запускается включением лидера
+    attr.exclude_kernel = 1; //при perf_event_paranoid = 2 разрешен только пользовательский код
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+void openGroup(PerfGroup& group) {
+    group.opened = true;
+    const uint32_t types[] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+    const uint64_t configs[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+    group.fds[0] = openCounter(types[0], configs[0], -1);
+    if (group.fds[0] < 0) {
+        group.error = errno;
+        return;
+    }
+    group.slot[0] = group.members++;
+    //остальные счетчики необязательны: на части процессоров их нет
+    for (int i = 1; i < (int)PerfCounter::Count; i++) {
+        group.fds[i] = openCounter(types[i], configs[i], group.fds[0]);
+        if (group.fds[i] >= 0) group.slot[i] = group.members++;
+    }
+    ioctl(group.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    lock_guard<mutex> lock(groupsLock);
+    groups.push_back(&group);
+}
+
+PerfGroup& localGroup() {
+    thread_local PerfGroup group;
+    if (!group.opened) openGroup(group);
+    return group;
+}
+
+bool enablePerfCounters(string& error) {
+    PerfGroup& group = localGroup();
+    if (group.fds[0] < 0) {
+        error = strerror(group.error);
+        if (group.error == EACCES || group.error == EPERM) {
+            error += " (проверьте /proc/sys/kernel/perf_event_paranoid)";
+        }
+        else if (group.error == ENOENT || group.error == EOPNOTSUPP) {
+            error += " (процессор или виртуальная машина не дает аппаратных счетчиков)";
+        }
+        return false;
+    }
+    perfEnabled.store(true, memory_order_relaxed);
+    return true;
+}
+
+void attachPerfCounters() {
+    if (perfCountersEnabled()) localGroup();
+}
+
+//если ядро делило счетчики по времени с другими группами, значения масштабируются
+//на долю времени, когда группа реально считала; fd можно читать из любого потока
+PerfSample readGroup(const PerfGroup& group) {
+    PerfSample sample;
+    if (group.fds[0] < 0) return sample;
+
+    uint64_t buffer[3 + (int)PerfCounter::Count]; //nr, time_enabled, time_running, значения
+    ssize_t size = ::read(group.fds[0], buffer, sizeof(buffer));
+    if (size < (ssize_t)(3 * sizeof(uint64_t)) || buffer[0] != (uint64_t)group.members) return sample;
+
+    double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 1.0;
+    for (int i = 0; i < (int)PerfCounter::Count; i++) {
+        if (group.slot[i] >= 0) sample.values[i] = (int64_t)(buffer[3 + group.slot[i]] * scale);
+    }
+    return sample;
+}
+
+PerfSample readPerfCounters() {
+    if (!perfCountersEnabled()) return PerfSample(); //без --perf счетчики не открываются
+    return readGroup(localGroup());
+}
+
+PerfSample readProcessPerfCounters() {
+    PerfSample total;
+    if (!perfCountersEnabled()) return total;
+    localGroup();
+    lock_guard<mutex> lock(groupsLock);
+    for (const PerfGroup* group : groups) {
+        PerfSample sample = readGroup(*group);
+        for (int i = 0; i < (int)PerfCounter::Count; i++) {
+            if (sample.values[i] >= 0) total.values[i] = max<int64_t>(total.values[i], 0) + sample.values[i];
+        }
+    }
+    return total;
+}
+
+#else
+
+bool enablePerfCounters(string& error) {
+    error = "счетчики поддерживаются только в Linux";
+    return false;
+}
+
+PerfSample readPerfCounters() {
+    return PerfSample();
+}
+
+PerfSample readProcessPerfCounters() {
+    return PerfSample();
+}
+
+void attachPerfCounters() {}
+
+#endif
+
+PerfSample perfDelta(const PerfSample& start, const PerfSample& end) {
+    PerfSample delta;
+    for (int i = 0; i < (int)PerfCounter::Count; i++) {
+        if (start.values[i] >= 0 && end.values[i] >= 0) {
+            delta.values[i] = end.values[i] - start.values[i];
+        }
+    }
+    return delta;
+}
@@ -0,0 +1,577 @@
+#include "planner.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+//стоимости в условных единицах "проверка строки при полном проходе"
+const double SCAN_ROW_COST = 1.0;
+const double FETCH_ROW_COST = 2.0; //строка по номеру из списка: случайный доступ к записи
+const double POSTING_COST = 0.1;   //элемент списка строк индекса
+const double COLUMN_ROW_COST = 0.02; //значение столбца в векторном фильтре (или бит карты тега)
+//цена проверки условия на строке (для порядка фильтров)
+const double NUMBER_FILTER_COST = 1.0;
+const double TAG_FILTER_COST = 2.0;
+const double TEXT_FILTER_COST = 5.0;
+//доли строк, когда индекса нет
+const double DEFAULT_TEXT_SELECTIVITY = 0.1;
+const double DEFAULT_RANGE_SELECTIVITY = 0.5;
+
+const char* accessPathName(AccessPath path) {
+    switch (path) {
+    case AccessPath::FullScan: return "full scan";
+    case AccessPath::Trigram: return "trigram index";
+    case AccessPath::TagPostings: return "tag postings";
+    case AccessPath::YearIndex: return "year index";
+    case AccessPath::ColumnBitmap: return "column bitmap";
+    }
+    return "?";
+}
+
+//условие на год как диапазон [from, to]; false - не диапазон (!=). Границы считаются в double
+//и прижимаются к диапазону int: литерал за его пределами дает пустой диапазон или все годы
+bool yearRange(const Predicate& p, int& from, int& to) {
+    from = INT_MIN;
+    to = INT_MAX;
+    double v = p.value;
+    double lo = INT_MIN, hi = INT_MAX;
+    switch (p.op) {
+    case CompareOp::Equal:
+        if (v == floor(v)) lo = hi = v; //дробный год не совпадет ни с каким
+        else lo = 1, hi = 0;
+        break;
+    case CompareOp::Less: hi = ceil(v) - 1; break;
+    case CompareOp::LessEqual: hi = floor(v); break;
+    case CompareOp::Greater: lo = floor(v) + 1; break;
+    case CompareOp::GreaterEqual: lo = ceil(v); break;
+    default: return false;
+    }
+    if (isnan(v) || lo > hi || lo > INT_MAX || hi < INT_MIN) { //пустой диапазон
+        from = 1;
+        to = 0;
+        return true;
+    }
+    from = (int)max(lo, (double)INT_MIN);
+    to = (int)min(hi, (double)INT_MAX);
+    return true;
+}
+
+bool compareValue(double value, CompareOp op, double bound) {
+    switch (op) {
+    case CompareOp::Equal: return value == bound;
+    case CompareOp::NotEqual: return value != bound;
+    case CompareOp::Less: return value < bound;
+    case CompareOp::LessEqual: return value <= bound;
+    case CompareOp::Greater: return value > bound;
+    case CompareOp::GreaterEqual: return value >= bound;
+    default: return false;
+    }
+}
+
+/*------Оценки------*/
+double estimateSelectivity(const Predicate& p, const CatalogIndex* index) {
+    if (!index || index->rows() == 0) {
+        if (p.field == QueryField::Year || p.field == QueryField::Rating) {
+            return p.op == CompareOp::Equal ? DEFAULT_TEXT_SELECTIVITY : DEFAULT_RANGE_SELECTIVITY;
+        }
+        return DEFAULT_TEXT_SELECTIVITY;
+    }
+    double n = (double)index->rows();
+    switch (p.field) {
+    case QueryField::Tag:
+        return index->tagCount(p.text) / n;
+    case QueryField::Year: {
+        int from, to;
+        if (yearRange(p, from, to)) return index->yearCount(from, to) / n;
+        Predicate equal = p;
+        equal.op = CompareOp::Equal;
+        yearRange(equal, from, to);
+        return 1 - index->yearCount(from, to) / n;
+    }
+    case QueryField::Rating: {
+        double from = 0, to = 10;
+        double step = 0.1;
+        if (p.op == CompareOp::Equal) from = to = p.value;
+        else if (p.op == CompareOp::Less) to = p.value - step;
+        else if (p.op == CompareOp::LessEqual) to = p.value;
+        else if (p.op == CompareOp::Greater) from = p.value + step;
+        else if (p.op == CompareOp::GreaterEqual) from = p.value;
+        else return 1 - index->ratingCount(p.value, p.value) / n;
+        return index->ratingCount(from, to) / n;
+    }
+    default: {
+        //верхняя оценка по триграммам; короткая подстрока - значение по умолчанию
+        size_t estimate = SIZE_MAX;
+        if (p.field != QueryField::Author) estimate = index->trigramEstimate(p.text, true);
+        if (p.field == QueryField::Author || p.field == QueryField::Text) {
+            size_t author = index->trigramEstimate(p.text, false);
+            if (p.field == QueryField::Author) estimate = author;
+            else if (estimate != SIZE_MAX && author != SIZE_MAX) estimate += author;
+            else estimate = SIZE_MAX;
+        }
+        return estimate == SIZE_MAX ? DEFAULT_TEXT_SELECTIVITY : min(1.0, estimate / n);
+    }
+    }
+}
+
+double filterCost(const Predicate& p) {
+    if (p.field == QueryField::Year || p.field == QueryField::Rating) return NUMBER_FILTER_COST;
+    if (p.field == QueryField::Tag) return TAG_FILTER_COST;
+    return TEXT_FILTER_COST;
+}
+
+//условие на год или рейтинг как диапазон столбца [lo, hi] (negate - строки вне диапазона);
+//false - столбец не годится (значения не точны в int16) или поле другое
+bool columnBounds(const Predicate& p, const CatalogColumns& columns, int16_t& lo, int16_t& hi, bool& negate) {
+    negate = p.op == CompareOp::NotEqual;
+    int from = INT_MIN, to = INT_MAX;
+    if (p.field == QueryField::Year && columns.yearsExact) {
+        Predicate equal = p;
+        if (negate) equal.op = CompareOp::Equal;
+        yearRange(equal, from, to);
+    }
+    else if (p.field == QueryField::Rating && columns.ratingsExact) {
+        switch (p.op) {
+        case CompareOp::Equal:
+        case CompareOp::NotEqual: from = ratingAtLeast(p.value); to = ratingAtMost(p.value); break;
+        case CompareOp::Less: to = ratingAtLeast(p.value) - 1; break;
+        case CompareOp::LessEqual: to = ratingAtMost(p.value); break;
+        case CompareOp::Greater: from = ratingAtMost(p.value) + 1; break;
+        case CompareOp::GreaterEqual: from = ratingAtLeast(p.value); break;
+        default: return false;
+        }
+    }
+    else {
+        return false;
+    }
+    if (from > to || from > INT16_MAX || to < INT16_MIN) { //пустой диапазон
+        lo = 1;
+        hi = 0;
+        return true;
+    }
+    lo = (int16_t)max(from, INT16_MIN);
+    hi = (int16_t)min(to, INT16_MAX);
+    return true;
+}
+
+//векторный проход по столбцам: все условия на год и рейтинг плюс теги из списков строк
+bool columnPath(const CatalogQuery& query, const CatalogIndex& index, const QueryPlan& plan, PathCost& c) {
+    c.path = AccessPath::ColumnBitmap;
+    double fraction = 1, cost = 0;
+    size_t ranges = 0;
+    for (size_t i = 0; i < query.predicates.size(); i++) {
+        const Predicate& p = query.predicates[i];
+        int16_t lo, hi;
+        bool negate;
+        if (columnBounds(p, index.columns(), lo, hi, negate)) ranges++;
+        else if (p.field == QueryField::Tag) cost += index.tagCount(p.text) * POSTING_COST;
+        else continue;
+        c.predicates.push_back((int)i);
+        fraction *= plan.selectivity[i]; //условия считаем независимыми
+    }
+    if (ranges == 0) return false; //одни теги дешевле взять из списков строк
+    c.estimatedRows = (size_t)(plan.indexedRows * fraction);
+    c.cost = cost + plan.indexedRows * COLUMN_ROW_COST * c.predicates.size() + c.estimatedRows * FETCH_ROW_COST;
+    return true;
+}
+
+QueryPlan planQuery(const CatalogQuery& query, const CatalogIndex* index, size_t catalogRows) {
+    QueryPlan plan;
+    plan.catalogRows = catalogRows;
+    plan.indexedRows = index ? min(index->rows(), catalogRows) : 0;
+    size_t tail = catalogRows - plan.indexedRows;
+    for (const Predicate& p : query.predicates) {
+        plan.selectivity.push_back(estimateSelectivity(p, index));
+    }
+
+    PathCost scan;
+    scan.estimatedRows = catalogRows;
+    scan.cost = catalogRows * SCAN_ROW_COST;
+    plan.alternatives.push_back(scan);
+    for (size_t i = 0; index && i < query.predicates.size(); i++) {
+        const Predicate& p = query.predicates[i];
+        PathCost c;
+        c.predicates.push_back((int)i);
+        if (p.field == QueryField::Tag) {
+            c.path = AccessPath::TagPostings;
+            c.estimatedRows = index->tagCount(p.text);
+            c.cost = c.estimatedRows * (POSTING_COST + FETCH_ROW_COST);
+        }
+        else if (p.field == QueryField::Year) {
+            int from, to;
+            if (!yearRange(p, from, to)) continue;
+            c.path = AccessPath::YearIndex;
+            c.estimatedRows = index->yearCount(from, to);
+            //строки диапазона годов еще сортируются по номеру
+            c.cost = c.estimatedRows * (POSTING_COST + FETCH_ROW_COST) +
+                c.estimatedRows * log2(c.estimatedRows + 1.0) * POSTING_COST;
+        }
+        else if (p.field == QueryField::Title || p.field == QueryField::Author) {
+            bool title = p.field == QueryField::Title;
+            size_t estimate = index->trigramEstimate(p.text, title);
+            if (estimate == SIZE_MAX) continue;
+            c.path = AccessPath::Trigram;
+            c.estimatedRows = estimate;
+            c.cost = index->trigramWork(p.text, title) * POSTING_COST + estimate * FETCH_ROW_COST;
+        }
+        else {
+            continue; //text и rating по отдельности ведущими не бывают
+        }
+        c.cost += tail * SCAN_ROW_COST; //хвост без индекса проверяется целиком при любом пути
+        plan.alternatives.push_back(c);
+    }
+    PathCost columns;
+    if (index && columnPath(query, *index, plan, columns)) {
+        columns.cost += tail * SCAN_ROW_COST;
+        plan.alternatives.push_back(columns);
+    }
+    plan.driver = *min_element(plan.alternatives.begin(), plan.alternatives.end(),
+        [](const PathCost& a, const PathCost& b) { return a.cost < b.cost; });
+
+    //фильтры: все условия, кроме точно выбранных ведущим путем (триграммы дают кандидатов - их проверяем)
+    for (size_t i = 0; i < query.predicates.size(); i++) {
+        const vector<int>& used = plan.driver.predicates;
+        bool exact = plan.driver.path != AccessPath::Trigram;
+        if (exact && find(used.begin(), used.end(), (int)i) != used.end()) continue;
+        plan.filters.push_back((int)i);
+    }
+    //полный проход с ORDER BY rating и LIMIT: блоки по карте от лучшей границы рейтинга
+    plan.topByZones = index && plan.driver.path == AccessPath::FullScan && query.ordered &&
+        query.orderBy == QueryField::Rating && query.limit < plan.indexedRows;
+    //дешевле и отсекает больше - раньше
+    stable_sort(plan.filters.begin(), plan.filters.end(), [&](int a, int b) {
+        double rankA = filterCost(query.predicates[a]) / max(1e-6, 1 - plan.selectivity[a]);
+        double rankB = filterCost(query.predicates[b]) / max(1e-6, 1 - plan.selectivity[b]);
+        return rankA < rankB;
+    });
+    return plan;
+}
+
+/*------Выполнение------*/
+//оставляет в rows строки, где условие выполняется (сжатие на месте, одно условие за проход)
+void applyFilter(MediaSpan catalog, const Predicate& p, vector<uint32_t>& rows) {
+    size_t kept = 0;
+    switch (p.field) {
+    case QueryField::Year:
+        for (uint32_t row : rows) {
+            if (compareValue(catalog[row].year, p.op, p.value)) rows[kept++] = row;
+        }
+        break;
+    case QueryField::Rating:
+        for (uint32_t row : rows) {
+            if (compareValue(catalog[row].rating, p.op, p.value)) rows[kept++] = row;
+        }
+        break;
+    case QueryField::Tag:
+        for (uint32_t row : rows) {
+            const vector<string>& tags = catalog[row].tags;
+            if (find(tags.begin(), tags.end(), p.text) != tags.end()) rows[kept++] = row;
+        }
+        break;
+    case QueryField::Title: {
+        string titleLower;
+        for (uint32_t row : rows) {
+            titleLower = catalog[row].title;
+            transform(titleLower.begin(), titleLower.end(), titleLower.begin(), ::tolower);
+            if (titleLower.find(p.text) != string::npos) rows[kept++] = row;
+        }
+        break;
+    }
+    case QueryField::Author:
+        for (uint32_t row : rows) {
+            if (catalog[row].author.find(p.text) != string::npos) rows[kept++] = row;
+        }
+        break;
+    case QueryField::Text: {
+        string searchLower = p.text, titleLower;
+        transform(searchLower.begin(), searchLower.end(), searchLower.begin(), ::tolower);
+        for (uint32_t row : rows) {
+            if (matchesSubstring(catalog[row], searchLower, p.text, titleLower)) rows[kept++] = row;
+        }
+        break;
+    }
+    }
+    rows.resize(kept);
+}
+
+vector<uint32_t> concatRows32(vector<uint32_t> a, vector<uint32_t> b) {
+    if (a.empty()) return b;
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+//фильтры над кандидатами по кускам в пуле потоков
+vector<uint32_t> filterRows(MediaSpan catalog, const CatalogQuery& query, const vector<int>& filters,
+    const vector<uint32_t>& candidates) {
+    return parallelReduce(candidates.size(), 4096, vector<uint32_t>(),
+        [&](size_t begin, size_t end) {
+            vector<uint32_t> rows(candidates.begin() + begin, candidates.begin() + end);
+            for (int f : filters) {
+                if (rows.empty()) break;
+                applyFilter(catalog, query.predicates[f], rows);
+            }
+            return rows;
+        },
+        concatRows32);
+}
+
+//может ли в блоке быть строка, где условие выполняется (по границам и маске тегов блока)
+bool zoneMayMatch(const Zone& zone, const Predicate& p) {
+    double low, high;
+    if (p.field == QueryField::Year) {
+        low = zone.minYear;
+        high = zone.maxYear;
+    }
+    else if (p.field == QueryField::Rating) {
+        low = zone.minRating;
+        high = zone.maxRating;
+    }
+    else if (p.field == QueryField::Tag) {
+        return (zone.tagMask & tagBit(p.text)) != 0;
+    }
+    else {
+        return true;
+    }
+    switch (p.op) {
+    case CompareOp::Equal: return low <= p.value && p.value <= high;
+    case CompareOp::NotEqual: return !(low == p.value && high == p.value);
+    case CompareOp::Less: return low < p.value;
+    case CompareOp::LessEqual: return low <= p.value;
+    case CompareOp::Greater: return high > p.value;
+    case CompareOp::GreaterEqual: return high >= p.value;
+    default: return true;
+    }
+}
+
+bool zoneMayMatch(const Zone& zone, const CatalogQuery& query, const vector<int>& filters) {
+    for (int f : filters) {
+        if (!zoneMayMatch(zone, query.predicates[f])) return false;
+    }
+    return true;
+}
+
+//делит [begin, end) на куски, не пересекающие границы блоков карты, и вызывает
+//piece(begin, end, zone) - zone равен nullptr для строк за пределами карты
+template <typename Piece>
+void forEachZonePiece(size_t begin, size_t end, const ZoneMap* zones, const Piece& piece) {
+    while (begin < end) {
+        size_t z = begin / ZONE_ROWS;
+        size_t pieceEnd = min(end, (z + 1) * ZONE_ROWS);
+        bool mapped = zones && z < zones->zones.size() && pieceEnd <= zones->rows;
+        piece(begin, pieceEnd, mapped ? &zones->zones[z] : nullptr);
+        begin = pieceEnd;
+    }
+}
+
+//строки [begin, end) со всеми условиями - в rows; блоки, где условия невыполнимы, пропускаются
+void scanPiece(MediaSpan catalog, const CatalogQuery& query, const vector<int>& filters,
+    const ZoneMap* zones, size_t begin, size_t end, vector<uint32_t>& rows) {
+    forEachZonePiece(begin, end, zones, [&](size_t from, size_t to, const Zone* zone) {
+        if (zone && !zoneMayMatch(*zone, query, filters)) return;
+        vector<uint32_t> piece(to - from);
+        for (size_t i = 0; i < piece.size(); i++) piece[i] = (uint32_t)(from + i);
+        for (int f : filters) {
+            if (piece.empty()) break;
+            applyFilter(catalog, query.predicates[f], piece);
+        }
+        rows.insert(rows.end(), piece.begin(), piece.end());
+    });
+}
+
+//строки [from, to) со всеми условиями
+vector<uint32_t> scanRows(MediaSpan catalog, const CatalogQuery& query, const vector<int>& filters,
+    size_t from, size_t to, const ZoneMap* zones) {
+    return parallelReduce(to - from, 4096, vector<uint32_t>(),
+        [&](size_t begin, size_t end) {
+            vector<uint32_t> rows;
+            scanPiece(catalog, query, filters, zones, from + begin, from + end, rows);
+            return rows;
+        },
+        concatRows32);
+}
+
+//строки индекса, где выполнены все условия на год, рейтинг и теги из predicates: карта
+//строится по кускам из целых слов, в каждом куске условия пересекаются и извлекаются строки;
+//блоки, где по карте блоков условия невыполнимы, не считаются вовсе
+vector<uint32_t> columnRows(const CatalogIndex& index, const CatalogQuery& query, const vector<int>& predicates) {
+    const CatalogColumns& columns = index.columns();
+    size_t n = columns.size(), words = bitmapWords(n);
+    struct Range {
+        const int16_t* values;
+        int16_t lo, hi;
+        bool negate;
+    };
+    vector<Range> ranges;
+    vector<vector<uint64_t>> tagMaps;
+    for (int i : predicates) {
+        const Predicate& p = query.predicates[i];
+        Range r;
+        if (columnBounds(p, columns, r.lo, r.hi, r.negate)) {
+            r.values = p.field == QueryField::Year ? columns.years.data() : columns.ratings.data();
+            ranges.push_back(r);
+        }
+        else {
+            vector<uint32_t> rows = index.tagRows(p.text);
+            tagMaps.emplace_back(words, 0);
+            setBitmapRows(rows.data(), rows.data() + rows.size(), tagMaps.back().data(), words);
+        }
+    }
+    return parallelReduce(words, 64, vector<uint32_t>(),
+        [&](size_t begin, size_t end) {
+            vector<uint32_t> rows;
+            vector<uint64_t> bits;
+            //границы блоков кратны 64 строкам, поэтому куски состоят из целых слов
+            forEachZonePiece(begin * 64, min(n, end * 64), &index.zones(), [&](size_t first, size_t last, const Zone* zone) {
+                if (zone && !zoneMayMatch(*zone, query, predicates)) return;
+                size_t word = first / 64;
+                bits.assign(bitmapWords(last - first), 0);
+                for (size_t r = 0; r < ranges.size(); r++) {
+                    filterRange16(ranges[r].values + first, last - first, ranges[r].lo, ranges[r].hi, ranges[r].negate,
+                        r > 0, bits.data());
+                }
+                for (const vector<uint64_t>& tags : tagMaps) andBitmap(bits.data(), tags.data() + word, bits.size());
+                appendBitmapRows(bits.data(), bits.size(), (uint32_t)first, rows);
+            });
+            return rows;
+        },
+        concatRows32);
+}
+
+vector<size_t> runCatalogQuery(MediaSpan catalog, const CatalogIndex* index,
+    const CatalogQuery& query, const QueryPlan& plan) {
+    OpTimer timer(Op::CatalogQuery);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("runCatalogQuery");
+    vector<uint32_t> rows;
+    vector<int> all = plan.filters; //все условия: для полного прохода и хвоста без индекса
+    for (int p : plan.driver.predicates) {
+        if (find(all.begin(), all.end(), p) == all.end()) all.push_back(p);
+    }
+    const ZoneMap* zones = index ? &index->zones() : nullptr;
+    if (plan.topByZones) {
+        //топ по рейтингу: блоки от лучшей границы, пока они могут дать строку лучше набранных
+        TRACE_SCOPE("query/topByZones");
+        vector<size_t> top = topRowsByZones(catalog, *zones, query.limit, query.descending,
+            [&](size_t begin, size_t end, vector<uint32_t>& out) { scanPiece(catalog, query, all, zones, begin, end, out); });
+        rows.assign(top.begin(), top.end());
+        rows = concatRows32(move(rows), scanRows(catalog, query, all, plan.indexedRows, catalog.size(), nullptr));
+    }
+    else if (plan.driver.path == AccessPath::FullScan || !index) {
+        rows = scanRows(catalog, query, all, 0, catalog.size(), zones);
+    }
+    else {
+        vector<uint32_t> candidates;
+        {
+            TRACE_SCOPE("query/driver");
+            const Predicate& p = query.predicates[plan.driver.predicates[0]];
+            if (plan.driver.path == AccessPath::ColumnBitmap) candidates = columnRows(*index, query, plan.driver.predicates);
+            else if (plan.driver.path == AccessPath::TagPostings) candidates = index->tagRows(p.text);
+            else if (plan.driver.path == AccessPath::Trigram) candidates = index->trigramCandidates(p.text, p.field == QueryField::Title);
+            else {
+                int from, to;
+                yearRange(p, from, to);
+                candidates = index->yearRows(from, to);
+            }
+            //строки индекса за пределами снимка (снимок короче индекса) отбрасываем
+            while (!candidates.empty() && candidates.back() >= catalog.size()) candidates.pop_back();
+        }
+        {
+            TRACE_SCOPE("query/filters");
+            rows = filterRows(catalog, query, plan.filters, candidates);
+        }
+        //хвост без индекса - со всеми условиями, включая ведущие
+        size_t indexed = min(index->rows(), catalog.size());
+        if (indexed < catalog.size()) {
+            rows = concatRows32(move(rows), scanRows(catalog, query, all, indexed, catalog.size(), nullptr));
+        }
+    }
+
+    vector<size_t> result(rows.begin(), rows.end());
+    size_t limit = min(query.limit, result.size());
+    if (query.ordered) {
+        TRACE_SCOPE("query/order");
+        auto before = [&](size_t a, size_t b) {
+            const Media& x = catalog[a];
+            const Media& y = catalog[b];
+            int order = 0;
+            if (query.orderBy == QueryField::Rating) order = x.rating < y.rating ? -1 : x.rating > y.rating;
+            else if (query.orderBy == QueryField::Year) order = x.year < y.year ? -1 : x.year > y.year;
+            else order = x.title.compare(y.title);
+            if (order != 0) return query.descending ? order > 0 : order < 0;
+            return a < b; //при равенстве - по порядку в каталоге
+        };
+        if (limit < result.size()) partial_sort(result.begin(), result.begin() + limit, result.end(), before);
+        else sort(result.begin(), result.end(), before);
+    }
+    result.resize(limit);
+    return result;
+}
+
+/*------EXPLAIN------*/
+string describePath(const CatalogQuery& query, const PathCost& c) {
+    char line[128];
+    string out = accessPathName(c.path);
+    for (size_t i = 0; i < c.predicates.size(); i++) {
+        out += (i > 0 ? " AND " : " [") + formatPredicate(query.predicates[c.predicates[i]]);
+    }
+    if (!c.predicates.empty()) out += "]";
+    snprintf(line, sizeof(line), ": строк ~%zu, стоимость %.0f", c.estimatedRows, c.cost);
+    return out + line;
+}
+
+string explainQuery(const CatalogQuery& query, const QueryPlan& plan) {
+    char line[160];
+    string out = "запрос:";
+    for (size_t i = 0; i < query.predicates.size(); i++) {
+        out += (i > 0 ? " AND " : " ") + formatPredicate(query.predicates[i]);
+    }
+    if (query.predicates.empty()) out += " (все записи)";
+    out += "\n";
+    snprintf(line, sizeof(line), "строк в каталоге: %zu (в индексе %zu, хвост без индекса %zu)\n",
+        plan.catalogRows, plan.indexedRows, plan.catalogRows - plan.indexedRows);
+    out += line;
+    out += "доступ: " + describePath(query, plan.driver) + "\n";
+    for (const PathCost& c : plan.alternatives) {
+        if (c.path == plan.driver.path && c.predicates == plan.driver.predicates) continue;
+        out += "  отклонено: " + describePath(query, c) + "\n";
+    }
+    out += "фильтры:";
+    if (plan.filters.empty()) out += " нет";
+    for (size_t i = 0; i < plan.filters.size(); i++) {
+        int f = plan.filters[i];
+        snprintf(line, sizeof(line), " (доля ~%.3f)", plan.selectivity[f]);
+        out += (i > 0 ? ", " : " ") + formatPredicate(query.predicates[f]) + line;
+    }
+    out += "\n";
+    if (plan.indexedRows > 0) {
+        snprintf(line, sizeof(line), "карта блоков: %zu блоков по %zu строк, блоки без подходящих строк пропускаются\n",
+            (plan.indexedRows + ZONE_ROWS - 1) / ZONE_ROWS, ZONE_ROWS);
+        out += line;
+    }
+    if (plan.topByZones) out += "топ по блокам: от лучшего рейтинга блока, пока блок может дать строку лучше набранных\n";
+    if (query.ordered) {
+        out += string("сортировка: ") + fieldName(query.orderBy) + (query.descending ? " DESC" : " ASC");
+        out += query.limit != SIZE_MAX ? ", LIMIT " + to_string(query.limit) + " (частичная сортировка)\n" : "\n";
+    }
+    else if (query.limit != SIZE_MAX) {
+        out += "LIMIT " + to_string(query.limit) + " (в порядке каталога)\n";
+    }
+    return out;
+}
+
+bool runCompositeQuery(IndexHolder& holder, const CatalogSnapshot& snapshot, const string& text,
+    vector<size_t>& rows, string& plan, string& error) {
+    CatalogQuery query;
+    if (!parseCatalogQuery(text, query, error)) return false;
+    shared_ptr<const CatalogIndex> index = holder.get(snapshot);
+    QueryPlan queryPlan = planQuery(query, index.get(), snapshot.records().size());
+    if (query.explain) plan = explainQuery(query, queryPlan);
+    else rows = runCatalogQuery(snapshot.records(), index.get(), query, queryPlan);
+    return true;
+}
@@ -0,0 +1,233 @@
+#include "posting_codec.h"
+
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//исключение: байт позиции + слово старших битов
+const size_t EXCEPTION_BITS = 40;
+
+/*------Упаковка блока------*/
+//число бит, в которые помещается value
+static uint32_t bitWidth(uint32_t value) {
+    uint32_t bits = 0;
+    while (bits < 32 && (value >> bits) != 0) bits++;
+    return bits;
+}
+
+//ширина блока с наименьшим размером: младшие b бит всех разностей + исключения
+static uint32_t chooseWidth(const uint32_t* deltas) {
+    size_t widths[33] = {};
+    for (size_t i = 0; i < POSTING_BLOCK; i++) widths[bitWidth(deltas[i])]++;
+    uint32_t best = 32;
+    size_t bestCost = POSTING_BLOCK * 32, exceptions = 0;
+    for (int b = 31; b >= 0; b--) {
+        exceptions += widths[b + 1]; //разности шире b бит
+        size_t cost = POSTING_BLOCK * b + exceptions * EXCEPTION_BITS;
+        if (cost <= bestCost) {
+            bestCost = cost;
+            best = (uint32_t)b;
+        }
+    }
+    return best;
+}
+
+//число i блока - в полосе i % 4 с позиции (i / 4) * b; слово w полосы l - data[w * 4 + l]
+static void packBlock(const uint32_t* deltas, uint32_t b, uint32_t* data) {
+    if (b == 0) return;
+    uint32_t mask = b == 32 ? ~0u : (1u << b) - 1;
+    for (size_t i = 0; i < POSTING_BLOCK; i++) {
+        uint32_t value = deltas[i] & mask;
+        size_t lane = i % 4, bit = (i / 4) * b;
+        size_t word = bit / 32, shift = bit % 32;
+        data[word * 4 + lane] |= value << shift;
+        if (shift + b > 32) data[(word + 1) * 4 + lane] |= value >> (32 - shift);
+    }
+}
+
+static void unpackBlock(const uint32_t* data, uint32_t b, uint32_t* out) {
+    if (b == 0) {
+        fill(out, out + POSTING_BLOCK, 0u);
+        return;
+    }
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32(b == 32 ? -1 : (int)((1u << b) - 1));
+    for (size_t j = 0; j < POSTING_BLOCK / 4; j++) {
+        size_t bit = j * b, word = bit / 32, shift = bit % 32;
+        __m128i v = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)(data + word * 4)), _mm_cvtsi32_si128((int)shift));
+        if (shift + b > 32) {
+            __m128i spill = _mm_loadu_si128((const __m128i*)(data + (word + 1) * 4));
+            v = _mm_or_si128(v, _mm_sll_epi32(spill, _mm_cvtsi32_si128((int)(32 - shift))));
+        }
+        _mm_storeu_si128((__m128i*)(out + j * 4), _mm_and_si128(v, mask));
+    }
+#else
+    uint32_t mask = b == 32 ? ~0u : (1u << b) - 1;
+    for (size_t i = 0; i < POSTING_BLOCK; i++) {
+        size_t lane = i % 4, bit = (i / 4) * b;
+        size_t word = bit / 32, shift = bit % 32;
+        uint32_t value = data[word * 4 + lane] >> shift;
+        if (shift + b > 32) value |= data[(word + 1) * 4 + lane] << (32 - shift);
+        out[i] = value & mask;
+    }
+#endif
+}
+
+//разности -> строки: out[i] = base + out[0] + ... + out[i]
+static void prefixSum(uint32_t* out, uint32_t base) {
+#ifdef __SSE2__
+    __m128i carry = _mm_set1_epi32((int)base);
+    for (size_t j = 0; j < POSTING_BLOCK; j += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(out + j));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, carry);
+        _mm_storeu_si128((__m128i*)(out + j), v);
+        carry = _mm_shuffle_epi32(v, 0xFF);
+    }
+#else
+    for (size_t i = 0; i < POSTING_BLOCK; i++) out[i] = base += out[i];
+#endif
+}
+
+/*------Кодирование------*/
+CompressedPostings CompressedPostings::encode(const uint32_t* rows, size_t n) {
+    CompressedPostings list;
+    list.size_ = (uint32_t)n;
+    list.blocks_ = (uint32_t)(n / POSTING_BLOCK);
+    list.last_ = n ? rows[n - 1] : 0;
+    vector<uint32_t>& words = list.words_;
+    words.assign(list.blocks_ * 3, 0);
+
+    uint32_t deltas[POSTING_BLOCK];
+    uint32_t previous = 0;
+    for (size_t k = 0; k < list.blocks_; k++) {
+        const uint32_t* block = rows + k * POSTING_BLOCK;
+        for (size_t i = 0; i < POSTING_BLOCK; i++) {
+            deltas[i] = block[i] - previous;
+            previous = block[i];
+        }
+        uint32_t b = chooseWidth(deltas);
+        vector<uint8_t> positions;
+        for (size_t i = 0; i < POSTING_BLOCK; i++) {
+            if (b < 32 && (deltas[i] >> b) != 0) positions.push_back((uint8_t)i);
+        }
+        words[k * 3] = previous;
+        words[k * 3 + 1] = (uint32_t)words.size();
+        words[k * 3 + 2] = b | (uint32_t)positions.size() << 8;
+
+        size_t data = words.size();
+        words.resize(data + 4 * b + (positions.size() + 3) / 4, 0);
+        packBlock(deltas, b, words.data() + data);
+        uint8_t* bytes = (uint8_t*)(words.data() + data + 4 * b);
+        copy(positions.begin(), positions.end(), bytes);
+        for (uint8_t p : positions) words.push_back(deltas[p] >> b);
+    }
+
+    //хвост: varint разностей
+    vector<uint8_t> tail;
+    for (size_t i = list.blocks_ * POSTING_BLOCK; i < n; i++) {
+        uint32_t delta = rows[i] - previous;
+        previous = rows[i];
+        while (delta >= 0x80) {
+            tail.push_back((uint8_t)(delta | 0x80));
+            delta >>= 7;
+        }
+        tail.push_back((uint8_t)delta);
+    }
+    list.tailOffset_ = (uint32_t)words.size();
+    words.resize(words.size() + (tail.size() + 3) / 4, 0);
+    copy(tail.begin(), tail.end(), (uint8_t*)(words.data() + list.tailOffset_));
+    words.shrink_to_fit();
+    return list;
+}
+
+/*------Распаковка------*/
+void CompressedPostings::decodeBlock(size_t block, uint32_t* out) const {
+    uint32_t base = block == 0 ? 0 : words_[(block - 1) * 3];
+    if (block == blocks_) {
+        const uint8_t* bytes = (const uint8_t*)(words_.data() + tailOffset_);
+        size_t count = size_ - blocks_ * POSTING_BLOCK;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t delta = 0;
+            for (int shift = 0;; shift += 7) {
+                uint8_t byte = *bytes++;
+                delta |= (uint32_t)(byte & 0x7F) << shift;
+                if (byte < 0x80) break;
+            }
+            out[i] = base += delta;
+        }
+        return;
+    }
+    const uint32_t* data = words_.data() + words_[block * 3 + 1];
+    uint32_t meta = words_[block * 3 + 2];
+    uint32_t b = meta & 0xFF, exceptions = meta >> 8;
+    unpackBlock(data, b, out);
+    if (exceptions) {
+        const uint8_t* positions = (const uint8_t*)(data + 4 * b);
+        const uint32_t* high = data + 4 * b + (exceptions + 3) / 4;
+        for (uint32_t e = 0; e < exceptions; e++) out[positions[e]] |= high[e] << b;
+    }
+    prefixSum(out, base);
+}
+
+vector<uint32_t> CompressedPostings::decode() const {
+    vector<uint32_t> rows(size_);
+    for (size_t k = 0; k < blockCount(); k++) decodeBlock(k, rows.data() + k * POSTING_BLOCK);
+    return rows;
+}
+
+/*------Пересечение------*/
+//первый блок с номером не меньше from, последняя строка которого не меньше target: шагами
+//1, 2, 4... по указателям пропуска, потом двоичный поиск
+size_t CompressedPostings::findBlock(size_t from, uint32_t target) const {
+    size_t blocks = blockCount();
+    if (from >= blocks || blockLast(from) >= target) return from;
+    size_t low = from, step = 1; //blockLast(low) < target
+    while (low + step < blocks && blockLast(low + step) < target) {
+        low += step;
+        step *= 2;
+    }
+    size_t high = min(low + step, blocks);
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (blockLast(middle) < target) low = middle;
+        else high = middle;
+    }
+    return high;
+}
+
+//rows - по возрастанию; остаются строки, которые есть в list
+static void intersectWith(vector<uint32_t>& rows, const CompressedPostings& list) {
+    uint32_t buffer[POSTING_BLOCK];
+    size_t kept = 0, i = 0, block = 0;
+    while (i < rows.size()) {
+        block = list.findBlock(block, rows[i]);
+        if (block == list.blockCount()) break;
+        list.decodeBlock(block, buffer);
+        const uint32_t* row = buffer;
+        const uint32_t* end = buffer + list.blockSize(block);
+        //в блоке все строки не больше его последней
+        uint32_t last = end[-1];
+        while (i < rows.size() && rows[i] <= last) {
+            while (*row < rows[i]) row++;
+            if (*row == rows[i]) rows[kept++] = rows[i];
+            i++;
+        }
+        block++;
+    }
+    rows.resize(kept);
+}
+
+vector<uint32_t> intersectPostings(vector<const CompressedPostings*> lists) {
+    if (lists.empty()) return {};
+    sort(lists.begin(), lists.end(), [](const CompressedPostings* a, const CompressedPostings* b) {
+        return a->size() < b->size();
+    });
+    vector<uint32_t> result = lists[0]->decode();
+    for (size_t k = 1; k < lists.size() && !result.empty(); k++) intersectWith(result, *lists[k]);
+    return result;
+}
@@ -0,0 +1,257 @@
+#include "query.h"
+#include "planner.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+using namespace std;
+
+bool parseQueryRequest(const string& json, QueryRequest& q, string& error) {
+    map<string, string> fields;
+    if (!parseJsonObject(json, fields)) {
+        error = "запрос не разобран";
+        return false;
+    }
+    q = QueryRequest();
+    q.op = fields["op"];
+    if (fields.count("limit")) q.limit = (size_t)max(0, atoi(fields["limit"].c_str()));
+
+    if (q.op == "search") q.text = fields["text"];
+    else if (q.op == "tag") q.text = fields["tag"];
+    else if (q.op == "query") q.text = fields["q"];
+    else if (q.op == "years" || q.op == "histogram") {
+        if (fields.count("from")) q.from = atoi(fields["from"].c_str());
+        if (fields.count("to")) q.to = atoi(fields["to"].c_str());
+        if (fields.count("step")) q.step = atoi(fields["step"].c_str());
+        if (q.op == "years" && !fields.count("from") && !fields.count("to")) {
+            error = "нужен from или to";
+            return false;
+        }
+        if (q.step <= 0) {
+            error = "step должно быть больше 0";
+            return false;
+        }
+        if (q.from > q.to) {
+            error = "from больше to";
+            return false;
+        }
+        return true;
+    }
+    else if (q.op == "top") q.n = fields.count("n") ? atoi(fields["n"].c_str()) : 10;
+    else if (q.op == "suggest") {
+        q.text = fields["q"];
+        q.n = fields.count("k") ? atoi(fields["k"].c_str()) : 10;
+    }
+    else if (q.op == "fuzzy") {
+        q.text = fields["q"];
+        if (fields.count("d")) q.distance = atoi(fields["d"].c_str());
+    }
+    else if (q.op == "text") {
+        q.text = fields["q"];
+        q.n = fields.count("k") ? atoi(fields["k"].c_str()) : 10;
+        if (fields.count("w")) q.weight = atof(fields["w"].c_str());
+    }
+    else if (q.op == "insert") {
+        //поля записи лежат в самом запросе; "op" разборщик записи пропускает
+        if (!parseJsonLine(json, q.record)) {
+            error = "запись не разобрана";
+            return false;
+        }
+        return true;
+    }
+    else if (q.op != "stats" && q.op != "dups") {
+        error = "неизвестная операция '" + q.op + "'";
+        return false;
+    }
+    if ((q.op == "search" || q.op == "tag" || q.op == "query" || q.op == "suggest" || q.op == "fuzzy" ||
+        q.op == "text") && q.text.empty()) {
+        error = "пустой текст запроса";
+        return false;
+    }
+    if (q.op == "top" && q.n <= 0) {
+        error = "n должно быть больше 0";
+        return false;
+    }
+    if ((q.op == "suggest" || q.op == "text") && q.n <= 0) {
+        error = "k должно быть больше 0";
+        return false;
+    }
+    if (q.op == "text" && q.weight < 0) {
+        error = "w не может быть отрицательным";
+        return false;
+    }
+    if (q.op == "fuzzy" && (q.distance < 0 || q.distance > 2)) {
+        error = "d должно быть от 0 до 2";
+        return false;
+    }
+    return true;
+}
+
+shared_ptr<const CachedResult> queryResult(QueryContext& context, const CatalogSnapshot& snapshot,
+    const QueryRequest& q) {
+    CacheQuery cacheQuery;
+    cacheQuery.op = q.op;
+    cacheQuery.text = q.text;
+    cacheQuery.n = q.n;
+    //топ обходит блоки по карте блоков версии
+    shared_ptr<const ZoneMap> zones = q.op == "top" ? context.index.zones(snapshot) : nullptr;
+    return runCachedQuery(context.cache, snapshot.records(), snapshot.version(), cacheQuery, zones.get());
+}
+
+void appendStatsJson(string& out, const CatalogStats& stats) {
+    char num[32];
+    snprintf(num, sizeof(num), "%.2f", stats.avgRating);
+    out += "{\"total\": " + to_string(stats.total) + ", \"avg_rating\": " + num;
+    if (stats.total > 0) {
+        out += ", \"min_year\": " + to_string(stats.minYear) +
+            ", \"max_year\": " + to_string(stats.maxYear);
+    }
+    out += ", \"tags\": {";
+    for (size_t i = 0; i < stats.tagCounts.size(); i++) {
+        if (i > 0) out += ", ";
+        appendJsonString(out, stats.tagCounts[i].first);
+        out += ": " + to_string(stats.tagCounts[i].second);
+    }
+    out += "}}";
+}
+
+void appendErrorJson(string& out, const string& error) {
+    out += "{\"ok\": false, \"error\": ";
+    appendJsonString(out, error);
+    out += "}";
+}
+
+void appendHistogramJson(string& out, const vector<YearBucket>& buckets) {
+    out += "{\"ok\": true, \"buckets\": [";
+    for (size_t i = 0; i < buckets.size(); i++) {
+        if (i > 0) out += ", ";
+        out += "{\"from\": " + to_string(buckets[i].from) + ", \"to\": " + to_string(buckets[i].to) +
+            ", \"count\": " + to_string(buckets[i].count) + "}";
+    }
+    out += "]}";
+}
+
+void appendSuggestionJson(string& out, const Suggestion& suggestion) {
+    out += "{\"text\": ";
+    appendJsonString(out, suggestion.text);
+    out += suggestion.author ? ", \"field\": \"author\"" : ", \"field\": \"title\"";
+    char rating[32];
+    snprintf(rating, sizeof(rating), "%.1f", suggestion.rating);
+    out += ", \"rating\": " + string(rating) + "}";
+}
+
+void appendSuggestionsJson(string& out, const vector<Suggestion>& suggestions) {
+    out += "{\"ok\": true, \"suggestions\": [";
+    for (size_t i = 0; i < suggestions.size(); i++) {
+        if (i > 0) out += ", ";
+        appendSuggestionJson(out, suggestions[i]);
+    }
+    out += "]}";
+}
+
+//ответ со строками каталога (count - все найденные, results - первые limit)
+void appendRowsJson(string& out, MediaSpan catalog, const vector<size_t>& rows, size_t limit) {
+    out += "{\"ok\": true, \"count\": " + to_string(rows.size()) + ", \"results\": [";
+    for (size_t i = 0; i < rows.size() && i < limit; i++) {
+        if (i > 0) out += ", ";
+        appendJsonObject(out, catalog[rows[i]]);
+    }
+    out += "]}";
+}
+
+//вставка: новая версия каталога и дозапись в дельту, чтобы запись пережила перезапуск
+void executeInsert(QueryContext& context, const QueryRequest& q, string& out) {
+    lock_guard<mutex> lock(context.insertLock);
+    if (!context.store.insert(q.record)) {
+        appendErrorJson(out, "некорректная запись");
+        return;
+    }
+    CatalogSnapshot snapshot = context.store.snapshot();
+    if (!saveDelta(snapshot.records(), context.filename, context.savedCount)) {
+        appendErrorJson(out, "запись добавлена, но не сохранена в файл");
+        return;
+    }
+    out += "{\"ok\": true, \"total\": " + to_string(snapshot.records().size()) + "}";
+}
+
+void executeQuery(QueryContext& context, const QueryRequest& q, string& out) {
+    if (q.op == "insert") {
+        executeInsert(context, q, out);
+        return;
+    }
+
+    CatalogSnapshot snapshot = context.store.snapshot();
+    MediaSpan catalog = snapshot.records();
+    if (q.op == "stats") {
+        out += "{\"ok\": true, \"stats\": ";
+        appendStatsJson(out, queryResult(context, snapshot, q)->stats);
+        out += "}";
+        return;
+    }
+    if (q.op == "dups") {
+        vector<pair<string, int>> duplicates = collectDuplicates(catalog);
+        out += "{\"ok\": true, \"count\": " + to_string(duplicates.size()) + ", \"results\": [";
+        for (size_t i = 0; i < duplicates.size() && i < q.limit; i++) {
+            if (i > 0) out += ", ";
+            out += "{\"key\": ";
+            appendJsonString(out, duplicates[i].first);
+            out += ", \"count\": " + to_string(duplicates[i].second) + "}";
+        }
+        out += "]}";
+        return;
+    }
+
+    if (q.op == "years") {
+        appendRowsJson(out, catalog, context.years.rows(snapshot, q.from, q.to), q.limit);
+        return;
+    }
+    if (q.op == "histogram") {
+        //без границ (INT_MIN, INT_MAX) - от самого раннего до самого позднего года
+        appendHistogramJson(out, context.years.histogram(snapshot, q.from, q.to, q.step));
+        return;
+    }
+    if (q.op == "suggest") {
+        appendSuggestionsJson(out, context.suggest.complete(snapshot, q.text, (size_t)q.n));
+        return;
+    }
+    if (q.op == "text") {
+        appendRowsJson(out, catalog, textRows(context.text.search(snapshot, q.text, (size_t)q.n, q.weight)), q.limit);
+        return;
+    }
+    if (q.op == "fuzzy") {
+        appendRowsJson(out, catalog, fuzzyRows(context.fuzzy.search(snapshot, q.text, q.distance)), q.limit);
+        return;
+    }
+    if (q.op == "query") {
+        vector<size_t> rows;
+        string plan, error;
+        if (!runCompositeQuery(context.index, snapshot, q.text, rows, plan, error)) {
+            appendErrorJson(out, "запрос: " + error);
+            return;
+        }
+        if (!plan.empty()) {
+            out += "{\"ok\": true, \"plan\": ";
+            appendJsonString(out, plan);
+            out += "}";
+            return;
+        }
+        appendRowsJson(out, catalog, rows, q.limit);
+        return;
+    }
+
+    //записи сериализуются прямо из строк каталога, без копий Media
+    appendRowsJson(out, catalog, queryResult(context, snapshot, q)->rows, q.limit);
+}
+
+void executeQueryJson(QueryContext& context, const string& json, string& out) {
+    QueryRequest q;
+    string error;
+    if (!parseQueryRequest(json, q, error)) {
+        appendErrorJson(out, error);
+        return;
+    }
+    executeQuery(context, q, out);
+}
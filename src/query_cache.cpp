@@ -0,0 +1,127 @@
+#include "query_cache.h"
+#include "metrics.h"
+
+#include <algorithm>
+
+using namespace std;
+
+bool QueryCache::cacheable(const CacheQuery& q) {
+    return q.op == "search" || q.op == "tag" || q.op == "top" || q.op == "stats";
+}
+
+//текст поиска не приводится к нижнему регистру: автор сравнивается с учетом регистра,
+//и "Толстой" и "толстой" дают разные результаты
+string QueryCache::makeKey(const CacheQuery& q) {
+    if (q.op == "top") return "top\x1f" + to_string(q.n);
+    if (q.op == "stats") return "stats";
+    return q.op + "\x1f" + q.text;
+}
+
+shared_ptr<const CachedResult> QueryCache::get(const string& key, uint64_t version) {
+    lock_guard<mutex> lock(lock_);
+    auto it = index_.find(key);
+    if (it == index_.end() || it->second->version != version) {
+        recordCacheLookup(false);
+        return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second); //в начало списка LRU
+    recordCacheLookup(true);
+    return it->second->result;
+}
+
+void QueryCache::put(const string& key, const CacheQuery& q, uint64_t version, shared_ptr<const CachedResult> result) {
+    if (capacity_ == 0) return;
+    lock_guard<mutex> lock(lock_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        //результат по старой версии не заменяет более новый
+        if (it->second->version > version) return;
+        it->second->version = version;
+        it->second->result = move(result);
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+    entries_.push_front({ key, q, version, move(result) });
+    index_[key] = entries_.begin();
+    if (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+//может ли результат запроса измениться от добавления записей
+bool QueryCache::affectedBy(const Entry& entry, const vector<Media>& added) const {
+    const CacheQuery& q = entry.query;
+    if (q.op == "search") {
+        string searchLower = q.text;
+        transform(searchLower.begin(), searchLower.end(), searchLower.begin(), ::tolower);
+        string titleLower;
+        for (const Media& item : added) {
+            if (matchesSubstring(item, searchLower, q.text, titleLower)) return true;
+        }
+        return false;
+    }
+    if (q.op == "tag") {
+        for (const Media& item : added) {
+            if (find(item.tags.begin(), item.tags.end(), q.text) != item.tags.end()) return true;
+        }
+        return false;
+    }
+    if (q.op == "top") {
+        //неполный топ пополнится любой записью; при равном рейтинге новая строка
+        //идет после старых и в топ не попадает
+        if (entry.result->rows.size() < (size_t)q.n) return !added.empty();
+        for (const Media& item : added) {
+            if (item.rating > entry.result->minRating) return true;
+        }
+        return false;
+    }
+    return true; //stats меняется от любой записи
+}
+
+void QueryCache::onInsert(const vector<Media>& added, uint64_t oldVersion, uint64_t newVersion) {
+    lock_guard<mutex> lock(lock_);
+    size_t invalidated = 0;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        //записи по более старым версиям никому больше не ответят
+        if (it->version != oldVersion || affectedBy(*it, added)) {
+            index_.erase(it->key);
+            it = entries_.erase(it);
+            invalidated++;
+            continue;
+        }
+        it->version = newVersion;
+        ++it;
+    }
+    recordCacheInvalidations(invalidated);
+}
+
+void QueryCache::clear() {
+    lock_guard<mutex> lock(lock_);
+    recordCacheInvalidations(entries_.size());
+    entries_.clear();
+    index_.clear();
+}
+
+size_t QueryCache::size() {
+    lock_guard<mutex> lock(lock_);
+    return entries_.size();
+}
+
+shared_ptr<const CachedResult> runCachedQuery(QueryCache& cache, MediaSpan catalog,
+    uint64_t version, const CacheQuery& q, const ZoneMap* zones) {
+    string key = QueryCache::makeKey(q);
+    shared_ptr<const CachedResult> cached = cache.get(key, version);
+    if (cached) return cached;
+
+    auto result = make_shared<CachedResult>();
+    if (q.op == "search") result->rows = findRowsBySubstring(catalog, q.text);
+    else if (q.op == "tag") result->rows = findRowsByTag(catalog, q.text);
+    else if (q.op == "top") {
+        result->rows = getTopRows(catalog, q.n, zones);
+        if (!result->rows.empty()) result->minRating = catalog[result->rows.back()].rating;
+    }
+    else if (q.op == "stats") result->stats = computeStatistics(catalog);
+    cache.put(key, q, version, result);
+    return result;
+}
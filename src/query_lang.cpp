@@ -0,0 +1,214 @@
+#include "query_lang.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+/*------Лексер------*/
+struct Token {
+    enum Kind { Word, String, Number, Symbol, End };
+    Kind kind = End;
+    string text;
+};
+
+//слово: латиница, цифры, '_', '-', '.' и любые байты UTF-8 (кириллица в тегах)
+bool isWordByte(unsigned char ch) {
+    return isalnum(ch) || ch == '_' || ch == '-' || ch == '.' || ch >= 0x80;
+}
+
+bool tokenize(const string& s, vector<Token>& tokens, string& error) {
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char ch = (unsigned char)s[i];
+        if (isspace(ch)) {
+            i++;
+            continue;
+        }
+        Token t;
+        if (ch == '"') {
+            t.kind = Token::String;
+            i++;
+            while (i < s.size() && s[i] != '"') {
+                if (s[i] == '\\' && i + 1 < s.size()) i++;
+                t.text += s[i++];
+            }
+            if (i >= s.size()) {
+                error = "незакрытая кавычка";
+                return false;
+            }
+            i++;
+        }
+        else if (ch == '>' || ch == '<' || ch == '!' || ch == '=') {
+            t.kind = Token::Symbol;
+            t.text = s[i++];
+            if (i < s.size() && s[i] == '=') t.text += s[i++];
+            if (t.text == "!") {
+                error = "ожидалось != ";
+                return false;
+            }
+        }
+        else if (ch == '~' || ch == ':') {
+            t.kind = Token::Symbol;
+            t.text = s[i++];
+        }
+        else if (isWordByte(ch)) {
+            while (i < s.size() && isWordByte((unsigned char)s[i])) t.text += s[i++];
+            char* end = nullptr;
+            strtod(t.text.c_str(), &end);
+            t.kind = *end == '\0' && (isdigit((unsigned char)t.text[0]) || t.text[0] == '-') ? Token::Number : Token::Word;
+        }
+        else {
+            error = string("неожиданный символ '") + s[i] + "'";
+            return false;
+        }
+        tokens.push_back(t);
+    }
+    tokens.push_back(Token());
+    return true;
+}
+
+string upper(string s) {
+    for (char& ch : s) ch = (char)toupper((unsigned char)ch);
+    return s;
+}
+
+bool keywordIs(const Token& t, const char* keyword) {
+    return t.kind == Token::Word && upper(t.text) == keyword;
+}
+
+bool parseField(const Token& t, QueryField& field) {
+    if (t.kind != Token::Word) return false;
+    string name = upper(t.text);
+    if (name == "TITLE") field = QueryField::Title;
+    else if (name == "AUTHOR") field = QueryField::Author;
+    else if (name == "TEXT") field = QueryField::Text;
+    else if (name == "TAG") field = QueryField::Tag;
+    else if (name == "YEAR") field = QueryField::Year;
+    else if (name == "RATING") field = QueryField::Rating;
+    else return false;
+    return true;
+}
+
+bool parseCompare(const string& symbol, CompareOp& op) {
+    if (symbol == "=") op = CompareOp::Equal;
+    else if (symbol == "!=") op = CompareOp::NotEqual;
+    else if (symbol == "<") op = CompareOp::Less;
+    else if (symbol == "<=") op = CompareOp::LessEqual;
+    else if (symbol == ">") op = CompareOp::Greater;
+    else if (symbol == ">=") op = CompareOp::GreaterEqual;
+    else return false;
+    return true;
+}
+
+/*------Разбор------*/
+bool parseCatalogQuery(const string& text, CatalogQuery& query, string& error) {
+    query = CatalogQuery();
+    vector<Token> tokens;
+    if (!tokenize(text, tokens, error)) return false;
+    size_t pos = 0;
+    auto expect = [&](const string& what) {
+        error = "ожидалось " + what + (tokens[pos].kind == Token::End ? " в конце запроса" : " перед '" + tokens[pos].text + "'");
+        return false;
+    };
+
+    if (keywordIs(tokens[pos], "EXPLAIN")) {
+        query.explain = true;
+        pos++;
+    }
+    //условия через AND
+    while (tokens[pos].kind != Token::End && !keywordIs(tokens[pos], "ORDER") && !keywordIs(tokens[pos], "LIMIT")) {
+        if (!query.predicates.empty()) {
+            if (!keywordIs(tokens[pos], "AND")) return expect("AND");
+            pos++;
+        }
+        Predicate p;
+        if (!parseField(tokens[pos], p.field)) return expect("поле (title, author, text, tag, year, rating)");
+        pos++;
+        if (tokens[pos].kind == Token::End) return expect("сравнение после " + string(fieldName(p.field)));
+        const Token& op = tokens[pos++];
+        const Token& value = tokens[pos];
+        if (p.field == QueryField::Year || p.field == QueryField::Rating) {
+            if (op.kind != Token::Symbol || !parseCompare(op.text, p.op)) {
+                pos--;
+                return expect("сравнение (=, !=, <, <=, >, >=)");
+            }
+            if (value.kind != Token::Number) return expect("число");
+            p.value = atof(value.text.c_str());
+        }
+        else if (p.field == QueryField::Tag) {
+            if (op.kind != Token::Symbol || (op.text != ":" && op.text != "=")) {
+                pos--;
+                return expect("':' после tag");
+            }
+            if (value.kind == Token::End || value.kind == Token::Symbol) return expect("тег");
+            p.op = CompareOp::Equal;
+            p.text = value.text;
+        }
+        else {
+            if (op.kind != Token::Symbol || op.text != "~") {
+                pos--;
+                return expect("'~' после " + string(fieldName(p.field)));
+            }
+            if (value.kind != Token::String) return expect("строка в кавычках");
+            p.op = CompareOp::Contains;
+            p.text = value.text;
+            if (p.field == QueryField::Title) {
+                transform(p.text.begin(), p.text.end(), p.text.begin(), ::tolower);
+            }
+        }
+        pos++;
+        query.predicates.push_back(p);
+    }
+
+    if (keywordIs(tokens[pos], "ORDER")) {
+        pos++;
+        if (!keywordIs(tokens[pos], "BY")) return expect("BY");
+        pos++;
+        if (!parseField(tokens[pos], query.orderBy) ||
+            (query.orderBy != QueryField::Rating && query.orderBy != QueryField::Year && query.orderBy != QueryField::Title)) {
+            return expect("поле сортировки (rating, year, title)");
+        }
+        query.ordered = true;
+        pos++;
+        if (keywordIs(tokens[pos], "DESC")) {
+            query.descending = true;
+            pos++;
+        }
+        else if (keywordIs(tokens[pos], "ASC")) {
+            pos++;
+        }
+    }
+    if (keywordIs(tokens[pos], "LIMIT")) {
+        pos++;
+        if (tokens[pos].kind != Token::Number || atoll(tokens[pos].text.c_str()) < 0) return expect("число после LIMIT");
+        query.limit = (size_t)atoll(tokens[pos].text.c_str());
+        pos++;
+    }
+    if (tokens[pos].kind != Token::End) return expect("конец запроса");
+    return true;
+}
+
+const char* fieldName(QueryField field) {
+    switch (field) {
+    case QueryField::Title: return "title";
+    case QueryField::Author: return "author";
+    case QueryField::Text: return "text";
+    case QueryField::Tag: return "tag";
+    case QueryField::Year: return "year";
+    case QueryField::Rating: return "rating";
+    }
+    return "?";
+}
+
+string formatPredicate(const Predicate& p) {
+    string out = fieldName(p.field);
+    if (p.field == QueryField::Tag) return out + ":\"" + p.text + "\"";
+    if (p.op == CompareOp::Contains) return out + "~\"" + p.text + "\"";
+    static const char* symbols[] = { "~", "=", "!=", "<", "<=", ">", ">=" };
+    char value[32];
+    snprintf(value, sizeof(value), "%g", p.value);
+    return out + symbols[(int)p.op] + value;
+}
@@ -0,0 +1,489 @@
+#include "server.h"
+#include "thread_pool.h"
+
+#include <iostream>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t MAX_INPUT = 16 << 20; //больше этого в буфере чтения - клиент не читает ответы или шлет мусор
+//больше неотправленного - соединение не читается, а запросы и ответы частями не продолжаются,
+//пока клиент не заберет ответы (иначе клиент, который шлет запросы и не читает, раздувает out
+//без предела)
+const size_t MAX_OUTPUT = 4 << 20;
+//служебные номера в epoll_event.data (номера соединений начинаются после них)
+const uint64_t WAKE_ID = 1;
+const uint64_t UNIX_LISTEN_ID = 2;
+const uint64_t TCP_LISTEN_ID = 3;
+const uint64_t FIRST_CONN_ID = 16;
+
+/*------Остановка по сигналу------*/
+volatile sig_atomic_t stopRequested = 0;
+int wakeFd = -1;
+
+void onStopSignal(int) {
+    stopRequested = 1;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeFd, &one, sizeof(one)); //write допустим в обработчике сигнала
+    (void)ignored;
+}
+
+/*------Соединения------*/
+//неотправленный вывод соединения, общий для цикла событий и задачи пула: задача не
+//продолжает работу, пока в очереди MAX_OUTPUT и больше
+struct OutputGauge {
+    atomic<size_t> queued{ 0 };   //отдано в цикл событий и еще не записано в сокет
+    atomic<bool> closed{ false }; //соединение закрыто - ответы больше не нужны
+
+    //false - соединение закрыто
+    bool reserve(size_t size) {
+        if (closed.load()) return false;
+        queued.fetch_add(size);
+        return true;
+    }
+    void release(size_t size) { queued.fetch_sub(size); }
+    void close() { closed.store(true); }
+    bool full() const { return queued.load() >= MAX_OUTPUT; }
+};
+
+//запросы соединения, отданные в пул одной задачей, и незаконченный ответ
+struct ConnectionTask {
+    vector<string> requests;
+    size_t next = 0;           //первый невыполненный запрос
+    ResponseContinuation more; //продолжение ответа, отданного не целиком
+};
+
+struct Connection {
+    int fd = -1;
+    string in;
+    string out;
+    size_t outPos = 0;     //сколько из out уже отправлено
+    bool busy = false;     //запросы соединения выполняются в пуле
+    bool peerClosed = false;
+    bool closeAfterWrite = false;
+    bool wantWrite = false; //есть неотправленный ответ - нужен EPOLLOUT
+    uint32_t events = 0;    //текущая подписка в epoll (0 - fd не в epoll)
+    shared_ptr<OutputGauge> gauge = make_shared<OutputGauge>();
+    shared_ptr<ConnectionTask> parked; //задача ждет, пока клиент заберет вывод (busy остается)
+};
+
+bool outputFull(const Connection& c) {
+    return c.out.size() - c.outPos >= MAX_OUTPUT;
+}
+
+//части ответов от задач пула для цикла событий
+struct Completion {
+    uint64_t conn;
+    string data;
+    bool closeAfter = false;
+    bool done = false; //задача соединения завершена
+    shared_ptr<ConnectionTask> parked; //очередь вывода полна - остаток задачи ждет в цикле событий
+};
+
+mutex completionsLock;
+deque<Completion> completions;
+
+void postCompletion(Completion&& c) {
+    {
+        lock_guard<mutex> lock(completionsLock);
+        completions.push_back(move(c));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+int listenUnix(const string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        ::close(fd);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    ::unlink(path.c_str()); //сокет от прошлого запуска
+    if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, 1024) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int listenTcp(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); //только локальные клиенты
+    if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, 1024) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class EventLoop {
+public:
+    EventLoop(const RequestParser& parser, const RequestHandler& handler)
+        : parser_(parser), handler_(handler) {}
+
+    int run(const ServerConfig& config);
+
+private:
+    void watch(int fd, uint64_t id, uint32_t events, int op);
+    void updateEvents(uint64_t id);
+    void acceptAll(int listenFd, bool tcp);
+    void readConnection(uint64_t id);
+    void dispatch(uint64_t id);
+    void runTask(uint64_t id, shared_ptr<ConnectionTask> task);
+    void resume(uint64_t id);
+    void flush(uint64_t id);
+    void closeConnection(uint64_t id);
+    void drainCompletions();
+
+    const RequestParser& parser_;
+    const RequestHandler& handler_;
+    int epollFd_ = -1;
+    uint64_t nextId_ = FIRST_CONN_ID;
+    unordered_map<uint64_t, Connection> connections_;
+    size_t busyCount_ = 0;
+    atomic<uint64_t> requests_{ 0 };
+};
+
+void EventLoop::watch(int fd, uint64_t id, uint32_t events, int op) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = id;
+    epoll_ctl(epollFd_, op, fd, &ev);
+}
+
+//после закрытия клиентом читать нечего: остается только запись (или ничего - тогда
+//fd убирается из epoll, иначе EPOLLHUP будил бы цикл, пока задача не закончит);
+//при полной очереди вывода чтение приостанавливается до ее отправки
+void EventLoop::updateEvents(uint64_t id) {
+    Connection& c = connections_[id];
+    bool reading = !c.peerClosed && !outputFull(c);
+    uint32_t events = (reading ? (uint32_t)(EPOLLIN | EPOLLRDHUP) : 0u) | (c.wantWrite ? (uint32_t)EPOLLOUT : 0u);
+    if (events == c.events) return;
+    if (events == 0) epoll_ctl(epollFd_, EPOLL_CTL_DEL, c.fd, nullptr);
+    else watch(c.fd, id, events, c.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+    c.events = events;
+}
+
+void EventLoop::acceptAll(int listenFd, bool tcp) {
+    while (true) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return; //EAGAIN - очередь приема пуста
+        if (tcp) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); //маленькие ответы - без задержки Нейгла
+        }
+        uint64_t id = nextId_++;
+        connections_[id].fd = fd;
+        updateEvents(id);
+    }
+}
+
+void EventLoop::readConnection(uint64_t id) {
+    Connection& c = connections_[id];
+    char buffer[65536];
+    while (true) {
+        ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            c.in.append(buffer, (size_t)n);
+            if (c.in.size() > MAX_INPUT) {
+                closeConnection(id);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) c.peerClosed = true;
+        else if (errno == EINTR) continue;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) c.peerClosed = true;
+        break;
+    }
+    if (c.peerClosed) updateEvents(id); //больше не читаем
+    dispatch(id);
+}
+
+//отдает в пул все готовые запросы соединения одной задачей (если задача уже идет или
+//очередь вывода полна - ждем)
+void EventLoop::dispatch(uint64_t id) {
+    Connection& c = connections_[id];
+    if (c.busy || c.closeAfterWrite || outputFull(c)) return; //после ответа с закрытием запросы не выполняются
+    vector<string> requests;
+    if (!parser_(c.in, requests)) {
+        closeConnection(id);
+        return;
+    }
+    if (requests.empty()) {
+        if (c.peerClosed && c.outPos == c.out.size()) closeConnection(id);
+        return;
+    }
+    c.busy = true;
+    busyCount_++;
+    requests_.fetch_add(requests.size(), memory_order_relaxed);
+    auto task = make_shared<ConnectionTask>();
+    task->requests = move(requests);
+    runTask(id, move(task));
+}
+
+//задача в пуле выполняет запросы по порядку и продолжает ответы частями, пока у соединения
+//есть место в очереди вывода. Когда места нет, поток пула не ждет клиента: остаток задачи
+//уходит в цикл событий (Completion::parked), и тот вернет его в пул, когда вывод уйдет
+void EventLoop::runTask(uint64_t id, shared_ptr<ConnectionTask> task) {
+    const RequestHandler& handler = handler_;
+    shared_ptr<OutputGauge> gauge = connections_[id].gauge;
+    threadPool().submit([id, &handler, gauge, task] {
+        ResponseSender send = [id, gauge](string&& data, bool closeAfter) {
+            if (!gauge->reserve(data.size())) return false;
+            postCompletion({ id, move(data), closeAfter, false });
+            return true;
+        };
+        while (true) {
+            //соединение закрыто: ответ отдавать некому, но запросы (вставки) выполняются
+            if (gauge->closed.load()) task->more = nullptr;
+            if (!task->more && task->next == task->requests.size()) break;
+            if (gauge->full() && !gauge->closed.load()) {
+                postCompletion({ id, string(), false, false, task });
+                return;
+            }
+            if (task->more) {
+                if (!task->more(send)) task->more = nullptr;
+            }
+            else task->more = handler(task->requests[task->next++], send);
+        }
+        postCompletion({ id, string(), false, true });
+    });
+}
+
+//возвращает в пул задачу, ждущую вывода, когда клиент забрал половину очереди (или
+//соединение закрыто - тогда задача только доделает запросы)
+void EventLoop::resume(uint64_t id) {
+    Connection& c = connections_[id];
+    if (!c.parked) return;
+    if (!c.gauge->closed.load() && c.out.size() - c.outPos > MAX_OUTPUT / 2) return;
+    runTask(id, move(c.parked));
+}
+
+void EventLoop::flush(uint64_t id) {
+    Connection& c = connections_[id];
+    while (c.outPos < c.out.size()) {
+        ssize_t n = ::write(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos);
+        if (n > 0) {
+            c.outPos += (size_t)n;
+            c.gauge->release((size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        closeConnection(id); //клиент ушел
+        return;
+    }
+    if (c.outPos == c.out.size()) {
+        c.out.clear();
+        c.outPos = 0;
+    }
+    else if (c.outPos > (1 << 20)) { //не копим отправленное начало буфера
+        c.out.erase(0, c.outPos);
+        c.outPos = 0;
+    }
+
+    bool pending = !c.out.empty();
+    if (!pending && !c.busy && (c.closeAfterWrite || (c.peerClosed && c.in.empty()))) {
+        closeConnection(id);
+        return;
+    }
+    c.wantWrite = pending;
+    updateEvents(id);
+    //очередь вывода ушла - продолжаем задачу или запускаем запросы, отложенные из-за нее
+    resume(id);
+    if (!c.busy && !c.closeAfterWrite && !c.in.empty() && !outputFull(c)) dispatch(id);
+}
+
+void EventLoop::closeConnection(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) return;
+    it->second.gauge->close(); //задача бросает ответ
+    if (it->second.busy) { //задача еще пишет ответы - закроем, когда она закончит
+        it->second.closeAfterWrite = true;
+        it->second.peerClosed = true;
+        it->second.in.clear();
+        updateEvents(id);
+        resume(id); //ждущая вывода задача доделывает запросы без ответов
+        return;
+    }
+    if (it->second.events != 0) epoll_ctl(epollFd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    ::close(it->second.fd);
+    connections_.erase(it);
+}
+
+void EventLoop::drainCompletions() {
+    deque<Completion> ready;
+    {
+        lock_guard<mutex> lock(completionsLock);
+        ready.swap(completions);
+    }
+    for (Completion& done : ready) {
+        auto it = connections_.find(done.conn);
+        if (it == connections_.end()) continue;
+        Connection& c = it->second;
+        if (done.parked) c.parked = move(done.parked); //вернется в пул из flush
+        if (c.closeAfterWrite) { //после последнего ответа соединения ничего не шлем
+            c.gauge->release(done.data.size());
+            done.data.clear();
+        }
+        if (c.out.empty()) c.out = move(done.data);
+        else c.out += done.data;
+        if (done.closeAfter) c.closeAfterWrite = true;
+        if (done.done) {
+            c.busy = false;
+            busyCount_--;
+            if (!c.closeAfterWrite) dispatch(done.conn); //запросы, пришедшие за время выполнения
+            if (!connections_.count(done.conn)) continue;
+        }
+        flush(done.conn);
+    }
+}
+
+int EventLoop::run(const ServerConfig& config) {
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd < 0) {
+        cerr << "Ошибка: не удалось создать epoll: " << strerror(errno) << "\n";
+        return 1;
+    }
+    watch(wakeFd, WAKE_ID, EPOLLIN, EPOLL_CTL_ADD);
+
+    int unixFd = -1, tcpFd = -1;
+    if (!config.socketPath.empty()) {
+        unixFd = listenUnix(config.socketPath);
+        if (unixFd < 0) {
+            cerr << "Ошибка: не могу слушать " << config.socketPath << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        watch(unixFd, UNIX_LISTEN_ID, EPOLLIN, EPOLL_CTL_ADD);
+        cerr << "Слушаю unix:" << config.socketPath << "\n";
+    }
+    if (config.port > 0) {
+        tcpFd = listenTcp(config.port);
+        if (tcpFd < 0) {
+            cerr << "Ошибка: не могу слушать порт " << config.port << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        watch(tcpFd, TCP_LISTEN_ID, EPOLLIN, EPOLL_CTL_ADD);
+        cerr << "Слушаю 127.0.0.1:" << config.port << "\n";
+    }
+
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    signal(SIGPIPE, SIG_IGN); //запись в закрытый сокет - ошибка EPIPE, а не завершение процесса
+
+    epoll_event events[256];
+    while (!stopRequested) {
+        int n = epoll_wait(epollFd_, events, 256, -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t counter;
+                ssize_t ignored = ::read(wakeFd, &counter, sizeof(counter));
+                (void)ignored;
+                drainCompletions();
+            }
+            else if (id == UNIX_LISTEN_ID) acceptAll(unixFd, false);
+            else if (id == TCP_LISTEN_ID) acceptAll(tcpFd, true);
+            else if (connections_.count(id)) {
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readConnection(id);
+                if (connections_.count(id) && (events[i].events & EPOLLOUT)) flush(id);
+            }
+        }
+    }
+
+    //дожидаемся начатых запросов (их ответы уже никто не прочитает, но вставки должны завершиться)
+    for (auto& kv : connections_) {
+        kv.second.gauge->close();
+        if (kv.second.parked) runTask(kv.first, move(kv.second.parked));
+    }
+    while (busyCount_ > 0) {
+        if (!threadPool().runPending()) this_thread::yield();
+        deque<Completion> ready;
+        {
+            lock_guard<mutex> lock(completionsLock);
+            ready.swap(completions);
+        }
+        for (Completion& done : ready) {
+            if (done.done) busyCount_--;
+            if (done.parked) runTask(done.conn, move(done.parked)); //ушла в цикл до закрытия
+        }
+    }
+    for (auto& kv : connections_) ::close(kv.second.fd);
+    connections_.clear();
+    if (unixFd >= 0) {
+        ::close(unixFd);
+        ::unlink(config.socketPath.c_str());
+    }
+    if (tcpFd >= 0) ::close(tcpFd);
+    ::close(epollFd_);
+    cerr << "Сервер остановлен, обработано запросов: " << requests_.load() << "\n";
+    return 0;
+}
+
+int runEventLoop(const ServerConfig& config, const RequestParser& parser, const RequestHandler& handler) {
+    EventLoop loop(parser, handler);
+    return loop.run(config);
+}
+
+/*------Протокол кадров------*/
+//кадр: uint32 длина (big-endian) + JSON
+bool parseFrames(string& in, vector<string>& requests) {
+    size_t pos = 0;
+    while (in.size() - pos >= 4) {
+        const unsigned char* p = (const unsigned char*)in.data() + pos;
+        size_t len = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+        if (len > MAX_FRAME) return false;
+        if (in.size() - pos - 4 < len) break; //кадр еще не дочитан
+        requests.emplace_back(in, pos + 4, len);
+        pos += 4 + len;
+    }
+    in.erase(0, pos);
+    return true;
+}
+
+int runServer(QueryContext& context, const ServerConfig& config) {
+    RequestHandler handler = [&context](const string& request, const ResponseSender& send) -> ResponseContinuation {
+        string out(4, '\0'); //место под длину
+        executeQueryJson(context, request, out);
+        uint32_t len = htonl((uint32_t)(out.size() - 4));
+        memcpy(&out[0], &len, 4);
+        send(move(out), false);
+        return nullptr;
+    };
+    return runEventLoop(config, parseFrames, handler);
+}
@@ -0,0 +1,150 @@
+#include "shared_scan.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+
+using namespace std;
+
+/*------Автомат Ахо-Корасик------*/
+AhoCorasick::AhoCorasick(const vector<string>& patterns) {
+    //классы байтов: 0 - байт не встречается в образцах (из любого состояния - в корень)
+    memset(classOf_, 0, sizeof(classOf_));
+    for (const string& p : patterns) {
+        for (unsigned char ch : p) {
+            if (classOf_[ch] == 0) classOf_[ch] = (uint16_t)classes_++;
+        }
+    }
+
+    next_.assign(classes_, -1);
+    out_.assign(1, -1);
+    outNext_.assign(patterns.size(), -1);
+    for (size_t id = 0; id < patterns.size(); id++) {
+        if (patterns[id].empty()) continue;
+        int32_t node = 0;
+        for (unsigned char ch : patterns[id]) {
+            size_t slot = (size_t)node * classes_ + classOf_[ch];
+            if (next_[slot] < 0) {
+                next_[slot] = (int32_t)out_.size();
+                out_.push_back(-1);
+                next_.resize(next_.size() + classes_, -1);
+            }
+            node = next_[slot];
+        }
+        outNext_[id] = out_[node];
+        out_[node] = (int32_t)id;
+    }
+
+    //обход в ширину: суффиксные ссылки и недостающие переходы через них
+    vector<int32_t> fail(out_.size(), 0);
+    dictLink_.assign(out_.size(), 0);
+    deque<int32_t> queue;
+    for (size_t c = 0; c < classes_; c++) {
+        int32_t child = next_[c];
+        if (child < 0) next_[c] = 0;
+        else queue.push_back(child);
+    }
+    while (!queue.empty()) {
+        int32_t node = queue.front();
+        queue.pop_front();
+        int32_t suffix = fail[node];
+        dictLink_[node] = out_[suffix] >= 0 ? suffix : dictLink_[suffix];
+        for (size_t c = 0; c < classes_; c++) {
+            size_t slot = (size_t)node * classes_ + c;
+            int32_t child = next_[slot];
+            if (child < 0) {
+                next_[slot] = next_[(size_t)suffix * classes_ + c];
+            }
+            else {
+                fail[child] = next_[(size_t)suffix * classes_ + c];
+                queue.push_back(child);
+            }
+        }
+    }
+}
+
+/*------Общий проход------*/
+using BatchRows = vector<vector<size_t>>;
+
+BatchRows findRowsBatch(MediaSpan catalog, const vector<ScanQuery>& queries) {
+    OpTimer timer(Op::BatchScan);
+    timer.setRecords(catalog.size());
+    TRACE_SCOPE("findRowsBatch");
+
+    //подстроки: образцы названия в нижнем регистре и автора как есть
+    vector<string> titlePatterns(queries.size()), authorPatterns(queries.size());
+    vector<size_t> matchAll; //пустая подстрока есть в любой записи
+    //теги: номер тега -> запросы с этим тегом
+    unordered_map<string, size_t> tagIds;
+    vector<vector<size_t>> tagQueries;
+    for (size_t q = 0; q < queries.size(); q++) {
+        const ScanQuery& query = queries[q];
+        if (query.kind == ScanQuery::Tag) {
+            auto it = tagIds.emplace(query.text, tagQueries.size()).first;
+            if (it->second == tagQueries.size()) tagQueries.emplace_back();
+            tagQueries[it->second].push_back(q);
+        }
+        else if (query.text.empty()) {
+            matchAll.push_back(q);
+        }
+        else {
+            titlePatterns[q] = query.text;
+            transform(titlePatterns[q].begin(), titlePatterns[q].end(), titlePatterns[q].begin(), ::tolower);
+            authorPatterns[q] = query.text;
+        }
+    }
+    AhoCorasick titleMatcher(titlePatterns);
+    AhoCorasick authorMatcher(authorPatterns);
+    bool substrings = !titleMatcher.empty();
+
+    return parallelReduce(catalog.size(), 4096, BatchRows(queries.size()),
+        [&](size_t begin, size_t end) {
+            BatchRows rows(queries.size());
+            //строка, на которой запрос уже отмечен (образец может встретиться дважды)
+            vector<size_t> lastRow(queries.size(), SIZE_MAX);
+            vector<uint64_t> tagSeen((tagQueries.size() + 63) / 64, 0);
+            string titleLower;
+            for (size_t i = begin; i < end; i++) {
+                const Media& item = catalog[i];
+                if (substrings) {
+                    auto onMatch = [&](int32_t q) {
+                        if (lastRow[q] == i) return;
+                        lastRow[q] = i;
+                        rows[q].push_back(i);
+                    };
+                    titleLower = item.title;
+                    transform(titleLower.begin(), titleLower.end(), titleLower.begin(), ::tolower);
+                    titleMatcher.scan(titleLower, onMatch);
+                    authorMatcher.scan(item.author, onMatch);
+                }
+                for (size_t q : matchAll) rows[q].push_back(i);
+
+                if (tagQueries.empty()) continue;
+                for (const string& tag : item.tags) {
+                    auto it = tagIds.find(tag);
+                    if (it == tagIds.end()) continue;
+                    uint64_t bit = 1ull << (it->second % 64);
+                    uint64_t& word = tagSeen[it->second / 64];
+                    if (word & bit) continue; //тег повторяется в записи
+                    word |= bit;
+                    for (size_t q : tagQueries[it->second]) rows[q].push_back(i);
+                }
+                for (const string& tag : item.tags) { //сбрасываем только поставленные биты
+                    auto it = tagIds.find(tag);
+                    if (it != tagIds.end()) tagSeen[it->second / 64] = 0;
+                }
+            }
+            return rows;
+        },
+        [](BatchRows a, BatchRows b) {
+            for (size_t q = 0; q < a.size(); q++) {
+                if (a[q].empty()) a[q] = move(b[q]);
+                else a[q].insert(a[q].end(), b[q].begin(), b[q].end());
+            }
+            return a;
+        });
+}
@@ -0,0 +1,171 @@
+#include "synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*------Случайные числа------*/
+//splitmix64: быстрый генератор, по seed и номеру записи дает независимые последовательности
+uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//равномерное число в [0, 1)
+double nextUnit(uint64_t& state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//начальное состояние генератора для записи index; salt разделяет потоки для разных полей
+uint64_t recordState(uint64_t seed, uint64_t index, uint64_t salt) {
+    uint64_t state = seed ^ (index * 0xD1B54A32D192ED03ULL) ^ (salt << 56);
+    nextRandom(state);
+    return state;
+}
+
+/*------Словари------*/
+const vector<string> RU_WORDS = {
+    "война", "мир", "мастер", "тайна", "город", "ночь", "сердце", "дорога", "море", "звезда",
+    "тень", "память", "огонь", "сад", "дом", "время", "лес", "река", "песня", "зима",
+    "преступление", "наказание", "остров", "капитан", "дочь", "отцы", "дети", "белая", "гвардия", "тихий",
+    "дон", "мертвые", "души", "герой", "нашего", "последний", "день", "вишневый", "горе", "ума"
+};
+const vector<string> EN_WORDS = {
+    "war", "peace", "shadow", "night", "city", "river", "star", "garden", "fire", "memory",
+    "road", "dream", "winter", "song", "house", "forest", "ocean", "king", "silent", "lost",
+    "empire", "stone", "glass", "island", "captain", "daughter", "father", "storm", "light", "dark"
+};
+const vector<string> RU_FIRST = {
+    "Лев", "Федор", "Михаил", "Анна", "Иван", "Александр", "Марина", "Борис", "Николай", "Ольга",
+    "Сергей", "Татьяна", "Антон", "Владимир", "Елена"
+};
+const vector<string> RU_LAST = {
+    "Толстой", "Достоевский", "Булгаков", "Ахматова", "Тургенев", "Пушкин", "Цветаева", "Пастернак",
+    "Гоголь", "Берггольц", "Есенин", "Толстая", "Чехов", "Набоков", "Улицкая"
+};
+const vector<string> EN_FIRST = {
+    "George", "Jane", "Frank", "Ursula", "Ray", "Agatha", "Ernest", "Virginia", "John", "Mary",
+    "Isaac", "Toni", "Neil", "Margaret", "Philip"
+};
+const vector<string> EN_LAST = {
+    "Orwell", "Austen", "Herbert", "Le Guin", "Bradbury", "Christie", "Hemingway", "Woolf", "Tolkien",
+    "Shelley", "Asimov", "Morrison", "Gaiman", "Atwood", "Dick"
+};
+//самые популярные теги идут первыми (получают наибольший вес по Ципфу)
+const vector<string> BASE_TAGS = {
+    "роман", "классика", "фантастика", "история", "приключения", "фэнтези", "детектив", "драма",
+    "антиутопия", "мистика", "психология", "поэзия", "комедия", "биография", "детская", "политика",
+    "триллер", "ужасы", "наука", "sci-fi", "drama", "thriller", "romance", "poetry"
+};
+
+//первая буква с заглавной (латиница и кириллица)
+string capitalize(const string& word) {
+    if (word.empty()) return word;
+    size_t pos = 0;
+    uint32_t cp = decodeUtf8(word, pos);
+    if (cp >= 'a' && cp <= 'z') cp -= 0x20;
+    else if (cp >= 0x0430 && cp <= 0x044F) cp -= 0x20; //а-я
+    else if (cp == 0x0451) cp = 0x0401; //ё
+    string result;
+    appendUtf8(result, cp);
+    result.append(word, pos, string::npos);
+    return result;
+}
+
+template <typename T>
+const T& pick(const vector<T>& items, uint64_t& state) {
+    return items[nextRandom(state) % items.size()];
+}
+
+/*------Генератор------*/
+SyntheticCatalog::SyntheticCatalog(const GeneratorConfig& config) : config_(config) {
+    int vocabulary = max(1, config_.tagVocabulary);
+    for (int i = 0; i < vocabulary; i++) {
+        tags_.push_back(i < (int)BASE_TAGS.size() ? BASE_TAGS[i] : "тег-" + to_string(i));
+    }
+
+    //вес тега k пропорционален 1 / (k + 1)^s
+    double sum = 0;
+    for (int i = 0; i < vocabulary; i++) {
+        sum += 1.0 / pow(i + 1.0, config_.zipfS);
+        tagCdf_.push_back(sum);
+    }
+    for (double& p : tagCdf_) p /= sum;
+}
+
+int SyntheticCatalog::sampleTag(uint64_t& state) const {
+    double u = nextUnit(state);
+    size_t k = upper_bound(tagCdf_.begin(), tagCdf_.end(), u) - tagCdf_.begin();
+    return (int)min(k, tagCdf_.size() - 1);
+}
+
+void SyntheticCatalog::fillBase(uint64_t index, Media& m) const {
+    uint64_t state = recordState(config_.seed, index, 1);
+    bool cyrillic = nextUnit(state) < config_.cyrillicShare;
+    const vector<string>& words = cyrillic ? RU_WORDS : EN_WORDS;
+
+    int wordCount = 1 + (int)(nextRandom(state) % 4);
+    m.title = capitalize(pick(words, state));
+    for (int w = 1; w < wordCount; w++) {
+        m.title += (wordCount == 2 && cyrillic) ? " и " : " "; //"Война и мир"
+        m.title += pick(words, state);
+    }
+    m.author = cyrillic ? pick(RU_FIRST, state) + " " + pick(RU_LAST, state)
+        : pick(EN_FIRST, state) + " " + pick(EN_LAST, state);
+    m.year = 1800 + (int)(nextRandom(state) % 225);
+}
+
+Media SyntheticCatalog::record(uint64_t index) const {
+    Media m;
+    m.id = to_string(index + 1);
+
+    uint64_t state = recordState(config_.seed, index, 2);
+    if (index > 0 && nextUnit(state) < config_.duplicateRate) {
+        //дубликат одной из предыдущих 1000 записей
+        uint64_t back = 1 + nextRandom(state) % min<uint64_t>(index, 1000);
+        fillBase(index - back, m);
+    }
+    else {
+        fillBase(index, m);
+    }
+
+    //рейтинг колоколом около 5, с одним знаком после запятой
+    double r = (nextUnit(state) + nextUnit(state) + nextUnit(state)) / 3.0 * 10.0;
+    m.rating = round(r * 10.0) / 10.0;
+
+    int tagCount = 1 + (int)(nextRandom(state) % 4);
+    for (int t = 0; t < tagCount; t++) {
+        const string& tag = tags_[sampleTag(state)];
+        if (find(m.tags.begin(), m.tags.end(), tag) == m.tags.end()) {
+            m.tags.push_back(tag);
+        }
+    }
+
+    if (nextUnit(state) < config_.invalidRate) { //портим одно поле
+        switch (nextRandom(state) % 4) {
+        case 0: m.title.clear(); break;
+        case 1: m.author.clear(); break;
+        case 2: m.year = 1700; break;
+        default: m.rating = 10.5; break;
+        }
+    }
+
+    m.cacheWidths();
+    return m;
+}
+
+vector<Media> SyntheticCatalog::generate(uint64_t first, size_t n) const {
+    vector<Media> records;
+    records.reserve(n);
+    for (uint64_t i = first; i < first + n; i++) {
+        records.push_back(record(i));
+    }
+    return records;
+}
+
+vector<Media> generateCatalog(const GeneratorConfig& config) {
+    return SyntheticCatalog(config).generate(0, (size_t)config.count);
+}
@@ -0,0 +1,349 @@
+#include "text_search.h"
+#include "catalog_index.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+
+using namespace std;
+
+/*------Основы слов------*/
+//букв в UTF-8 (байты продолжения не считаются)
+static size_t letterCount(const char* s, size_t bytes) {
+    size_t letters = 0;
+    for (size_t i = 0; i < bytes; i++) letters += ((unsigned char)s[i] & 0xC0) != 0x80;
+    return letters;
+}
+
+string stemWord(const string& word) {
+    //сначала длинные окончания; после отрезания должно остаться не меньше трех букв
+    static const char* russian[] = {
+        "ями", "ами", "ого", "его", "ому", "ему", "ыми", "ими", "иях", "ией",
+        "ах", "ях", "ов", "ев", "ей", "ой", "ий", "ый", "ая", "яя", "ое", "ее", "ые", "ие",
+        "ую", "юю", "ом", "ем", "ам", "ям", "ых", "их", "ия",
+        "а", "я", "о", "е", "ы", "и", "у", "ю", "ь", "й",
+    };
+    size_t letters = letterCount(word.data(), word.size());
+    for (const char* ending : russian) {
+        size_t bytes = strlen(ending);
+        if (word.size() > bytes && word.compare(word.size() - bytes, bytes, ending) == 0 &&
+            letters - letterCount(ending, bytes) >= 3) {
+            return word.substr(0, word.size() - bytes);
+        }
+    }
+    //английский: ies -> i, sses -> ss, s (кроме ss, us) и ing
+    auto endsWith = [&](const char* ending) {
+        size_t bytes = strlen(ending);
+        return word.size() > bytes && word.compare(word.size() - bytes, bytes, ending) == 0;
+    };
+    if (endsWith("ies") && letters >= 5) return word.substr(0, word.size() - 2);
+    if (endsWith("sses")) return word.substr(0, word.size() - 2);
+    if (endsWith("ing") && letters >= 6) return word.substr(0, word.size() - 3);
+    if (endsWith("s") && !endsWith("ss") && !endsWith("us") && letters >= 4) return word.substr(0, word.size() - 1);
+    return word;
+}
+
+vector<string> textTerms(const string& text) {
+    vector<string> terms = splitWords(text);
+    for (string& term : terms) term = stemWord(term);
+    return terms;
+}
+
+//основы записи: название и автор
+static vector<string> recordTerms(const Media& item) {
+    vector<string> terms = textTerms(item.title);
+    vector<string> author = textTerms(item.author);
+    terms.insert(terms.end(), author.begin(), author.end());
+    return terms;
+}
+
+/*------Построение------*/
+shared_ptr<const TextIndex> TextIndex::build(MediaSpan catalog, uint64_t base) {
+    TRACE_SCOPE("text/build");
+    auto index = make_shared<TextIndex>();
+    index->rows_ = catalog.size();
+    index->base_ = base;
+    index->lengths_.reserve(catalog.size());
+    index->ratings_.reserve(catalog.size());
+
+    //списки (строка, tf) по основам; строки идут по порядку, поэтому списки отсортированы
+    vector<vector<pair<uint32_t, uint16_t>>> lists;
+    size_t totalLength = 0;
+    for (size_t i = 0; i < catalog.size(); i++) {
+        vector<string> terms = recordTerms(catalog[i]);
+        index->lengths_.push_back((uint16_t)min<size_t>(terms.size(), UINT16_MAX));
+        index->ratings_.push_back((float)catalog[i].rating);
+        totalLength += terms.size();
+        for (const string& term : terms) {
+            auto it = index->slots_.emplace(term, (uint32_t)lists.size()).first;
+            if (it->second == lists.size()) lists.emplace_back();
+            vector<pair<uint32_t, uint16_t>>& list = lists[it->second];
+            if (!list.empty() && list.back().first == (uint32_t)i) {
+                if (list.back().second < UINT16_MAX) list.back().second++;
+            }
+            else list.push_back({ (uint32_t)i, 1 });
+        }
+    }
+    index->averageLength_ = catalog.empty() ? 0 : (double)totalLength / catalog.size();
+
+    index->offsets_.reserve(lists.size() + 1);
+    index->offsets_.push_back(0);
+    index->firstBlock_.push_back(0);
+    index->maxScores_.reserve(lists.size());
+    for (vector<pair<uint32_t, uint16_t>>& list : lists) {
+        float best = 0;
+        for (size_t p = 0; p < list.size(); p++) {
+            uint32_t row = list[p].first;
+            index->postings_.push_back(row);
+            index->freqs_.push_back(list[p].second);
+            float score = (float)index->termScore(1, list[p].second, index->lengths_[row]);
+            best = max(best, score);
+            if (p % TEXT_BLOCK == 0) index->blocks_.push_back({ row, score, index->ratings_[row], index->ratings_[row] });
+            Block& block = index->blocks_.back();
+            block.last = row;
+            block.maxScore = max(block.maxScore, score);
+            block.maxRating = max(block.maxRating, index->ratings_[row]);
+            block.restRating = block.maxRating;
+        }
+        for (size_t b = index->blocks_.size() - 1, first = index->firstBlock_.back(); b > first; b--) {
+            index->blocks_[b - 1].restRating = max(index->blocks_[b - 1].maxRating, index->blocks_[b].restRating);
+        }
+        index->maxScores_.push_back(best);
+        index->offsets_.push_back((uint32_t)index->postings_.size());
+        index->firstBlock_.push_back((uint32_t)index->blocks_.size());
+        vector<pair<uint32_t, uint16_t>>().swap(list);
+    }
+    return index;
+}
+
+double TextIndex::termScore(double idf, uint32_t tf, uint32_t length) const {
+    double norm = K1 * (1 - B + B * length / max(averageLength_, 1e-9));
+    return idf * tf * (K1 + 1) / (tf + norm);
+}
+
+vector<TextIndex::Term> TextIndex::queryTerms(const string& text) const {
+    vector<Term> terms;
+    for (const string& term : textTerms(text)) {
+        auto it = slots_.find(term);
+        if (it == slots_.end()) continue;
+        bool seen = false;
+        for (const Term& t : terms) seen = seen || t.id == it->second;
+        if (seen) continue;
+        double df = offsets_[it->second + 1] - offsets_[it->second];
+        terms.push_back({ it->second, log(1 + (rows_ - df + 0.5) / (df + 0.5)) });
+    }
+    return terms;
+}
+
+double TextIndex::score(const Media& item, const vector<string>& terms, double weight) const {
+    vector<string> words = recordTerms(item);
+    double total = weight * item.rating / 10;
+    bool found = false;
+    for (size_t t = 0; t < terms.size(); t++) {
+        if (find(terms.begin(), terms.begin() + t, terms[t]) != terms.begin() + t) continue; //повтор в запросе
+        uint32_t tf = (uint32_t)count(words.begin(), words.end(), terms[t]);
+        if (tf == 0) continue;
+        auto it = slots_.find(terms[t]);
+        double df = it == slots_.end() ? 0 : offsets_[it->second + 1] - offsets_[it->second];
+        total += termScore(log(1 + (rows_ - df + 0.5) / (df + 0.5)), tf, (uint32_t)words.size());
+        found = true;
+    }
+    return found ? total : -1;
+}
+
+/*------Поиск------*/
+//лучше: больше оценка, при равной - меньше строка
+static bool betterMatch(const TextMatch& a, const TextMatch& b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.row < b.row;
+}
+
+vector<TextMatch> TextIndex::search(const string& text, size_t k, double weight, TextSearchStats* stats) const {
+    TRACE_SCOPE("text/wand");
+    vector<TextMatch> result;
+    vector<Term> terms = queryTerms(text);
+    if (k == 0 || terms.empty()) return result;
+
+    struct Cursor {
+        const uint32_t* row;
+        const uint32_t* end;
+        const uint16_t* freq; //tf строки *row
+        double idf;
+        double bound;         //верхняя граница вклада основы
+        size_t term;          //номер основы в запросе
+        const uint32_t* first;
+        const Block* blocks;  //блоки списка
+        const Block* blocksEnd;
+    };
+    vector<Cursor> cursors;
+    for (const Term& t : terms) {
+        const uint32_t* first = postings_.data() + offsets_[t.id];
+        //граница с запасом на округление: запись с равной оценкой не должна потеряться
+        double bound = t.idf * maxScores_[t.id] * (1 + 1e-6) + 1e-9;
+        cursors.push_back({ first, postings_.data() + offsets_[t.id + 1], freqs_.data() + offsets_[t.id], t.idf, bound,
+            cursors.size(), first, blocks_.data() + firstBlock_[t.id], blocks_.data() + firstBlock_[t.id + 1] });
+        if (stats) stats->postings += offsets_[t.id + 1] - offsets_[t.id];
+    }
+    const uint32_t DONE = numeric_limits<uint32_t>::max();
+    auto rowOf = [&](const Cursor& c) { return c.row == c.end ? DONE : *c.row; };
+
+    //на вершине - худшая из k лучших
+    auto worse = [](const TextMatch& a, const TextMatch& b) { return betterMatch(a, b); };
+    priority_queue<TextMatch, vector<TextMatch>, decltype(worse)> heap(worse);
+    while (true) {
+        //на одной записи - в порядке основ запроса, чтобы сумма оценки не зависела от порядка обхода;
+        //курсоров мало и сдвинулись только передние - сортировка вставками
+        for (size_t i = 1; i < cursors.size(); i++) {
+            for (size_t j = i; j > 0; j--) {
+                uint32_t a = rowOf(cursors[j - 1]), b = rowOf(cursors[j]);
+                if (a < b || (a == b && cursors[j - 1].term < cursors[j].term)) break;
+                swap(cursors[j - 1], cursors[j]);
+            }
+        }
+        while (!cursors.empty() && rowOf(cursors.back()) == DONE) cursors.pop_back();
+        if (cursors.empty()) break;
+
+        //опорная основа: первая, на которой сумма границ может обогнать k-ю запись; запись
+        //до строки основы i + 1 есть только в списках 0..i, и ее рейтинг не больше
+        //наибольшего в их непройденных блоках
+        double threshold = heap.size() == k ? heap.top().score : -numeric_limits<double>::infinity();
+        double bound = 0;
+        float restRating = 0;
+        size_t pivot = cursors.size();
+        for (size_t i = 0; i < cursors.size(); i++) {
+            const Cursor& c = cursors[i];
+            bound += c.bound;
+            restRating = max(restRating, c.blocks[(c.row - c.first) / TEXT_BLOCK].restRating);
+            if (bound + weight * max(restRating, 0.0f) / 10 * (1 + 1e-6) + 1e-9 > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == cursors.size()) break; //ни одна оставшаяся запись не попадет в первые k
+        uint32_t row = rowOf(cursors[pivot]);
+        while (pivot + 1 < cursors.size() && rowOf(cursors[pivot + 1]) == row) pivot++;
+
+        //Block-Max: границы блоков, где лежит опорная запись, точнее границ основ; если и
+        //с ними порог не взять, ни одна запись до конца этих блоков его не возьмет
+        if (heap.size() == k) {
+            double blockBound = 0;
+            float blockRating = 0;
+            uint32_t next = pivot + 1 < cursors.size() ? rowOf(cursors[pivot + 1]) : DONE;
+            for (size_t i = 0; i <= pivot; i++) {
+                const Cursor& c = cursors[i];
+                const Block* from = c.blocks + (c.row - c.first) / TEXT_BLOCK;
+                const Block* block = lower_bound(from, c.blocksEnd, row, [](const Block& b, uint32_t r) { return b.last < r; });
+                if (block == c.blocksEnd) continue; //в списке нет строк от опорной и дальше
+                blockBound += c.idf * block->maxScore;
+                blockRating = max(blockRating, block->maxRating);
+                next = min(next, block->last + 1);
+            }
+            blockBound = (blockBound + weight * blockRating / 10) * (1 + 1e-6) + 1e-9;
+            if (blockBound <= threshold) {
+                uint32_t target = max(next, row + 1);
+                for (size_t i = 0; i <= pivot; i++) {
+                    Cursor& c = cursors[i];
+                    const uint32_t* moved = gallop(c.row, c.end, target);
+                    c.freq += moved - c.row;
+                    c.row = moved;
+                }
+                continue;
+            }
+        }
+
+        if (rowOf(cursors[0]) == row) {
+            //все основы до опорной стоят на этой записи - считаем полную оценку
+            double score = weight * ratings_[row] / 10;
+            for (Cursor& c : cursors) {
+                if (rowOf(c) != row) break;
+                score += termScore(c.idf, *c.freq, lengths_[row]);
+                c.row++;
+                c.freq++;
+            }
+            if (stats) stats->scored++;
+            TextMatch match{ row, score };
+            if (heap.size() < k) heap.push(match);
+            else if (betterMatch(match, heap.top())) {
+                heap.pop();
+                heap.push(match);
+            }
+        }
+        else {
+            //записи до опорной не наберут порога - перепрыгиваем их в списках основ до опорной
+            for (size_t i = 0; i < pivot; i++) {
+                Cursor& c = cursors[i];
+                const uint32_t* next = gallop(c.row, c.end, row);
+                c.freq += next - c.row;
+                c.row = next;
+            }
+        }
+    }
+    for (; !heap.empty(); heap.pop()) result.push_back(heap.top());
+    reverse(result.begin(), result.end());
+    return result;
+}
+
+vector<TextMatch> TextIndex::searchExhaustive(const string& text, size_t k, double weight) const {
+    TRACE_SCOPE("text/exhaustive");
+    vector<TextMatch> result;
+    vector<Term> terms = queryTerms(text);
+    if (k == 0 || terms.empty()) return result;
+    vector<double> scores(rows_, 0);
+    vector<uint8_t> seen(rows_, 0);
+    vector<uint32_t> touched;
+    for (const Term& t : terms) {
+        for (uint32_t p = offsets_[t.id]; p < offsets_[t.id + 1]; p++) {
+            uint32_t row = postings_[p];
+            if (!seen[row]) {
+                seen[row] = 1;
+                touched.push_back(row);
+                scores[row] = weight * ratings_[row] / 10;
+            }
+            scores[row] += termScore(t.idf, freqs_[p], lengths_[row]);
+        }
+    }
+    for (uint32_t row : touched) result.push_back({ row, scores[row] });
+    size_t keep = min(k, result.size());
+    partial_sort(result.begin(), result.begin() + keep, result.end(), betterMatch);
+    result.resize(keep);
+    return result;
+}
+
+vector<size_t> textRows(const vector<TextMatch>& matches) {
+    vector<size_t> rows;
+    rows.reserve(matches.size());
+    for (const TextMatch& m : matches) rows.push_back(m.row);
+    return rows;
+}
+
+/*------Индекс для цепочки версий------*/
+vector<TextMatch> TextIndexHolder::search(const CatalogSnapshot& snapshot, const string& text, size_t k, double weight) {
+    OpTimer timer(Op::TextSearch);
+    MediaSpan catalog = snapshot.records();
+    vector<TextMatch> result;
+    if (catalog.empty() || k == 0) return result;
+
+    shared_ptr<const TextIndex> index = index_.get(snapshot, [&] { return TextIndex::build(catalog, snapshot.base()); });
+    //снимок старше общего индекса той же цепочки: оценки BM25 зависят от статистики всех
+    //строк, поэтому у него свой индекс (строится вне общего, другие запросы не ждут)
+    if (!index) index = TextIndex::build(catalog, snapshot.base());
+    result = index->search(text, k, weight);
+
+    //строки после индекса - по статистике индекса
+    if (index->rows() < catalog.size()) {
+        TRACE_SCOPE("text/tail");
+        vector<string> terms = textTerms(text);
+        for (size_t i = index->rows(); i < catalog.size(); i++) {
+            double score = index->score(catalog[i], terms, weight);
+            if (score >= 0) result.push_back({ i, score });
+        }
+        sort(result.begin(), result.end(), betterMatch);
+        if (result.size() > k) result.resize(k);
+    }
+    timer.setRecords(result.size());
+    return result;
+}
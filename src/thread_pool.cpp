@@ -0,0 +1,117 @@
+#include "thread_pool.h"
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+//номер текущего потока в пуле (-1 - поток не из пула)
+thread_local int workerIndex = -1;
+thread_local ThreadPool* workerPool = nullptr;
+
+ThreadPool::ThreadPool(int workers, bool pin) {
+    if (workers <= 0) workers = max(1u, thread::hardware_concurrency());
+    for (int i = 0; i < workers; i++) {
+        queues_.push_back(make_unique<WorkerQueue>());
+    }
+    for (int i = 0; i < workers; i++) {
+        threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+#ifdef __linux__
+        if (pin) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % max(1u, thread::hardware_concurrency()), &cpus);
+            pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpus), &cpus);
+        }
+#else
+        (void)pin;
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleepLock_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (thread& t : threads_) t.join();
+}
+
+void ThreadPool::submit(function<void()> task) {
+    size_t index = (workerPool == this) ? (size_t)workerIndex
+        : nextQueue_.fetch_add(1, memory_order_relaxed) % queues_.size();
+    {
+        lock_guard<mutex> lock(queues_[index]->lock);
+        queues_[index]->tasks.push_back(move(task));
+    }
+    pending_.fetch_add(1, memory_order_release);
+    {
+        lock_guard<mutex> lock(sleepLock_); //чтобы не потерять пробуждение между проверкой и wait
+    }
+    wake_.notify_one();
+}
+
+//свои задачи - с конца (последние поставленные, их данные еще в кэше)
+bool ThreadPool::popLocal(int index, function<void()>& task) {
+    WorkerQueue& queue = *queues_[index];
+    lock_guard<mutex> lock(queue.lock);
+    if (queue.tasks.empty()) return false;
+    task = move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+//чужие - с начала (самые старые, обычно самые крупные куски)
+bool ThreadPool::steal(int thief, function<void()>& task) {
+    int count = (int)queues_.size();
+    for (int k = 1; k <= count; k++) {
+        WorkerQueue& queue = *queues_[(thief + k) % count];
+        lock_guard<mutex> lock(queue.lock);
+        if (queue.tasks.empty()) continue;
+        task = move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::runPending() {
+    if (pending_.load(memory_order_acquire) == 0) return false;
+    function<void()> task;
+    int self = (workerPool == this) ? workerIndex : 0;
+    bool found = (workerPool == this && popLocal(self, task)) || steal(self, task);
+    if (!found) return false;
+    pending_.fetch_sub(1, memory_order_relaxed);
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(int index) {
+    workerIndex = index;
+    workerPool = this;
+    while (true) {
+        attachPerfCounters(); //после включения замеров поток считает и свою работу (бенчмарк)
+        if (runPending()) continue;
+        unique_lock<mutex> lock(sleepLock_);
+        wake_.wait(lock, [this] { return stopping_ || pending_.load(memory_order_acquire) > 0; });
+        if (stopping_ && pending_.load(memory_order_acquire) == 0) return;
+    }
+}
+
+/*------Общий пул------*/
+int poolWorkers = 0;
+bool poolPin = false;
+
+void configureThreadPool(int workers, bool pin) {
+    poolWorkers = workers;
+    poolPin = pin;
+}
+
+ThreadPool& threadPool() {
+    static ThreadPool pool(poolWorkers, poolPin);
+    return pool;
+}
@@ -0,0 +1,94 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> traceEnabled{ false };
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+//буфер событий одного потока; блокировка почти всегда свободна
+//(ее берет только владелец и stopTrace)
+struct TraceBuffer {
+    int tid = 0;
+    mutex lock;
+    vector<TraceEvent> events;
+};
+
+mutex traceMutex;
+vector<unique_ptr<TraceBuffer>> traceBuffers; //буферы не удаляются, как и копии метрик
+string traceFile;
+uint64_t traceStart = 0;
+
+uint64_t traceNow() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TraceBuffer& localTraceBuffer() {
+    thread_local TraceBuffer* buffer = nullptr;
+    if (!buffer) {
+        lock_guard<mutex> lock(traceMutex);
+        traceBuffers.push_back(make_unique<TraceBuffer>());
+        buffer = traceBuffers.back().get();
+        buffer->tid = (int)traceBuffers.size();
+    }
+    return *buffer;
+}
+
+void recordSpan(const char* name, uint64_t startNs, uint64_t endNs) {
+    TraceBuffer& buffer = localTraceBuffer();
+    lock_guard<mutex> lock(buffer.lock);
+    buffer.events.push_back({ name, startNs, endNs });
+}
+
+bool startTrace(const string& filename) {
+    lock_guard<mutex> lock(traceMutex);
+    traceFile = filename;
+    traceStart = traceNow();
+    for (auto& buffer : traceBuffers) {
+        lock_guard<mutex> bufferLock(buffer->lock);
+        buffer->events.clear();
+    }
+    traceEnabled.store(true, memory_order_relaxed);
+    return true;
+}
+
+//отрезки пишутся как полные события ("ph": "X"), время - в микросекундах от startTrace
+bool stopTrace() {
+    if (!traceEnabled.exchange(false)) return true;
+    lock_guard<mutex> lock(traceMutex);
+
+    string tmpName = traceFile + ".tmp";
+    ofstream file(tmpName);
+    if (!file.is_open()) return false;
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"LR\"}}";
+    char line[256];
+    for (auto& buffer : traceBuffers) {
+        lock_guard<mutex> bufferLock(buffer->lock);
+        for (const TraceEvent& e : buffer->events) {
+            if (e.start < traceStart) continue; //отрезок начался до включения трассировки
+            snprintf(line, sizeof(line),
+                ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                e.name, buffer->tid, (e.start - traceStart) / 1e3, (e.end - e.start) / 1e3);
+            file << line;
+        }
+        buffer->events.clear();
+    }
+    file << "\n]}\n";
+    file.close();
+    if (!file) return false;
+    return rename(tmpName.c_str(), traceFile.c_str()) == 0;
+}
@@ -0,0 +1,154 @@
+#include "workload.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>        // замеры задержек при воспроизведении нагрузки
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+/*------Воспроизведение нагрузки------*/
+
+//читает файл нагрузки; строки с ошибками пропускаются с сообщением
+vector<WorkloadQuery> loadWorkload(const string& filename) {
+    vector<WorkloadQuery> queries;
+    ifstream file(filename);
+    if (!file.is_open()) {
+        logOut() << "Ошибка: не могу открыть файл " << filename << "\n";
+        return queries;
+    }
+
+    string line;
+    int lineNo = 0;
+    while (getline(file, line)) {
+        lineNo++;
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        map<string, string> fields;
+        if (!parseJsonObject(line, fields) || !fields.count("op")) {
+            logOut() << "Ошибка: строка " << lineNo << " файла нагрузки не разобрана\n";
+            continue;
+        }
+        WorkloadQuery q;
+        q.op = fields["op"];
+        if (q.op == "search") q.text = fields["text"];
+        else if (q.op == "tag") q.text = fields["tag"];
+        else if (q.op == "top") q.n = fields.count("n") ? atoi(fields["n"].c_str()) : 10;
+        else if (q.op != "stats" && q.op != "dups") {
+            logOut() << "Ошибка: неизвестная операция '" << q.op << "' в строке " << lineNo << "\n";
+            continue;
+        }
+        queries.push_back(q);
+    }
+    return queries;
+}
+
+//выполняет запрос над каталогом; возвращает размер результата
+size_t runQuery(MediaSpan catalog, const WorkloadQuery& q) {
+    if (q.op == "search") return findBySubstring(catalog, q.text).size();
+    if (q.op == "tag") return findByTag(catalog, q.text).size();
+    if (q.op == "top") return getTopN(catalog, q.n).size();
+    if (q.op == "dups") return collectDuplicates(catalog).size();
+    return computeStatistics(catalog).total;
+}
+
+//перцентиль по отсортированным значениям (ближайший ранг)
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)ceil(p * sorted.size());
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+//прогоняет нагрузку по каталогу в threads потоков.
+//rate > 0 - открытая модель: запрос i планируется на момент start + i/rate, и задержка
+//считается от запланированного момента (очередь перед запросом тоже попадает в задержку);
+//rate == 0 - на полной скорости, задержка считается от фактического начала запроса
+void replayWorkload(CatalogStore& store, const vector<WorkloadQuery>& queries,
+    int threads, double rate, int repeat, const string& importFile, size_t importBatch) {
+    using Clock = chrono::steady_clock;
+
+    vector<Media> imported;
+    if (!importFile.empty()) imported = loadFromFile(importFile);
+
+    ostream* savedLog = logStream;
+    static ostream nullStream(nullptr); //сообщения запросов в замерах не нужны
+    logStream = &nullStream;
+
+    size_t total = queries.size() * repeat;
+    vector<map<string, vector<double>>> perThread(threads); //задержки в мкс по операциям
+    Clock::time_point start = Clock::now();
+
+    auto worker = [&](int t) {
+        for (size_t i = t; i < total; i += threads) {
+            const WorkloadQuery& q = queries[i % queries.size()];
+            Clock::time_point begin = Clock::now();
+            if (rate > 0) {
+                Clock::time_point planned = start + chrono::duration_cast<Clock::duration>(
+                    chrono::duration<double>(i / rate));
+                this_thread::sleep_until(planned);
+                begin = planned;
+            }
+            {
+                CatalogSnapshot snapshot = store.snapshot(); //без блокировок, даже во время импорта
+                runQuery(snapshot.records(), q);
+            }
+            perThread[t][q.op].push_back(
+                chrono::duration<double, micro>(Clock::now() - begin).count());
+        }
+    };
+
+    //писатель: вставляет импортируемые записи пачками, по версии каталога на пачку
+    size_t versions = 0;
+    double importSeconds = 0;
+    auto importer = [&] {
+        Clock::time_point importStart = Clock::now();
+        for (size_t i = 0; i < imported.size(); i += max<size_t>(importBatch, 1)) {
+            size_t end = min(imported.size(), i + max<size_t>(importBatch, 1));
+            vector<Media> batch(make_move_iterator(imported.begin() + i), make_move_iterator(imported.begin() + end));
+            if (store.insertBatch(move(batch)) > 0) versions++;
+        }
+        importSeconds = chrono::duration<double>(Clock::now() - importStart).count();
+    };
+
+    vector<thread> pool;
+    if (!imported.empty()) pool.emplace_back(importer);
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (thread& th : pool) th.join();
+    store.reclaim();
+
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    logStream = savedLog;
+
+    //сводим задержки потоков и выводим по операциям
+    map<string, vector<double>> byOp;
+    for (auto& m : perThread) {
+        for (auto& kv : m) {
+            byOp[kv.first].insert(byOp[kv.first].end(), kv.second.begin(), kv.second.end());
+        }
+    }
+    char line[256];
+    for (auto& kv : byOp) {
+        vector<double>& lat = kv.second;
+        sort(lat.begin(), lat.end());
+        snprintf(line, sizeof(line),
+            "{\"op\": \"%s\", \"count\": %zu, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+            "\"p999_us\": %.1f, \"max_us\": %.1f}\n",
+            kv.first.c_str(), lat.size(), percentile(lat, 0.50), percentile(lat, 0.99),
+            percentile(lat, 0.999), lat.back());
+        cout << line;
+    }
+    snprintf(line, sizeof(line),
+        "{\"total\": %zu, \"threads\": %d, \"seconds\": %.3f, \"qps\": %.1f}\n",
+        total, threads, seconds, seconds > 0 ? total / seconds : 0.0);
+    cout << line;
+    if (!imported.empty()) {
+        snprintf(line, sizeof(line),
+            "{\"imported_versions\": %zu, \"import_seconds\": %.3f, \"records\": %zu}\n",
+            versions, importSeconds, store.snapshot().records().size());
+        cout << line;
+    }
+}
@@ -0,0 +1,133 @@
+#include "year_index.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/*------Индекс------*/
+void YearIndex::add(int year, uint32_t row) {
+    if (byYear_.empty()) {
+        first_ = minYear_ = maxYear_ = year;
+        byYear_.resize(1);
+        tree_.assign(2, 0);
+    }
+    else if (year < first_ || year >= first_ + (int)byYear_.size()) {
+        //год за пределами слотов: раздвигаем их и пересчитываем дерево (редко - годы ограничены)
+        int last = first_ + (int)byYear_.size() - 1;
+        int newFirst = min(first_, year), newLast = max(last, year);
+        vector<vector<uint32_t>> grown((size_t)(newLast - newFirst) + 1);
+        for (size_t s = 0; s < byYear_.size(); s++) grown[s + (first_ - newFirst)] = move(byYear_[s]);
+        byYear_.swap(grown);
+        first_ = newFirst;
+        rebuildTree();
+    }
+    size_t slot = (size_t)(year - first_);
+    byYear_[slot].push_back(row);
+    size_++;
+    for (size_t i = slot + 1; i < tree_.size(); i += i & (~i + 1)) tree_[i]++;
+    minYear_ = min(minYear_, year);
+    maxYear_ = max(maxYear_, year);
+}
+
+void YearIndex::clear() {
+    *this = YearIndex();
+}
+
+void YearIndex::rebuildTree() {
+    size_t n = byYear_.size();
+    tree_.assign(n + 1, 0);
+    for (size_t i = 1; i <= n; i++) {
+        tree_[i] += byYear_[i - 1].size();
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= n) tree_[parent] += tree_[i];
+    }
+}
+
+size_t YearIndex::prefix(long long slot) const {
+    if (slot < 0) return 0;
+    if (slot >= (long long)byYear_.size()) return size_;
+    size_t sum = 0;
+    for (size_t i = (size_t)slot + 1; i > 0; i -= i & (~i + 1)) sum += tree_[i];
+    return sum;
+}
+
+size_t YearIndex::count(int from, int to) const {
+    if (size_ == 0 || from > to) return 0;
+    return prefix((long long)to - first_) - prefix((long long)from - first_ - 1);
+}
+
+vector<uint32_t> YearIndex::rows(int from, int to) const {
+    vector<uint32_t> result;
+    if (count(from, to) == 0) return result;
+    size_t lo = (size_t)max(0LL, (long long)from - first_);
+    size_t hi = (size_t)min((long long)byYear_.size() - 1, (long long)to - first_);
+    result.reserve(count(from, to));
+    size_t years = 0;
+    for (size_t s = lo; s <= hi; s++) {
+        if (byYear_[s].empty()) continue;
+        result.insert(result.end(), byYear_[s].begin(), byYear_[s].end());
+        years++;
+    }
+    if (years > 1) sort(result.begin(), result.end()); //внутри года строки уже по возрастанию
+    return result;
+}
+
+vector<YearBucket> yearHistogram(const YearIndex& index, int from, int to, int step) {
+    vector<YearBucket> buckets;
+    if (index.size() == 0) return buckets;
+    //за пределами известных лет столбцы пустые - их не выводим
+    from = max(from, index.minYear());
+    to = min(to, index.maxYear());
+    if (from > to) return buckets; //диапазон пуст или целиком вне известных лет
+    step = max(step, 1);
+    long long start = (long long)from - (((long long)from % step) + step) % step; //кратно step вниз
+    for (long long b = start; b <= to; b += step) {
+        YearBucket bucket;
+        bucket.from = (int)max<long long>(b, from);
+        bucket.to = (int)min<long long>(b + step - 1, to);
+        bucket.count = index.count(bucket.from, bucket.to);
+        buckets.push_back(bucket);
+    }
+    return buckets;
+}
+
+/*------Индекс для цепочки версий------*/
+bool YearIndexHolder::sync(const CatalogSnapshot& snapshot) {
+    MediaSpan catalog = snapshot.records();
+    if (base_ != snapshot.base()) { //другая цепочка (каталог заменен) - строим заново
+        index_.clear();
+        base_ = snapshot.base();
+    }
+    if (index_.size() > catalog.size()) return false;
+    for (size_t i = index_.size(); i < catalog.size(); i++) index_.add(catalog[i].year, (uint32_t)i);
+    return true;
+}
+
+YearIndex buildYearIndex(MediaSpan catalog) {
+    YearIndex index;
+    for (size_t i = 0; i < catalog.size(); i++) index.add(catalog[i].year, (uint32_t)i);
+    return index;
+}
+
+vector<size_t> YearIndexHolder::rows(const CatalogSnapshot& snapshot, int from, int to) {
+    OpTimer timer(Op::YearIndex);
+    TRACE_SCOPE("yearRange");
+    vector<uint32_t> rows;
+    {
+        lock_guard<mutex> lock(lock_);
+        if (sync(snapshot)) rows = index_.rows(from, to);
+        else rows = buildYearIndex(snapshot.records()).rows(from, to);
+    }
+    timer.setRecords(rows.size());
+    return vector<size_t>(rows.begin(), rows.end());
+}
+
+vector<YearBucket> YearIndexHolder::histogram(const CatalogSnapshot& snapshot, int from, int to, int step) {
+    OpTimer timer(Op::YearIndex);
+    TRACE_SCOPE("yearHistogram");
+    lock_guard<mutex> lock(lock_);
+    if (sync(snapshot)) return yearHistogram(index_, from, to, step);
+    return yearHistogram(buildYearIndex(snapshot.records()), from, to, step);
+}
@@ -0,0 +1,84 @@
+#include "zone_map.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+using namespace std;
+
+uint64_t tagBit(const string& tag) {
+    return 1ull << (hash<string>()(tag) % 64);
+}
+
+ZoneMap buildZoneMap(MediaSpan catalog) {
+    TRACE_SCOPE("index/zones");
+    ZoneMap map;
+    map.rows = catalog.size();
+    map.zones.resize((catalog.size() + ZONE_ROWS - 1) / ZONE_ROWS);
+    size_t count = map.zones.size();
+    size_t perChunk = runSequential(catalog.size()) ? max<size_t>(count, 1) : chunkSize(count, 1);
+    runChunks((count + perChunk - 1) / perChunk, [&](size_t c) {
+        for (size_t z = c * perChunk; z < min(count, (c + 1) * perChunk); z++) {
+            Zone& zone = map.zones[z];
+            size_t begin = z * ZONE_ROWS, end = min(catalog.size(), begin + ZONE_ROWS);
+            zone.minYear = zone.maxYear = catalog[begin].year;
+            zone.minRating = zone.maxRating = catalog[begin].rating;
+            for (size_t i = begin; i < end; i++) {
+                const Media& m = catalog[i];
+                zone.minYear = min(zone.minYear, m.year);
+                zone.maxYear = max(zone.maxYear, m.year);
+                zone.minRating = min(zone.minRating, m.rating);
+                zone.maxRating = max(zone.maxRating, m.rating);
+                for (const string& tag : m.tags) zone.tagMask |= tagBit(tag);
+            }
+        }
+    });
+    return map;
+}
+
+vector<size_t> topRowsByZones(MediaSpan catalog, const ZoneMap& zones, size_t k,
+    bool descending, const function<void(size_t, size_t, vector<uint32_t>&)>& select) {
+    TRACE_SCOPE("topRowsByZones");
+    vector<size_t> result;
+    if (k == 0) return result;
+    auto better = [&](size_t a, size_t b) {
+        double x = catalog[a].rating, y = catalog[b].rating;
+        if (x != y) return descending ? x > y : x < y;
+        return a < b;
+    };
+    //блоки от лучшей границы рейтинга, при равных границах - по порядку
+    vector<size_t> order(zones.zones.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        double x = descending ? zones.zones[a].maxRating : zones.zones[a].minRating;
+        double y = descending ? zones.zones[b].maxRating : zones.zones[b].minRating;
+        if (x != y) return descending ? x > y : x < y;
+        return a < b;
+    });
+
+    //на вершине - худшая из k лучших
+    priority_queue<size_t, vector<size_t>, decltype(better)> heap(better);
+    vector<uint32_t> rows;
+    for (size_t z : order) {
+        size_t first = z * ZONE_ROWS;
+        if (heap.size() == k) {
+            //следующие блоки не лучше этого: если этот не может дать строку лучше k-й, заканчиваем
+            double bound = descending ? zones.zones[z].maxRating : zones.zones[z].minRating;
+            double worst = catalog[heap.top()].rating;
+            if ((descending ? bound < worst : bound > worst) || (bound == worst && first > heap.top())) break;
+        }
+        rows.clear();
+        select(first, min(zones.rows, first + ZONE_ROWS), rows);
+        for (uint32_t row : rows) {
+            if (heap.size() < k) heap.push(row);
+            else if (better(row, heap.top())) {
+                heap.pop();
+                heap.push(row);
+            }
+        }
+    }
+    for (; !heap.empty(); heap.pop()) result.push_back(heap.top());
+    return result;
+}
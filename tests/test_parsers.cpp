@@ -0,0 +1,150 @@
+//Разбор входного потока соединения: запросы не должны зависеть от того, как поток
+//поделен на чтения. Каждый поток подается целиком, по одному байту и кусками случайной
+//длины; результат должен совпасть с ожидаемым списком запросов, а недочитанный конец -
+//остаться в буфере. Кадры (server.h): нулевая длина, длина, разрезанная между чтениями,
+//несколько кадров в одном буфере, кадр ровно MAX_FRAME и отказ на MAX_FRAME + 1. HTTP
+//(http_server.h): конвейер запросов с телами и пустыми строками между ними, HTTP/1.0,
+//запрос без Content-Length, неверный и слишком большой Content-Length, Transfer-Encoding,
+//слишком длинный заголовок.
+
+#include "server.h"
+#include "http_server.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int failures = 0, checks = 0;
+
+void check(bool ok, const string& what) {
+    checks++;
+    if (!ok) {
+        failures++;
+        cerr << "Ошибка: " << what << "\n";
+    }
+}
+
+//подает stream парсеру кусками по длинам из split (последний кусок - остаток);
+//false - парсер отказался от потока
+bool feed(const RequestParser& parser, const string& stream, const vector<size_t>& split,
+    vector<string>& requests, string& rest) {
+    rest.clear();
+    size_t pos = 0;
+    for (size_t i = 0; pos < stream.size(); i++) {
+        size_t length = i < split.size() ? split[i] : stream.size() - pos;
+        rest.append(stream, pos, length);
+        pos += length;
+        if (!parser(rest, requests)) return false;
+    }
+    return true;
+}
+
+//stream целиком, по байту и случайными кусками дает expected и оставляет rest
+void checkSplits(const RequestParser& parser, const string& name, const string& stream,
+    const vector<string>& expected, const string& rest) {
+    mt19937 random(7);
+    vector<vector<size_t>> splits = { {}, vector<size_t>(stream.size(), 1) };
+    for (int k = 0; k < 20; k++) {
+        vector<size_t> split;
+        for (size_t total = 0; total < stream.size();) {
+            split.push_back(1 + random() % 700);
+            total += split.back();
+        }
+        splits.push_back(split);
+    }
+    for (const vector<size_t>& split : splits) {
+        vector<string> requests;
+        string left;
+        bool ok = feed(parser, stream, split, requests, left);
+        check(ok && requests == expected && left == rest,
+            name + " (кусков " + to_string(split.empty() ? 1 : split.size()) + ")");
+    }
+}
+
+/*------Кадры------*/
+string frame(const string& json) {
+    uint32_t n = (uint32_t)json.size();
+    string out = { (char)(n >> 24), (char)(n >> 16), (char)(n >> 8), (char)n };
+    return out + json;
+}
+
+void testFrames() {
+    string a = "{\"op\": \"stats\"}";
+    string b = "{\"op\": \"search\", \"text\": \"мир\"}";
+    checkSplits(parseFrames, "один кадр", frame(a), { a }, "");
+    checkSplits(parseFrames, "пустой кадр", frame(""), { "" }, "");
+    checkSplits(parseFrames, "кадры подряд", frame(a) + frame("") + frame(b), { a, "", b }, "");
+    //недочитанный кадр (и его длина) остается в буфере
+    string partial = frame(b).substr(0, 10);
+    checkSplits(parseFrames, "кадр не дочитан", frame(a) + partial, { a }, partial);
+    checkSplits(parseFrames, "длина не дочитана", frame(a) + frame(b).substr(0, 3), { a }, frame(b).substr(0, 3));
+
+    string largest(MAX_FRAME, 'x');
+    checkSplits(parseFrames, "кадр MAX_FRAME", frame(largest) + frame(a), { largest, a }, "");
+    //слишком длинный кадр отвергается по одной длине, не дожидаясь тела
+    string tooLong = frame(string(MAX_FRAME + 1, 'x'));
+    vector<string> requests;
+    string in = frame(a) + tooLong.substr(0, 4);
+    check(!parseFrames(in, requests), "кадр MAX_FRAME + 1");
+    requests.clear();
+    check(!feed(parseFrames, frame(a) + tooLong, { 2, 19, 3 }, requests, in) && requests == vector<string>{ a },
+        "кадр MAX_FRAME + 1 после целого кадра");
+}
+
+/*------HTTP------*/
+//заголовок без тела и остаток буфера после запроса, который нельзя отделить от следующего
+void checkUnframed(const string& name, const string& head, const string& rest) {
+    vector<string> requests;
+    string in = head + rest;
+    check(parseHttpRequests(in, requests) && requests == vector<string>{ head } && in.empty(), name);
+}
+
+void testHttp() {
+    string get = "GET /stats HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    string post = "POST /records HTTP/1.1\r\nContent-Length: 11\r\n\r\n{\"id\": \"1\"}";
+    string old = "GET /top?n=3 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    checkSplits(parseHttpRequests, "GET", get, { get }, "");
+    checkSplits(parseHttpRequests, "POST с телом", post, { post }, "");
+    checkSplits(parseHttpRequests, "HTTP/1.0", old, { old }, "");
+    //пустые строки между запросами пропускаются
+    checkSplits(parseHttpRequests, "конвейер", get + post + "\r\n" + old + post, { get, post, old, post }, "");
+    //без Content-Length тела нет: следующие байты - уже новый запрос
+    string bare = "POST /records HTTP/1.1\r\n\r\n";
+    checkSplits(parseHttpRequests, "без Content-Length", bare + get, { bare, get }, "");
+    string header = "content-length:  11 \r\n";
+    string spaced = "POST /records HTTP/1.1\r\n" + header + "\r\n{\"id\": \"1\"}";
+    checkSplits(parseHttpRequests, "Content-Length с пробелами", spaced + get, { spaced, get }, "");
+    //недочитанные заголовок и тело остаются в буфере
+    checkSplits(parseHttpRequests, "тело не дочитано", get + post.substr(0, post.size() - 1), { get },
+        post.substr(0, post.size() - 1));
+    checkSplits(parseHttpRequests, "заголовок не дочитан", get + "GET /top HTTP/1.1\r\n", { get }, "GET /top HTTP/1.1\r\n");
+    string largest = "POST /records HTTP/1.1\r\nContent-Length: " + to_string(MAX_BODY) + "\r\n\r\n" + string(MAX_BODY, 'x');
+    checkSplits(parseHttpRequests, "тело MAX_BODY", largest + get, { largest, get }, "");
+
+    checkUnframed("Content-Length не число", "POST /records HTTP/1.1\r\nContent-Length: abc\r\n\r\n", "{}" + get);
+    checkUnframed("Content-Length отрицательный", "POST /records HTTP/1.1\r\nContent-Length: -1\r\n\r\n", get);
+    checkUnframed("Content-Length пустой", "POST /records HTTP/1.1\r\nContent-Length:\r\n\r\n", get);
+    checkUnframed("Content-Length больше MAX_BODY",
+        "POST /records HTTP/1.1\r\nContent-Length: " + to_string(MAX_BODY + 1) + "\r\n\r\n", "xx");
+    checkUnframed("Transfer-Encoding", "POST /records HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "5\r\nhello\r\n0\r\n\r\n" + get);
+
+    //заголовок без конца длиннее MAX_HEAD - поток испорчен
+    vector<string> requests;
+    string in = get + "GET /" + string(MAX_HEAD, 'a');
+    check(!parseHttpRequests(in, requests), "заголовок длиннее MAX_HEAD");
+    in = "GET /" + string(MAX_HEAD - 100, 'a') + " HTTP/1.1\r\n";
+    requests.clear();
+    check(parseHttpRequests(in, requests) && requests.empty(), "длинный заголовок не дочитан");
+}
+
+int main() {
+    testFrames();
+    testHttp();
+    cout << "Проверок: " << checks << ", ошибок: " << failures << "\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+//Планировщик против полного прохода: для каждого запроса строки, выбранные по индексу
+//(любой ведущий путь, который выберет планировщик), должны совпасть со строками полного
+//прохода без индекса. Запросы покрывают граничные литералы: дробные годы, числа за
+//пределами int и int16, пустые и полные диапазоны. Индекс строится и по всему каталогу,
+//и по его началу (остальное - хвост без индекса).
+
+#include "planner.h"
+#include "synthetic.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const char* QUERIES[] = {
+    "year>=2000 AND year<=1e10",
+    "year<=3000 AND year>=2000",
+    "year<=1e10",
+    "year<1e10 AND tag:классика",
+    "year>=-1e10 AND year<1900",
+    "year>-1e10",
+    "year<-1e10",
+    "year>1e10",
+    "year>=1e10",
+    "year=1e10",
+    "year!=1e10 AND rating>=9",
+    "year=-1e10",
+    "year!=-1e10 AND tag:роман",
+    "year<=2147483647 AND year>=2147483647",
+    "year>=2147483647",
+    "year>2147483646.5",
+    "year<=-2147483648",
+    "year<-2147483648",
+    "year>=2147483648",
+    "year<=-2147483649",
+    "year=1990.5",
+    "year!=1990.5 AND rating<1",
+    "year>1999.5 AND year<=2003",
+    "year>=1999.5 AND year<2003.5",
+    "year=1990",
+    "year!=1990 AND tag:роман AND rating<=3.5",
+    "year>=32767",
+    "year<=-32768",
+    "year>=40000 AND rating>1",
+    "rating>1e10",
+    "rating<=-1e10",
+    "rating>=-1e10 AND year=1950",
+    "rating<1e10 AND year>1e10",
+    "rating=7.3 AND year<2000",
+    "rating!=5 AND year>=1950 AND year<=1970",
+    "rating>0.7 AND rating<0.95",
+    "title~\"мир\" AND year<=1e10",
+    "author~\"Лев\" AND year>=-1e10 AND year<=1e10",
+    "year>=1950 AND year<=1970 AND rating>=9 ORDER BY rating DESC LIMIT 7",
+    "year<=1e10 ORDER BY year ASC LIMIT 20",
+};
+
+int main() {
+    GeneratorConfig config;
+    config.count = 40000;
+    config.invalidRate = 0;
+    vector<Media> catalog = generateCatalog(config);
+    vector<Media> head(catalog.begin(), catalog.begin() + catalog.size() * 7 / 8);
+    shared_ptr<const CatalogIndex> full = CatalogIndex::build(catalog, 0);
+    shared_ptr<const CatalogIndex> partial = CatalogIndex::build(head, 0);
+
+    int failures = 0, checks = 0;
+    for (const char* text : QUERIES) {
+        CatalogQuery query;
+        string error;
+        if (!parseCatalogQuery(text, query, error)) {
+            cerr << "Ошибка разбора '" << text << "': " << error << "\n";
+            failures++;
+            continue;
+        }
+        QueryPlan scanPlan = planQuery(query, nullptr, catalog.size());
+        vector<size_t> expected = runCatalogQuery(catalog, nullptr, query, scanPlan);
+        for (const CatalogIndex* index : { full.get(), partial.get() }) {
+            QueryPlan plan = planQuery(query, index, catalog.size());
+            vector<size_t> got = runCatalogQuery(catalog, index, query, plan);
+            checks++;
+            if (got != expected) {
+                failures++;
+                cerr << "Не совпало: " << text << " (путь " << accessPathName(plan.driver.path)
+                     << ", строк в индексе " << index->rows() << "): " << got.size()
+                     << " вместо " << expected.size() << "\n";
+            }
+        }
+    }
+    cout << "Проверок: " << checks << ", ошибок: " << failures << "\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+//Сжатые списки строк: encode и decode должны вернуть исходный список, блоки (decodeBlock,
+//blockLast) - его части по POSTING_BLOCK, findBlock и intersectPostings - то же, что
+//простой проход по несжатым спискам. Списки покрывают пустой и из одной строки, длины
+//около границы блока, блоки с большим числом исключений и разности у самого UINT32_MAX.
+
+#include "posting_codec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Case {
+    string name;
+    vector<uint32_t> rows;
+};
+
+//n строк от first с разностями из gap()
+template <typename Gap>
+vector<uint32_t> makeRows(size_t n, uint32_t first, Gap gap) {
+    vector<uint32_t> rows;
+    uint64_t row = first;
+    for (size_t i = 0; i < n && row <= UINT32_MAX; i++) {
+        rows.push_back((uint32_t)row);
+        row += gap(i);
+    }
+    return rows;
+}
+
+vector<Case> makeCases() {
+    mt19937 random(12345);
+    vector<Case> cases;
+    cases.push_back({ "пустой", {} });
+    cases.push_back({ "одна строка 0", { 0 } });
+    cases.push_back({ "одна строка UINT32_MAX", { UINT32_MAX } });
+    cases.push_back({ "0 и UINT32_MAX", { 0, UINT32_MAX } });
+    for (size_t n : { POSTING_BLOCK - 1, POSTING_BLOCK, POSTING_BLOCK + 1,
+                      2 * POSTING_BLOCK - 1, 2 * POSTING_BLOCK, 2 * POSTING_BLOCK + 1 }) {
+        string size = " " + to_string(n);
+        cases.push_back({ "подряд" + size, makeRows(n, 7, [](size_t) { return 1; }) });
+        cases.push_back({ "случайные разности" + size,
+            makeRows(n, 3, [&](size_t) { return 1 + random() % 1000; }) });
+        //каждая восьмая разность на порядки больше остальных - исключения блока
+        cases.push_back({ "исключения" + size,
+            makeRows(n, 0, [&](size_t i) { return i % 8 == 5 ? (1u << 24) + random() % (1u << 20) : 1 + random() % 4; }) });
+        //строки кончаются ровно на UINT32_MAX
+        vector<uint32_t> top = makeRows(n, 0, [](size_t) { return 3; });
+        for (uint32_t& row : top) row += UINT32_MAX - top.back();
+        cases.push_back({ "у UINT32_MAX" + size, top });
+    }
+    //исключения в каждом числе блока и разности почти в 2^32
+    cases.push_back({ "чередование", makeRows(3 * POSTING_BLOCK + 5, 0,
+        [](size_t i) { return i % 2 ? 1u : (1u << 28); }) });
+    cases.push_back({ "огромные разности", makeRows(2 * POSTING_BLOCK, 0,
+        [](size_t i) { return i == 0 ? UINT32_MAX - 4 * POSTING_BLOCK : 1; }) });
+    vector<uint32_t> spread = makeRows(POSTING_BLOCK + 1, 1, [](size_t) { return 33554431u; });
+    cases.push_back({ "разности 2^25", spread });
+    return cases;
+}
+
+int main() {
+    int failures = 0, checks = 0;
+    auto check = [&](bool ok, const string& what) {
+        checks++;
+        if (!ok) {
+            failures++;
+            cerr << "Ошибка: " << what << "\n";
+        }
+    };
+
+    vector<Case> cases = makeCases();
+    vector<CompressedPostings> encoded;
+    for (const Case& c : cases) {
+        CompressedPostings list = CompressedPostings::encode(c.rows);
+        check(list.size() == c.rows.size() && list.empty() == c.rows.empty(), c.name + ": размер");
+        check(list.decode() == c.rows, c.name + ": decode");
+        check(list.blockCount() == (c.rows.size() + POSTING_BLOCK - 1) / POSTING_BLOCK, c.name + ": число блоков");
+
+        //блоки по порядку составляют весь список
+        vector<uint32_t> blocks;
+        uint32_t buffer[POSTING_BLOCK];
+        for (size_t b = 0; b < list.blockCount(); b++) {
+            size_t n = list.blockSize(b);
+            list.decodeBlock(b, buffer);
+            check(n > 0 && list.blockLast(b) == buffer[n - 1], c.name + ": последняя строка блока " + to_string(b));
+            blocks.insert(blocks.end(), buffer, buffer + n);
+        }
+        check(blocks == c.rows, c.name + ": decodeBlock");
+
+        //findBlock - первый блок от from с последней строкой не меньше target
+        vector<uint32_t> targets = { 0, 1, UINT32_MAX };
+        for (size_t i = 0; i < c.rows.size(); i += 37) {
+            targets.push_back(c.rows[i]);
+            if (c.rows[i] < UINT32_MAX) targets.push_back(c.rows[i] + 1);
+        }
+        for (size_t from = 0; from <= list.blockCount(); from++) {
+            for (uint32_t target : targets) {
+                size_t expected = from;
+                while (expected < list.blockCount() && list.blockLast(expected) < target) expected++;
+                if (list.findBlock(from, target) != expected) {
+                    check(false, c.name + ": findBlock(" + to_string(from) + ", " + to_string(target) + ")");
+                }
+            }
+        }
+        checks++;
+        encoded.push_back(move(list));
+    }
+
+    //пересечение каждой пары - как у несжатых списков
+    for (size_t a = 0; a < cases.size(); a++) {
+        for (size_t b = a; b < cases.size(); b++) {
+            vector<uint32_t> expected;
+            set_intersection(cases[a].rows.begin(), cases[a].rows.end(), cases[b].rows.begin(), cases[b].rows.end(),
+                back_inserter(expected));
+            check(intersectPostings({ &encoded[a], &encoded[b] }) == expected,
+                "пересечение '" + cases[a].name + "' и '" + cases[b].name + "'");
+        }
+    }
+    check(intersectPostings({}).empty(), "пересечение без списков");
+
+    cout << "Проверок: " << checks << ", ошибок: " << failures << "\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+//Кэш результатов и вставки: результат, в который может попасть новая запись, удаляется
+//из кэша; остальные переносятся на новую версию и должны совпасть с подсчетом заново.
+//Для каждого кэшируемого запроса (search по названию и по автору, tag, полный и неполный
+//top, stats) вставляются подходящая и неподходящая записи. Запросы без кэша (years,
+//query) и search через контекст сервера после вставки должны видеть новую запись.
+
+#include "query.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int failures = 0, checks = 0;
+
+void check(bool ok, const string& what) {
+    checks++;
+    if (!ok) {
+        failures++;
+        cerr << "Ошибка: " << what << "\n";
+    }
+}
+
+vector<Media> baseCatalog() {
+    return {
+        Media("1", "Война и мир", "Лев Толстой", 1869, { "роман", "классика" }, 9.1),
+        Media("2", "Анна Каренина", "Лев Толстой", 1877, { "роман" }, 8.7),
+        Media("3", "Мертвые души", "Николай Гоголь", 1842, { "поэма" }, 8.2),
+        Media("4", "Ревизор", "Николай Гоголь", 1836, { "пьеса" }, 7.9),
+        Media("5", "Стихотворения", "Александр Пушкин", 1829, { "поэзия" }, 6.5),
+    };
+}
+
+struct Case {
+    string name;
+    CacheQuery query;
+    Media matching; //результат запроса может измениться
+    Media other;    //не может (id пустой - такой записи нет)
+};
+
+//результат запроса по текущей версии: из кэша (cached) или подсчетом без кэша
+shared_ptr<const CachedResult> currentResult(CatalogStore& store, QueryCache& cache, const CacheQuery& q) {
+    CatalogSnapshot snapshot = store.snapshot();
+    return runCachedQuery(cache, snapshot.records(), snapshot.version(), q);
+}
+
+bool sameResult(const CachedResult& a, const CachedResult& b) {
+    return a.rows == b.rows && a.stats.total == b.stats.total && a.minRating == b.minRating;
+}
+
+//запрос кэшируется, затем вставляется record: запись кэша должна остаться (kept) или
+//исчезнуть, а ответ после вставки - совпасть с подсчетом без кэша
+void checkInsert(const Case& c, const Media& record, bool kept) {
+    QueryCache cache;
+    QueryCache uncached(0);
+    CatalogStore store(baseCatalog());
+    store.attachCache(&cache);
+    string key = QueryCache::makeKey(c.query);
+    currentResult(store, cache, c.query);
+    check(store.insert(record), c.name + ": вставка " + record.title);
+    uint64_t version = store.snapshot().version();
+    string what = c.name + " после вставки '" + record.title + "'";
+    check((cache.get(key, version) != nullptr) == kept, what + (kept ? ": результат удален" : ": результат остался"));
+    check(sameResult(*currentResult(store, cache, c.query), *currentResult(store, uncached, c.query)),
+        what + ": ответ не совпал с подсчетом заново");
+    store.attachCache(nullptr);
+}
+
+vector<Case> makeCases() {
+    CacheQuery search{ "search", "мир", 0 };
+    CacheQuery author{ "search", "Толстой", 0 };
+    CacheQuery tag{ "tag", "роман", 0 };
+    CacheQuery top{ "top", "", 3 };
+    CacheQuery partialTop{ "top", "", 10 }; //в каталоге меньше 10 записей
+    CacheQuery stats{ "stats", "", 0 };
+    return {
+        { "search", search, Media("n1", "Миры и мир", "Иван Ефремов", 1957, { "фантастика" }, 5.0),
+            Media("n2", "Отцы и дети", "Иван Тургенев", 1862, { "роман" }, 8.0) },
+        { "search по автору", author, Media("n1", "Петр Первый", "Алексей Толстой", 1934, { "роман" }, 7.0),
+            Media("n2", "Записки охотника", "Иван Тургенев", 1852, { "рассказы" }, 7.5) },
+        { "tag", tag, Media("n1", "Обломов", "Иван Гончаров", 1859, { "роман" }, 7.8),
+            Media("n2", "Гроза", "Александр Островский", 1859, { "пьеса" }, 7.0) },
+        //рейтинг, равный последнему в топе, в топ не попадает: новая строка идет после старых
+        { "top", top, Media("n1", "Идиот", "Федор Достоевский", 1869, { "роман" }, 8.5),
+            Media("n2", "Бесы", "Федор Достоевский", 1872, { "роман" }, 8.2) },
+        { "неполный top", partialTop, Media("n1", "Черновик", "Неизвестный автор", 1900, {}, 0.5), Media() },
+        { "stats", stats, Media("n1", "Черновик", "Неизвестный автор", 1900, {}, 0.5), Media() },
+    };
+}
+
+//ответ сервера на запрос JSON содержит запись с этим id
+bool answerHas(QueryContext& context, const string& json, const string& id) {
+    string out;
+    executeQueryJson(context, json, out);
+    return out.find("\"id\": \"" + id + "\"") != string::npos;
+}
+
+void testContext() {
+    CatalogStore store(baseCatalog());
+    QueryContext context(store, "", 5);
+    const char* queries[] = {
+        "{\"op\": \"search\", \"text\": \"Обломов\"}",
+        "{\"op\": \"tag\", \"tag\": \"роман\"}",
+        "{\"op\": \"top\", \"n\": 3}",
+        "{\"op\": \"years\", \"from\": 1850, \"to\": 1870}",
+        "{\"op\": \"query\", \"q\": \"tag:роман AND year>=1850\"}",
+    };
+    for (const char* q : queries) check(!answerHas(context, q, "n1"), string("до вставки: ") + q);
+    check(store.insert(Media("n1", "Обломов", "Иван Гончаров", 1859, { "роман" }, 9.5)), "вставка через контекст");
+    for (const char* q : queries) check(answerHas(context, q, "n1"), string("после вставки: ") + q);
+}
+
+int main() {
+    for (const Case& c : makeCases()) {
+        checkInsert(c, c.matching, false);
+        if (!c.other.id.empty()) checkInsert(c, c.other, true);
+    }
+    testContext();
+    cout << "Проверок: " << checks << ", ошибок: " << failures << "\n";
+    return failures == 0 ? 0 : 1;
+}
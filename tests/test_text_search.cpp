@@ -0,0 +1,54 @@
+//WAND против полного подсчета: для каждого запроса и веса рейтинга первые k записей
+//(строки и оценки, с учетом равных оценок) должны совпасть с подсчетом оценки каждой
+//записи из списков. Каталог - сгенерированный (все слова частые) и его копия с редким
+//словом в части записей, где отсечение по границам срабатывает чаще.
+
+#include "text_search.h"
+#include "synthetic.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main() {
+    GeneratorConfig config;
+    config.count = 30000;
+    config.invalidRate = 0;
+    vector<Media> catalog = generateCatalog(config);
+    vector<Media> rare = catalog;
+    for (size_t i = 0; i < rare.size(); i += 300) rare[i].title += " Фолиант";
+
+    vector<string> queries;
+    for (size_t i = 0; i < catalog.size() && queries.size() < 40; i += 701) {
+        queries.push_back(catalog[i].title);
+        queries.push_back("фолиант " + catalog[i].title.substr(0, catalog[i].title.find(' ')));
+    }
+    queries.push_back("фолиант");
+
+    int failures = 0, checks = 0;
+    for (const vector<Media>* source : { &catalog, &rare }) {
+        shared_ptr<const TextIndex> index = TextIndex::build(*source, 0);
+        for (const string& q : queries) {
+            for (double weight : { 0.0, 1.0, 5.0 }) {
+                for (size_t k : { 1, 10, 100 }) {
+                    vector<TextMatch> got = index->search(q, k, weight);
+                    vector<TextMatch> expected = index->searchExhaustive(q, k, weight);
+                    checks++;
+                    bool same = got.size() == expected.size();
+                    for (size_t i = 0; same && i < got.size(); i++) {
+                        same = got[i].row == expected[i].row && got[i].score == expected[i].score;
+                    }
+                    if (!same) {
+                        failures++;
+                        cerr << "Не совпало: '" << q << "' w=" << weight << " k=" << k << ": " << got.size()
+                             << " записей вместо " << expected.size() << "\n";
+                    }
+                }
+            }
+        }
+    }
+    cout << "Проверок: " << checks << ", ошибок: " << failures << "\n";
+    return failures == 0 ? 0 : 1;
+}